@@ -17,6 +17,10 @@ DMA_BUFFER uint32_t int_adc1_dma_buffer[INT_ADC_MAX_BUFFER_LENGTH]; //do not use
 int8_t int_adc_set_nsamp(struct int_adc_dev_s *self, uint16_t nsamp);
 int8_t int_adc_arm(struct int_adc_dev_s *self);
 uint32_t* int_adc_get_data(struct int_adc_dev_s *self);
+int8_t int_adc_start_stream(struct int_adc_dev_s *self);
+int8_t int_adc_stop_stream(struct int_adc_dev_s *self);
+uint32_t* int_adc_get_block(struct int_adc_dev_s *self);
+int8_t int_adc_release_block(struct int_adc_dev_s *self);
 
 static struct int_adc_dev_s *int_adc_devGlob=0; //required for ISR/Callback fct. works only for one instance!
 
@@ -24,10 +28,16 @@ static struct int_adc_dev_s *int_adc_devGlob=0; //required for ISR/Callback fct.
 void int_adc_dev_init(struct int_adc_dev_s *self, struct tim_dev_s *tim_dev, ADC_HandleTypeDef *hadc)
 {
     self->hadc = hadc;
+    self->tim_dev = tim_dev;
     self->set_nsamp = &int_adc_set_nsamp;
     self->arm = &int_adc_arm;
     self->get_data = &int_adc_get_data;
+    self->start_stream = &int_adc_start_stream;
+    self->stop_stream = &int_adc_stop_stream;
+    self->get_block = &int_adc_get_block;
+    self->release_block = &int_adc_release_block;
     self->nsamp = INT_ADC_MAX_BUFFER_LENGTH;
+    self->streaming = 0;
 }
 
 int8_t int_adc_set_nsamp(struct int_adc_dev_s *self, uint16_t nsamp)
@@ -52,6 +62,11 @@ int8_t int_adc_arm(struct int_adc_dev_s *self)
         errno = EOVERFLOW;
         return 0;
     }
+    if(self->streaming)
+    {
+        errno = EBUSY;
+        return -1;
+    }
     int_adc_devGlob = self;
     int_adc_devGlob->data_avail = 0;
     // conversion clock is generated by timer, arming does not collect samples until the timer is started
@@ -67,14 +82,123 @@ int8_t int_adc_arm(struct int_adc_dev_s *self)
     return 0;
 }
 
+// half h is filled, the DMA goes on with the other one
+static void int_adc_half_done(struct int_adc_dev_s *self, int8_t h)
+{
+    int8_t other = 1-h;
+    if(self->ready_half == other)
+    {
+        self->ready_half = -1; //not taken in time, overwritten from now on
+        self->overruns++;
+    }
+    if(self->owned_half == other && !self->owned_lost)
+    {
+        self->owned_lost = 1;
+        self->overruns++;
+    }
+    self->ready_half = h;
+}
+
+int8_t int_adc_start_stream(struct int_adc_dev_s *self)
+{
+    if(self->nsamp > INT_ADC_MAX_BUFFER_LENGTH || self->nsamp < 2 || (self->nsamp & 1))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(self->hadc->DMA_Handle->Init.Mode != DMA_CIRCULAR ||
+       self->hadc->Init.ConversionDataManagement != ADC_CONVERSIONDATA_DMA_CIRCULAR)
+    {
+        errno = EINVAL; //see the CubeMX configuration in internal_adc.h
+        return -1;
+    }
+    int_adc_devGlob = self;
+    self->data_avail = 0;
+    self->ready_half = -1;
+    self->owned_half = -1;
+    self->owned_lost = 0;
+    self->overruns = 0;
+    self->blocks = 0;
+    self->streaming = 1;
+    // like arm, samples are collected once the timer runs
+    if(HAL_ADC_Start_DMA(self->hadc, &int_adc1_dma_buffer[0], self->nsamp) != HAL_OK)
+    {
+        self->streaming = 0;
+        errno = EBUSY;
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t int_adc_stop_stream(struct int_adc_dev_s *self)
+{
+    HAL_StatusTypeDef result = HAL_ADC_Stop_DMA(self->hadc);
+    self->streaming = 0;
+    self->ready_half = -1;
+    if(result != HAL_OK)
+    {
+        errno = EIO;
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
+
+uint32_t* int_adc_get_block(struct int_adc_dev_s *self)
+{
+    uint32_t *block = NULL;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if(self->owned_half < 0 && self->ready_half >= 0)
+    {
+        self->owned_half = self->ready_half;
+        self->ready_half = -1;
+        self->owned_lost = 0;
+        self->blocks++;
+        block = &int_adc1_dma_buffer[self->owned_half * (self->nsamp/2)];
+    }
+    __set_PRIMASK(primask);
+    return block;
+}
+
+int8_t int_adc_release_block(struct int_adc_dev_s *self)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t lost = self->owned_lost;
+    self->owned_half = -1;
+    self->owned_lost = 0;
+    __set_PRIMASK(primask);
+    if(lost)
+    {
+        errno = EOVERFLOW; //the samples in the block are not consistent
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
+
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc)
 {
+    if(int_adc_devGlob->streaming)
+    {
+        int_adc_half_done(int_adc_devGlob, 1);
+        return;
+    }
+    if(hadc->DMA_Handle->Init.Mode == DMA_CIRCULAR)
+    {
+        HAL_ADC_Stop_DMA(hadc); //keep the snapshot of arm
+    }
     int_adc_devGlob->data_avail = 1;
 }
 
 void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc)
 {
-  
+    if(int_adc_devGlob->streaming)
+    {
+        int_adc_half_done(int_adc_devGlob, 0);
+    }
 }
 
 uint32_t* int_adc_get_data(struct int_adc_dev_s *self)
@@ -22,6 +22,21 @@ struct int_adc_dev_s
     uint32_t* (*get_data) (struct int_adc_dev_s *self); //returns pointer to sampled data
     uint8_t data_avail; //flag showing availability of data (conversion done)
     int16_t nsamp;
+    // Streaming: the DMA fills the buffer of nsamp samples circularly, every
+    // finished half becomes a block of nsamp/2 samples the application owns
+    // from get_block to release_block, while the DMA fills the other half.
+    // Needs the ADC (Conversion Data Management: DMA Circular) and its DMA
+    // (Mode: Circular) configured so in CubeMX, arm works with it as well.
+    int8_t (*start_stream) (struct int_adc_dev_s *self);
+    int8_t (*stop_stream) (struct int_adc_dev_s *self);
+    uint32_t* (*get_block) (struct int_adc_dev_s *self); //next filled block, NULL if none
+    int8_t (*release_block) (struct int_adc_dev_s *self); //-1 and EOVERFLOW if it was overwritten meanwhile
+    uint8_t streaming;
+    volatile int8_t ready_half; //filled and not taken, -1 none
+    volatile int8_t owned_half; //held by the application, -1 none
+    volatile uint8_t owned_lost; //the DMA reached the owned half before it was released
+    volatile uint32_t overruns; //blocks lost because the application was late
+    uint32_t blocks; //blocks handed out
     //TODO: consider using a vtable
 };
 
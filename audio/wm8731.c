@@ -15,6 +15,26 @@ static volatile uint8_t wm8731_nextOutBuf=0, //next available half of output buf
 
 static struct wm8731_dev_s *wm8731_devGlob=0; //required for ISR/Callback fct.
 
+// register values after reset (datasheet register map), R10..R14 do not exist
+static const uint16_t wm8731_defaults[WM8731_NUM_REGS] = {
+    0x097, 0x097, 0x079, 0x079, 0x00A, 0x008, 0x09F, 0x00A, 0x000, 0x000,
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000
+};
+
+// the chip can not be read, the reset register has to be written every time
+static const uint8_t wm8731_policy[WM8731_NUM_REGS] = {
+    REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY,
+    REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY,
+    REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY,
+    REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_VOLATILE
+};
+
+// 7 bit address and 9 bit value per transfer
+static int8_t wm8731_regmap_write(struct regmap_s *map, uint16_t reg, uint16_t val)
+{
+    return wm8731_writeReg((struct wm8731_dev_s *)map->ctx, reg, val);
+}
+
 void HAL_SAI_TxHalfCpltCallback(SAI_HandleTypeDef *hsai)
 {
     wm8731_nextOutBuf=0;
@@ -60,6 +80,11 @@ void wm8731_init(struct wm8731_dev_s *self, struct i2c_dev_s *i2c_dev,
     self->startAdcDma = &wm8731_startAdcDma;
     self->putOutBuf = &wm8731_putOutBuf;
     self->getInBuf = &wm8731_getInBuf;
+
+    regmap_init(&self->map, self->reg, self->reg_dirty, self->reg_valid, WM8731_NUM_REGS, wm8731_policy);
+    self->map.ctx = self;
+    self->map.write_reg = &wm8731_regmap_write;
+    self->map.read_reg = NULL;
 }
 
 
@@ -118,19 +143,23 @@ int8_t wm8731_writeReg(struct wm8731_dev_s *self, uint8_t regadr, uint16_t val)
     uint8_t data[2];
     data[0]=((regadr&0x7F)<<1)+((val&0x0100)>>8); //left 7 bits are register adr, one data bit (MSB) right
     data[1]=val&0x00FF; //8 lower data bits
-    return self->i2c_dev->master_transmit(self->i2c_dev, self->hw_adr, &data[0], 2, 0xFFFFFFFF);
+    return self->i2c_dev->master_transmit(self->i2c_dev, self->hw_adr, &data[0], 2, I2C_TIMEOUT_MS);
     //HAL_I2C_Master_Transmit(&hi2c2, addr, &data[0], size, timeout);
 }
 
 int8_t wm8731_reset(struct wm8731_dev_s *self)
 {
     int8_t error=0;
-    self->reg[WM8731_RESET_ADR]=0u; //writing 0 resets device
-    error+=wm8731_writeReg(self, WM8731_RESET_ADR, self->reg[WM8731_RESET_ADR]);
+    uint16_t val;
+    val=0u; //writing 0 resets device
+    error+=regmap_write(&self->map, WM8731_RESET_ADR, val);
+    if(!error)
+    {
+        regmap_set_defaults(&self->map, wm8731_defaults); //later writes of reset values are skipped
+    }
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -142,12 +171,12 @@ int8_t wm8731_reset(struct wm8731_dev_s *self)
 int8_t wm8731_disable_power_down(struct wm8731_dev_s *self)
 {
     int8_t error=0;
-    self->reg[WM8731_PWR_DOWN_CTRL_ADR]=0u; //writing 0 enables all components
-    error+=wm8731_writeReg(self, WM8731_PWR_DOWN_CTRL_ADR, self->reg[WM8731_PWR_DOWN_CTRL_ADR]);
+    uint16_t val;
+    val=0u; //writing 0 enables all components
+    error+=regmap_write(&self->map, WM8731_PWR_DOWN_CTRL_ADR, val);
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -159,22 +188,22 @@ int8_t wm8731_disable_power_down(struct wm8731_dev_s *self)
 int8_t wm8731_set_interface_format(struct wm8731_dev_s *self)
 {    
     int8_t error=0;
+    uint16_t val;
     //16bit, DSP Mode: MSB on 1st BCLK, WM8731 is master
-    self->reg[WM8731_DIG_INTERFACE_FMT_ADR] = 0u;
-    self->reg[WM8731_DIG_INTERFACE_FMT_ADR] &= ~(1<<WM8731_BCLKINV_BIT_NUM); //0: clk not inverted
-    // self->reg[WM8731_DIG_INTERFACE_FMT_ADR] |= (1<<WM8731_BCLKINV_BIT_NUM); //1: clk inverted
-    self->reg[WM8731_DIG_INTERFACE_FMT_ADR] |= (1<<WM8731_MS_BIT_NUM); //1: WM8731 is master
-    self->reg[WM8731_DIG_INTERFACE_FMT_ADR] &= ~(1<<WM8731_LRSWAP_BIT_NUM); //0: L/R not swapped
-    self->reg[WM8731_DIG_INTERFACE_FMT_ADR] &= ~(1<<WM8731_LRP_BIT_NUM); //0: MSB is available on 1st BCLK rising edge after DACLRC rising edge
-    // self->reg[WM8731_DIG_INTERFACE_FMT_ADR] |= (1<<WM8731_LRP_BIT_NUM); //1: MSB is available on 2nd BCLK rising edge after DACLRC rising edge
-    self->reg[WM8731_DIG_INTERFACE_FMT_ADR] &= ~(WM8731_IWL_MASK); //all 0: 16 bits
-    self->reg[WM8731_DIG_INTERFACE_FMT_ADR] |= (WM8731_FORMAT_MASK); //all 1: DSP Mode, frame sync + 2 data packed word
-    error+=wm8731_writeReg(self, WM8731_DIG_INTERFACE_FMT_ADR, self->reg[WM8731_DIG_INTERFACE_FMT_ADR]);
+    val=0u;
+    val &= ~(1<<WM8731_BCLKINV_BIT_NUM); //0: clk not inverted
+    // val |= (1<<WM8731_BCLKINV_BIT_NUM); //1: clk inverted
+    val |= (1<<WM8731_MS_BIT_NUM); //1: WM8731 is master
+    val &= ~(1<<WM8731_LRSWAP_BIT_NUM); //0: L/R not swapped
+    val &= ~(1<<WM8731_LRP_BIT_NUM); //0: MSB is available on 1st BCLK rising edge after DACLRC rising edge
+    // val |= (1<<WM8731_LRP_BIT_NUM); //1: MSB is available on 2nd BCLK rising edge after DACLRC rising edge
+    val &= ~(WM8731_IWL_MASK); //all 0: 16 bits
+    val |= (WM8731_FORMAT_MASK); //all 1: DSP Mode, frame sync + 2 data packed word
+    error+=regmap_write(&self->map, WM8731_DIG_INTERFACE_FMT_ADR, val);
 
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -186,35 +215,35 @@ int8_t wm8731_set_interface_format(struct wm8731_dev_s *self)
 int8_t wm8731_set_sampling_rate(struct wm8731_dev_s *self, enum wm8731_sr sr)
 {
     int8_t error=0;
+    uint16_t val;
     switch(sr)
     {
         case ADC48_DAC48:
-            self->reg[WM8731_SAMPLING_CTRL_ADR]=0u;
-            self->reg[WM8731_SAMPLING_CTRL_ADR] &= ~(1<<WM8731_CLKODIV2_BIT_NUM); //0: clk out not divided
-            self->reg[WM8731_SAMPLING_CTRL_ADR] &= ~(1<<WM8731_CLKIDIV2_BIT_NUM); //0: clk in not divided
-            self->reg[WM8731_SAMPLING_CTRL_ADR] &= ~(WM8731_SR_MASK);
-            self->reg[WM8731_SAMPLING_CTRL_ADR] &= ~(1<<WM8731_BOSR_BIT_NUM);
-            self->reg[WM8731_SAMPLING_CTRL_ADR] |= (1<<WM8731_USB_NORM_BIT_NUM); //1: USB mode (clk is 12 MHz)
+            val=0u;
+            val &= ~(1<<WM8731_CLKODIV2_BIT_NUM); //0: clk out not divided
+            val &= ~(1<<WM8731_CLKIDIV2_BIT_NUM); //0: clk in not divided
+            val &= ~(WM8731_SR_MASK);
+            val &= ~(1<<WM8731_BOSR_BIT_NUM);
+            val |= (1<<WM8731_USB_NORM_BIT_NUM); //1: USB mode (clk is 12 MHz)
             break;
         case ADC8_DAC8:
-            self->reg[WM8731_SAMPLING_CTRL_ADR]=0u;
-            self->reg[WM8731_SAMPLING_CTRL_ADR] &= ~(1<<WM8731_CLKODIV2_BIT_NUM); //0: clk out not divided
-            self->reg[WM8731_SAMPLING_CTRL_ADR] &= ~(1<<WM8731_CLKIDIV2_BIT_NUM); //0: clk in not divided
-            self->reg[WM8731_SAMPLING_CTRL_ADR] |= (3<<WM8731_SR_BIT_NUM);
-            self->reg[WM8731_SAMPLING_CTRL_ADR] &= ~(1<<WM8731_BOSR_BIT_NUM);
-            self->reg[WM8731_SAMPLING_CTRL_ADR] |= (1<<WM8731_USB_NORM_BIT_NUM); //1: USB mode (clk is 12 MHz)
+            val=0u;
+            val &= ~(1<<WM8731_CLKODIV2_BIT_NUM); //0: clk out not divided
+            val &= ~(1<<WM8731_CLKIDIV2_BIT_NUM); //0: clk in not divided
+            val |= (3<<WM8731_SR_BIT_NUM);
+            val &= ~(1<<WM8731_BOSR_BIT_NUM);
+            val |= (1<<WM8731_USB_NORM_BIT_NUM); //1: USB mode (clk is 12 MHz)
             break;
         default:
             errno=EINVAL;
             return -1;
             break;
     }
-    error+=wm8731_writeReg(self, WM8731_SAMPLING_CTRL_ADR, self->reg[WM8731_SAMPLING_CTRL_ADR]);
+    error+=regmap_write(&self->map, WM8731_SAMPLING_CTRL_ADR, val);
 
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -226,21 +255,21 @@ int8_t wm8731_set_sampling_rate(struct wm8731_dev_s *self, enum wm8731_sr sr)
 int8_t wm8731_conf_analog_path(struct wm8731_dev_s *self)
 {
     int8_t error=0;
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR]=0u;
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR] &= ~(WM8731_SIDEATT_MASK); //all 0: 6dB attenuation of sidetone
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_SIDETONE_BIT_NUM); //0: no sidetone
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR] |= (1<<WM8731_DACSEL_BIT_NUM); //1: enable DAC
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_BYPASS_BIT_NUM); //0: no bypass
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_INSEL_BIT_NUM); //0: select line in
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_MUTEMIC_BIT_NUM); //0: disable micmute
-    self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_MICBOOST_BIT_NUM); //0: no mic boost
-
-    error+=wm8731_writeReg(self, WM8731_ANALOG_AUDIO_PATH_CTRL_ADR, self->reg[WM8731_ANALOG_AUDIO_PATH_CTRL_ADR]);
+    uint16_t val;
+    val=0u;
+    val &= ~(WM8731_SIDEATT_MASK); //all 0: 6dB attenuation of sidetone
+    val &= ~(1<<WM8731_SIDETONE_BIT_NUM); //0: no sidetone
+    val |= (1<<WM8731_DACSEL_BIT_NUM); //1: enable DAC
+    val &= ~(1<<WM8731_BYPASS_BIT_NUM); //0: no bypass
+    val &= ~(1<<WM8731_INSEL_BIT_NUM); //0: select line in
+    val &= ~(1<<WM8731_MUTEMIC_BIT_NUM); //0: disable micmute
+    val &= ~(1<<WM8731_MICBOOST_BIT_NUM); //0: no mic boost
+
+    error+=regmap_write(&self->map, WM8731_ANALOG_AUDIO_PATH_CTRL_ADR, val);
 
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -252,18 +281,18 @@ int8_t wm8731_conf_analog_path(struct wm8731_dev_s *self)
 int8_t wm8731_conf_digital_path(struct wm8731_dev_s *self)
 {
     int8_t error=0;
-    self->reg[WM8731_DIG_AUDIO_PATH_CTRL_ADR]=0u;
-    self->reg[WM8731_DIG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_HPOR_BIT_NUM); //0: clear dc offset when highpass enabled
-    self->reg[WM8731_DIG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_DACMU_BIT_NUM); //0: disable DAC mute
-    self->reg[WM8731_DIG_AUDIO_PATH_CTRL_ADR] &= ~(WM8731_DEEMPH_MASK); //00: disable de-emphasis control
-    self->reg[WM8731_DIG_AUDIO_PATH_CTRL_ADR] &= ~(1<<WM8731_ADCHPD_BIT_NUM); //0: enable ADC highpass filter
+    uint16_t val;
+    val=0u;
+    val &= ~(1<<WM8731_HPOR_BIT_NUM); //0: clear dc offset when highpass enabled
+    val &= ~(1<<WM8731_DACMU_BIT_NUM); //0: disable DAC mute
+    val &= ~(WM8731_DEEMPH_MASK); //00: disable de-emphasis control
+    val &= ~(1<<WM8731_ADCHPD_BIT_NUM); //0: enable ADC highpass filter
 
-    error+=wm8731_writeReg(self, WM8731_DIG_AUDIO_PATH_CTRL_ADR, self->reg[WM8731_DIG_AUDIO_PATH_CTRL_ADR]);
+    error+=regmap_write(&self->map, WM8731_DIG_AUDIO_PATH_CTRL_ADR, val);
 
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -275,22 +304,22 @@ int8_t wm8731_conf_digital_path(struct wm8731_dev_s *self)
 int8_t wm8731_conf_linein(struct wm8731_dev_s *self, float_t volume_db)
 {
     int8_t error=0;
-    self->reg[WM8731_LEFT_LINE_IN_ADR]=0u;
-    self->reg[WM8731_LEFT_LINE_IN_ADR] &= ~(1<<WM8731_LRINBOTH_BIT_NUM); //0: decouple left and right channel
-    self->reg[WM8731_LEFT_LINE_IN_ADR] &= ~(1<<WM8731_LINMUTE_BIT_NUM); //0: disable mute
-    self->reg[WM8731_LEFT_LINE_IN_ADR] |= (0b10111<<WM8731_LINVOL_BIT_NUM)&WM8731_LINVOL_MASK; //0b10111: default 0dB
-    error+=wm8731_writeReg(self, WM8731_LEFT_LINE_IN_ADR, self->reg[WM8731_LEFT_LINE_IN_ADR]);
-
-    self->reg[WM8731_RIGHT_LINE_IN_ADR]=0u;
-    self->reg[WM8731_RIGHT_LINE_IN_ADR] &= ~(1<<WM8731_RLINBOTH_BIT_NUM); //0: decouple left and right channel
-    self->reg[WM8731_RIGHT_LINE_IN_ADR] &= ~(1<<WM8731_RINMUTE_BIT_NUM); //0: disable mute
-    self->reg[WM8731_RIGHT_LINE_IN_ADR] |= (0b10111<<WM8731_RINVOL_BIT_NUM)&WM8731_RINVOL_MASK; //0b10111: default 0dB
-    error+=wm8731_writeReg(self, WM8731_RIGHT_LINE_IN_ADR, self->reg[WM8731_RIGHT_LINE_IN_ADR]);
+    uint16_t val;
+    val=0u;
+    val &= ~(1<<WM8731_LRINBOTH_BIT_NUM); //0: decouple left and right channel
+    val &= ~(1<<WM8731_LINMUTE_BIT_NUM); //0: disable mute
+    val |= (0b10111<<WM8731_LINVOL_BIT_NUM)&WM8731_LINVOL_MASK; //0b10111: default 0dB
+    error+=regmap_write(&self->map, WM8731_LEFT_LINE_IN_ADR, val);
+
+    val=0u;
+    val &= ~(1<<WM8731_RLINBOTH_BIT_NUM); //0: decouple left and right channel
+    val &= ~(1<<WM8731_RINMUTE_BIT_NUM); //0: disable mute
+    val |= (0b10111<<WM8731_RINVOL_BIT_NUM)&WM8731_RINVOL_MASK; //0b10111: default 0dB
+    error+=regmap_write(&self->map, WM8731_RIGHT_LINE_IN_ADR, val);
 
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -302,12 +331,12 @@ int8_t wm8731_conf_linein(struct wm8731_dev_s *self, float_t volume_db)
 int8_t wm8731_activate(struct wm8731_dev_s *self)
 {
     int8_t error=0;
-    self->reg[WM8731_ACTIVE_CTRL_ADR]=0u|(1<<WM8731_ACTIVE_BIT_NUM);
-    error+=wm8731_writeReg(self, WM8731_ACTIVE_CTRL_ADR, self->reg[WM8731_ACTIVE_CTRL_ADR]);
+    uint16_t val;
+    val=0u|(1<<WM8731_ACTIVE_BIT_NUM);
+    error+=regmap_write(&self->map, WM8731_ACTIVE_CTRL_ADR, val);
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include "i2c_hal.h"
+#include "regmap.h"
 #include "main.h"
 
 /* Register addresses */
@@ -24,6 +25,7 @@
 #define WM8731_SAMPLING_CTRL_ADR (0x8)
 #define WM8731_ACTIVE_CTRL_ADR (0x9)
 #define WM8731_RESET_ADR (0xF)
+#define WM8731_NUM_REGS (16)
 
 /* REG0 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
 #define WM8731_LRINBOTH_BIT_NUM (8u)
@@ -131,7 +133,10 @@ struct wm8731_dev_s
     void (*getInBuf) (struct wm8731_dev_s *self, int16_t *data);
 
     uint8_t hw_adr; /**< hardware address of chip */
-    uint16_t reg[16]; /**<  */
+    struct regmap_s map; /**< shadow of the registers, values already in the chip are not written again */
+    uint16_t reg[WM8731_NUM_REGS]; /**<  */
+    uint32_t reg_dirty[REGMAP_BITMAP_WORDS(WM8731_NUM_REGS)];
+    uint32_t reg_valid[REGMAP_BITMAP_WORDS(WM8731_NUM_REGS)];
 };
 
 void wm8731_init(struct wm8731_dev_s *self, struct i2c_dev_s *i2c_dev,
@@ -0,0 +1,215 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Bus transaction trace and latency profiler for the I2C and SPI drivers */
+#include "bus_trace.h"
+
+#ifdef BUS_TRACE
+
+#include <errno.h>
+#include <string.h>
+#include "stm32h7xx_hal.h"
+
+#if (BUS_TRACE_RING_SIZE & (BUS_TRACE_RING_SIZE - 1)) != 0
+#error "BUS_TRACE_RING_SIZE has to be a power of two"
+#endif
+
+// seq is the record index + 1 once the slot is written, 0 while it is written
+struct bus_trace_slot_s
+{
+    uint32_t seq;
+    struct bus_trace_rec_s rec;
+};
+
+// The ring has several writers (interrupts of different priority, main loop)
+// that claim slots by an atomic increment of head and never wait. The reader
+// detects slots overwritten while it copies them by their sequence number.
+static struct bus_trace_slot_s bus_trace_ring[BUS_TRACE_RING_SIZE];
+static uint32_t bus_trace_head;
+static uint32_t bus_trace_tail;
+static uint32_t bus_trace_lost;
+
+static struct bus_trace_dev_s bus_trace_devs[BUS_TRACE_DEVICES];
+static uint8_t bus_trace_ndev;
+static uint32_t bus_trace_reset_tick;
+
+uint32_t bus_trace_now(void)
+{
+    return DWT->CYCCNT;
+}
+
+void bus_trace_reset(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(bus_trace_devs, 0, sizeof(bus_trace_devs));
+    bus_trace_ndev = 0;
+    bus_trace_tail = __atomic_load_n(&bus_trace_head, __ATOMIC_RELAXED);
+    bus_trace_lost = 0;
+    bus_trace_reset_tick = HAL_GetTick();
+    __set_PRIMASK(primask);
+}
+
+void bus_trace_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55; //unlock, required on some Cortex-M7
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    bus_trace_reset();
+}
+
+static inline uint8_t bus_trace_bin(uint32_t us)
+{
+    uint8_t bin = us ? 32 - __builtin_clz(us) : 0;
+    return bin < BUS_TRACE_HIST_BINS ? bin : BUS_TRACE_HIST_BINS - 1;
+}
+
+// interrupts disabled
+static struct bus_trace_dev_s *bus_trace_dev(uint8_t bus, uint8_t dev)
+{
+    for (uint8_t i = 0; i < bus_trace_ndev; i++)
+    {
+        if (bus_trace_devs[i].bus == bus && bus_trace_devs[i].dev == dev)
+            return &bus_trace_devs[i];
+    }
+    if (bus_trace_ndev >= BUS_TRACE_DEVICES)
+        return NULL;
+    struct bus_trace_dev_s *d = &bus_trace_devs[bus_trace_ndev++];
+    d->bus = bus;
+    d->dev = dev;
+    return d;
+}
+
+void bus_trace_record(uint8_t bus, uint8_t dev, uint16_t len, uint32_t t_submit,
+                      uint32_t busy, uint8_t error)
+{
+    uint32_t now = bus_trace_now();
+    uint32_t latency = now - t_submit;
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+
+    uint32_t idx = __atomic_fetch_add(&bus_trace_head, 1, __ATOMIC_RELAXED);
+    struct bus_trace_slot_s *slot = &bus_trace_ring[idx & (BUS_TRACE_RING_SIZE - 1)];
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->rec.t_end = now;
+    slot->rec.latency = latency;
+    slot->rec.busy = busy;
+    slot->rec.len = len;
+    slot->rec.bus = bus | (error ? BUS_TRACE_BUS_ERROR : 0);
+    slot->rec.dev = dev;
+    __atomic_store_n(&slot->seq, idx + 1, __ATOMIC_RELEASE);
+
+    // the counters are a few adds, cheaper under a short lock than one atomic each
+    uint32_t latency_us = latency / cycles_per_us;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    struct bus_trace_dev_s *d = bus_trace_dev(bus, dev);
+    if (d)
+    {
+        d->count++;
+        d->bytes += len;
+        if (error)
+            d->errors++;
+        d->busy_us += busy / cycles_per_us;
+        if (latency_us > d->latency_max_us)
+            d->latency_max_us = latency_us;
+        d->hist[bus_trace_bin(latency_us)]++;
+    }
+    __set_PRIMASK(primask);
+}
+
+uint16_t bus_trace_read(struct bus_trace_rec_s *recs, uint16_t max)
+{
+    uint16_t n = 0;
+    while (n < max)
+    {
+        uint32_t head = __atomic_load_n(&bus_trace_head, __ATOMIC_ACQUIRE);
+        if (head == bus_trace_tail)
+            break;
+        if (head - bus_trace_tail > BUS_TRACE_RING_SIZE)
+        {
+            bus_trace_lost += head - bus_trace_tail - BUS_TRACE_RING_SIZE;
+            bus_trace_tail = head - BUS_TRACE_RING_SIZE;
+        }
+        struct bus_trace_slot_s *slot = &bus_trace_ring[bus_trace_tail & (BUS_TRACE_RING_SIZE - 1)];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == 0 && head - bus_trace_tail == 1)
+            break; //newest record is still being written, try again next time
+        recs[n] = slot->rec;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // overwritten or not finished before or while copying
+        if (seq != bus_trace_tail + 1 || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+            bus_trace_lost++;
+        else
+            n++;
+        bus_trace_tail++;
+    }
+    return n;
+}
+
+int8_t bus_trace_get_device(uint8_t index, struct bus_trace_dev_s *dev)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (index >= bus_trace_ndev)
+    {
+        __set_PRIMASK(primask);
+        errno = ENOENT;
+        return -1;
+    }
+    *dev = bus_trace_devs[index];
+    __set_PRIMASK(primask);
+    errno = 0;
+    return 0;
+}
+
+int8_t bus_trace_dump(bus_trace_write_fn write, void *ctx, uint16_t max_rec)
+{
+    uint32_t pending = __atomic_load_n(&bus_trace_head, __ATOMIC_ACQUIRE) - bus_trace_tail;
+    if (pending > BUS_TRACE_RING_SIZE)
+    {
+        // overwritten before this dump, reported in its header
+        bus_trace_lost += pending - BUS_TRACE_RING_SIZE;
+        bus_trace_tail += pending - BUS_TRACE_RING_SIZE;
+        pending = BUS_TRACE_RING_SIZE;
+    }
+    if (pending > max_rec)
+        pending = max_rec;
+    struct bus_trace_hdr_s hdr = {
+        .magic = BUS_TRACE_MAGIC,
+        .version = BUS_TRACE_VERSION,
+        .ndev = bus_trace_ndev,
+        .nrec = pending,
+        .cycles_per_us = SystemCoreClock / 1000000,
+        .window_ms = HAL_GetTick() - bus_trace_reset_tick,
+        .lost = bus_trace_lost
+    };
+    bus_trace_lost = 0;
+    if (write(ctx, &hdr, sizeof(hdr)) < 0)
+        return -1;
+    for (uint16_t i = 0; i < hdr.ndev; i++)
+    {
+        struct bus_trace_dev_s d;
+        bus_trace_get_device(i, &d);
+        if (write(ctx, &d, sizeof(d)) < 0)
+            return -1;
+    }
+
+    struct bus_trace_rec_s recs[16];
+    while (pending)
+    {
+        uint16_t n = pending > 16 ? 16 : pending;
+        uint16_t got = bus_trace_read(recs, n);
+        // records lost meanwhile leave a gap filled with padding (bus 0), they are
+        // only counted in bus_trace_lost and reported by the next header
+        memset(&recs[got], 0, (n - got) * sizeof(recs[0]));
+        if (write(ctx, recs, n * sizeof(recs[0])) < 0)
+            return -1;
+        pending -= n;
+    }
+    return 0;
+}
+
+#endif
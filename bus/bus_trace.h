@@ -0,0 +1,112 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Bus transaction trace and latency profiler for the I2C and SPI drivers */
+#ifndef BUS_TRACE_H
+#define BUS_TRACE_H
+
+#include <stdint.h>
+
+// The drivers call the hooks below only if BUS_TRACE is defined for the whole
+// build, otherwise they compile to nothing. With tracing on, every finished
+// transaction updates the counters of its device and is appended to an event
+// ring. Both are read out with bus_trace_dump and turned into a utilization
+// report on the host by bus_trace_report.c.
+//
+// This header has no HAL dependency, so the host decoder can include it.
+
+// event ring length, power of two
+#ifndef BUS_TRACE_RING_SIZE
+#define BUS_TRACE_RING_SIZE (128)
+#endif
+// number of devices with counters, over all buses
+#ifndef BUS_TRACE_DEVICES
+#define BUS_TRACE_DEVICES (16)
+#endif
+// latency histogram, bin i counts latencies of 2^(i-1) <= us < 2^i (bin 0: < 1us)
+#define BUS_TRACE_HIST_BINS (16)
+
+#define BUS_TRACE_MAGIC (0x43525442u) //"BTRC"
+#define BUS_TRACE_VERSION (1)
+
+enum bus_trace_type
+{
+    BUS_TRACE_I2C = 1,
+    BUS_TRACE_SPI = 2
+};
+
+// bus byte of records and device counters
+#define BUS_TRACE_BUS(type, port) ((uint8_t)(((type) << 4) | ((port) & 0x0F)))
+#define BUS_TRACE_BUS_TYPE(bus) (((bus) >> 4) & 0x07)
+#define BUS_TRACE_BUS_PORT(bus) ((bus) & 0x0F)
+#define BUS_TRACE_BUS_ERROR (0x80) //record only: transaction failed
+
+// one finished transaction, times in cycles of the core clock
+struct bus_trace_rec_s
+{
+    uint32_t t_end;   //cycle counter at completion
+    uint32_t latency; //submission to completion
+    uint32_t busy;    //time on the bus, less than latency if it waited for the bus
+    uint16_t len;     //bytes transferred
+    uint8_t bus;      //BUS_TRACE_BUS(), ored with BUS_TRACE_BUS_ERROR
+    uint8_t dev;      //7 bit I2C address, SPI chip select index
+};
+
+// counters of one device since the last reset
+struct bus_trace_dev_s
+{
+    uint8_t bus;
+    uint8_t dev;
+    uint16_t reserved;
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t errors;
+    uint32_t busy_us;        //total time on the bus
+    uint32_t latency_max_us;
+    uint32_t hist[BUS_TRACE_HIST_BINS];
+};
+
+// dump stream: header, ndev device counters, nrec records (bus 0: padding, not
+// a record and not a loss), all little endian
+struct bus_trace_hdr_s
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t ndev;
+    uint32_t nrec;
+    uint32_t cycles_per_us;
+    uint32_t window_ms;     //time since the counters were reset
+    uint32_t lost;          //records overwritten before they were read, since the last header
+};
+
+// output of bus_trace_dump, returns len or -1; has to take everything, e.g. by
+// waiting for space in the tx buffer of a serial_dev_s
+typedef int (*bus_trace_write_fn) (void *ctx, const void *data, int len);
+
+// enables the cycle counter and resets everything
+void bus_trace_init(void);
+void bus_trace_reset(void);
+uint32_t bus_trace_now(void);
+// Called by the drivers from any context, also interrupts. t_submit is the
+// cycle counter when the transaction was requested, busy the cycles on the bus.
+void bus_trace_record(uint8_t bus, uint8_t dev, uint16_t len, uint32_t t_submit,
+                      uint32_t busy, uint8_t error);
+
+// oldest records first, returns the number read; single reader only
+uint16_t bus_trace_read(struct bus_trace_rec_s *recs, uint16_t max);
+// consistent copy of the counters of device index, -1 and ENOENT past the last one
+int8_t bus_trace_get_device(uint8_t index, struct bus_trace_dev_s *dev);
+// Writes header, counters and up to max_rec pending records. Returns -1 if
+// write failed, the host decoder resynchronizes on the next header.
+int8_t bus_trace_dump(bus_trace_write_fn write, void *ctx, uint16_t max_rec);
+
+#ifdef BUS_TRACE
+#define BUS_TRACE_END(type, port, dev, len, t_submit, busy, error) \
+    bus_trace_record(BUS_TRACE_BUS(type, port), (dev), (len), (t_submit), (busy), (error))
+#else
+#define BUS_TRACE_END(type, port, dev, len, t_submit, busy, error) do {} while (0)
+#endif
+
+#endif
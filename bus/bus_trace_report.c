@@ -0,0 +1,208 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Host side decoder of bus_trace_dump streams, prints per device utilization */
+// Not part of the firmware, build on the host with
+//     cc -DBUS_TRACE_HOST -o bus_trace_report bus_trace_report.c
+// and feed it the captured dump stream, from a file or stdin:
+//     bus_trace_report capture.bin
+#ifdef BUS_TRACE_HOST
+
+#include <stdio.h>
+#include <string.h>
+#include "bus_trace.h"
+
+#define REPORT_MAX_DEVICES (64)
+
+// per device figures taken from the records, the counters come with every dump
+struct report_dev_s
+{
+    struct bus_trace_dev_s counters;
+    uint32_t records;
+    uint32_t record_errors;
+    uint64_t busy_cycles;
+    uint64_t latency_cycles;
+    uint32_t latency_max_cycles;
+};
+
+struct report_s
+{
+    struct report_dev_s dev[REPORT_MAX_DEVICES];
+    int ndev;
+    uint32_t dumps;
+    uint32_t lost;
+    uint32_t cycles_per_us;
+    uint32_t window_ms;
+    // record time span, summed from the gaps so the cycle counter may wrap
+    int have_t;
+    uint32_t t_last;
+    uint64_t span_cycles;
+};
+
+static struct report_dev_s *report_dev(struct report_s *r, uint8_t bus, uint8_t dev)
+{
+    for (int i = 0; i < r->ndev; i++)
+    {
+        if (r->dev[i].counters.bus == bus && r->dev[i].counters.dev == dev)
+            return &r->dev[i];
+    }
+    if (r->ndev >= REPORT_MAX_DEVICES)
+        return NULL;
+    struct report_dev_s *d = &r->dev[r->ndev++];
+    memset(d, 0, sizeof(*d));
+    d->counters.bus = bus;
+    d->counters.dev = dev;
+    return d;
+}
+
+static void report_add_record(struct report_s *r, const struct bus_trace_rec_s *rec)
+{
+    if (!rec->bus)
+        return; //padding
+    uint8_t bus = rec->bus & ~BUS_TRACE_BUS_ERROR;
+    struct report_dev_s *d = report_dev(r, bus, rec->dev);
+    if (!d)
+        return;
+    d->records++;
+    if (rec->bus & BUS_TRACE_BUS_ERROR)
+        d->record_errors++;
+    d->busy_cycles += rec->busy;
+    d->latency_cycles += rec->latency;
+    if (rec->latency > d->latency_max_cycles)
+        d->latency_max_cycles = rec->latency;
+    if (r->have_t)
+        r->span_cycles += (uint32_t)(rec->t_end - r->t_last);
+    r->t_last = rec->t_end;
+    r->have_t = 1;
+}
+
+// reads one dump, 0 at the end of the stream
+static int report_read_dump(struct report_s *r, FILE *in)
+{
+    struct bus_trace_hdr_s hdr;
+    // find the next header byte by byte, a dump may have been cut off
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1)
+        return 0;
+    while (hdr.magic != BUS_TRACE_MAGIC || hdr.version != BUS_TRACE_VERSION)
+    {
+        memmove(&hdr, (uint8_t *)&hdr + 1, sizeof(hdr) - 1);
+        if (fread((uint8_t *)&hdr + sizeof(hdr) - 1, 1, 1, in) != 1)
+            return 0;
+    }
+    r->dumps++;
+    r->lost += hdr.lost;
+    r->cycles_per_us = hdr.cycles_per_us;
+    r->window_ms = hdr.window_ms;
+    for (int i = 0; i < hdr.ndev; i++)
+    {
+        struct bus_trace_dev_s c;
+        if (fread(&c, sizeof(c), 1, in) != 1)
+            return 0;
+        struct report_dev_s *d = report_dev(r, c.bus, c.dev);
+        if (d)
+            d->counters = c; //counters are totals since the reset, the last dump counts
+    }
+    for (uint32_t i = 0; i < hdr.nrec; i++)
+    {
+        struct bus_trace_rec_s rec;
+        if (fread(&rec, sizeof(rec), 1, in) != 1)
+            return 0;
+        report_add_record(r, &rec);
+    }
+    return 1;
+}
+
+// upper bound of the bin that holds fraction q of the counts, at most the maximum, in us
+static uint32_t report_percentile(const struct bus_trace_dev_s *c, double q)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < BUS_TRACE_HIST_BINS; i++)
+        total += c->hist[i];
+    uint32_t sum = 0;
+    for (int i = 0; i < BUS_TRACE_HIST_BINS; i++)
+    {
+        sum += c->hist[i];
+        if (total && sum >= q * total)
+            return (1u << i) < c->latency_max_us ? (1u << i) : c->latency_max_us;
+    }
+    return c->latency_max_us;
+}
+
+static const char *report_type(uint8_t bus)
+{
+    switch (BUS_TRACE_BUS_TYPE(bus))
+    {
+    case BUS_TRACE_I2C:
+        return "i2c";
+    case BUS_TRACE_SPI:
+        return "spi";
+    default:
+        return "?";
+    }
+}
+
+static void report_print(const struct report_s *r, FILE *out)
+{
+    double window_us = r->window_ms * 1000.0;
+    double span_us = r->cycles_per_us ? (double)r->span_cycles / r->cycles_per_us : 0;
+    fprintf(out, "%u dumps, counters over %.3f s, records over %.3f s, %u records lost\n\n",
+            r->dumps, r->window_ms / 1000.0, span_us / 1e6, r->lost);
+    fprintf(out, "bus    dev   count    bytes  errors  busy ms  util %%  p50 us  p99 us  max us | rec util %%  rec avg us\n");
+    for (int i = 0; i < r->ndev; i++)
+    {
+        const struct report_dev_s *d = &r->dev[i];
+        const struct bus_trace_dev_s *c = &d->counters;
+        double util = window_us > 0 ? 100.0 * c->busy_us / window_us : 0;
+        double rec_util = span_us > 0 ? 100.0 * d->busy_cycles / r->cycles_per_us / span_us : 0;
+        double rec_avg = d->records ? (double)d->latency_cycles / r->cycles_per_us / d->records : 0;
+        fprintf(out, "%s%-2u  0x%02x %7u %8u %7u %8.2f %7.2f %7u %7u %7u | %10.2f %11.1f\n",
+                report_type(c->bus), BUS_TRACE_BUS_PORT(c->bus), c->dev, c->count, c->bytes, c->errors,
+                c->busy_us / 1000.0, util, report_percentile(c, 0.5), report_percentile(c, 0.99),
+                c->latency_max_us, rec_util, rec_avg);
+    }
+
+    // the devices of a bus share it, their sum is the bus load
+    fprintf(out, "\nbus    util %%\n");
+    for (int i = 0; i < r->ndev; i++)
+    {
+        uint8_t bus = r->dev[i].counters.bus;
+        int first = 1;
+        for (int j = 0; j < i; j++)
+            first &= r->dev[j].counters.bus != bus;
+        if (!first)
+            continue;
+        uint64_t busy_us = 0;
+        for (int j = i; j < r->ndev; j++)
+        {
+            if (r->dev[j].counters.bus == bus)
+                busy_us += r->dev[j].counters.busy_us;
+        }
+        fprintf(out, "%s%-2u %7.2f\n", report_type(bus), BUS_TRACE_BUS_PORT(bus),
+                window_us > 0 ? 100.0 * busy_us / window_us : 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static struct report_s report;
+    FILE *in = stdin;
+    if (argc > 1 && !(in = fopen(argv[1], "rb")))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    while (report_read_dump(&report, in)) {}
+    if (in != stdin)
+        fclose(in);
+    if (!report.dumps)
+    {
+        fprintf(stderr, "no bus trace dump found\n");
+        return 1;
+    }
+    report_print(&report, stdout);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,41 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Timeout budget shared by the bus drivers and the chip drivers on top */
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <stdint.h>
+#include "stm32h7xx_hal.h"
+
+// A deadline is started once and handed through a sequence of bus calls, each
+// call gets what is left of the budget (deadline_remaining) as its Timeout, so
+// the whole sequence ends within the budget even if every step is slow. There
+// is no "forever": waits that used HAL_MAX_DELAY get a budget instead.
+struct deadline_s
+{
+    uint32_t start;  //HAL tick
+    uint32_t budget; //ms
+};
+
+static inline void deadline_start(struct deadline_s *d, uint32_t budget_ms)
+{
+    d->start = HAL_GetTick();
+    d->budget = budget_ms;
+}
+
+static inline int deadline_expired(const struct deadline_s *d)
+{
+    return HAL_GetTick() - d->start >= d->budget;
+}
+
+// ms left, 0 once expired
+static inline uint32_t deadline_remaining(const struct deadline_s *d)
+{
+    uint32_t elapsed = HAL_GetTick() - d->start;
+    return elapsed >= d->budget ? 0 : d->budget - elapsed;
+}
+
+#endif
@@ -6,56 +6,590 @@
 /* Driver for I2C based on HAL functions */
 
 #include <errno.h>
+#include <string.h>
 #include "stm32h7xx_hal.h"
 #include "i2c_hal.h"
+#include "bus_trace.h"
 
-void i2c_init(struct i2c_dev_s *self, I2C_HandleTypeDef *hi2c)
+// handle -> instance map, required for the shared HAL callbacks
+static struct i2c_dev_s *i2c_registry[I2C_MAX_INSTANCES];
+
+static struct i2c_dev_s *i2c_lookup(I2C_HandleTypeDef *hi2c)
 {
-    self->hi2c = hi2c;
-    self->mem_read = &i2c_mem_read;
-    self->mem_write = &i2c_mem_write;
-    self->master_transmit = &i2c_master_transmit;
+    for (int i = 0; i < I2C_MAX_INSTANCES; i++)
+    {
+        if (i2c_registry[i] && i2c_registry[i]->hi2c == hi2c)
+            return i2c_registry[i];
+    }
+    return NULL;
 }
 
-int8_t i2c_mem_read(struct i2c_dev_s *self, uint16_t DevAddress,
-                            uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
-{    
-    if (HAL_I2C_Mem_Read(self->hi2c, DevAddress, MemAddress, MemAddSize, pData, Size, Timeout)==HAL_OK)
+static void i2c_register(struct i2c_dev_s *self)
+{
+    int free_slot = -1;
+    for (int i = 0; i < I2C_MAX_INSTANCES; i++)
     {
+        if (i2c_registry[i] && i2c_registry[i]->hi2c == self->hi2c)
+        {
+            i2c_registry[i] = self;
+            self->port = i;
+            return;
+        }
+        if (!i2c_registry[i] && free_slot < 0)
+            free_slot = i;
+    }
+    if (free_slot >= 0)
+    {
+        i2c_registry[free_slot] = self;
+        self->port = free_slot;
+    }
+}
+
+static inline uint32_t i2c_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+static inline uint32_t i2c_cycles_per_us(void)
+{
+    return SystemCoreClock / 1000000;
+}
+
+static void i2c_delay_us(uint32_t us)
+{
+    uint32_t start = i2c_cycles();
+    while (i2c_cycles() - start < us * i2c_cycles_per_us()) {}
+}
+
+static int i2c_errno(uint32_t hal_error)
+{
+    if (hal_error & HAL_I2C_ERROR_TIMEOUT)
+        return ETIMEDOUT;
+    if (hal_error & HAL_I2C_ERROR_AF)
+        return ENXIO;
+    if (hal_error & HAL_I2C_ERROR_ARLO)
+        return EAGAIN;
+    if (hal_error & HAL_I2C_ERROR_OVR)
+        return EOVERFLOW;
+    return EIO;
+}
+
+// true if a has to run before b
+static int i2c_before(const struct i2c_xfer_s *a, const struct i2c_xfer_s *b)
+{
+    if (a->prio != b->prio)
+        return a->prio > b->prio;
+    if (!a->deadline_us)
         return 0;
+    if (!b->deadline_us)
+        return 1;
+    uint32_t da = a->t_submit + a->deadline_us * i2c_cycles_per_us();
+    uint32_t db = b->t_submit + b->deadline_us * i2c_cycles_per_us();
+    return (int32_t)(da - db) < 0;
+}
+
+// sorted insert, behind all transactions it does not have to overtake; interrupts disabled
+static void i2c_enqueue(struct i2c_dev_s *self, struct i2c_xfer_s *x)
+{
+    struct i2c_xfer_s *prev = NULL;
+    struct i2c_xfer_s *y = self->head;
+    while (y && !i2c_before(x, y))
+    {
+        prev = y;
+        y = y->next;
     }
+    x->next = y;
+    if (prev)
+        prev->next = x;
     else
+        self->head = x;
+    if (!y)
+        self->tail = x;
+}
+
+static struct i2c_stats_s *i2c_stats_slot(struct i2c_dev_s *self, uint16_t DevAddress, int create)
+{
+    for (int i = 0; i < I2C_STATS_DEVICES; i++)
     {
-        errno = EIO; //TODO: use/translate error returned from HAL
+        struct i2c_stats_s *st = &self->stats[i];
+        if (st->count && st->dev_address == DevAddress)
+            return st;
+        if (!st->count && create)
+        {
+            st->dev_address = DevAddress;
+            return st;
+        }
+    }
+    return NULL;
+}
+
+static void i2c_record(struct i2c_dev_s *self, struct i2c_xfer_s *x)
+{
+    struct i2c_stats_s *st = i2c_stats_slot(self, x->dev_address, 1);
+    if (!st)
+        return;
+    uint32_t latency = (i2c_cycles() - x->t_submit) / i2c_cycles_per_us();
+    uint32_t wait = x->chunk ? (x->t_start - x->t_submit) / i2c_cycles_per_us() : latency;
+    st->count++;
+    if (x->status != I2C_XFER_DONE)
+        st->errors++;
+    if (x->deadline_us && latency > x->deadline_us)
+        st->missed++;
+    if (wait > st->wait_max)
+        st->wait_max = wait;
+    if (latency > st->latency_max)
+        st->latency_max = latency;
+    st->latency_sum += latency;
+}
+
+// statistics and trace of a finished transaction
+static void i2c_account(struct i2c_dev_s *self, struct i2c_xfer_s *x)
+{
+    i2c_record(self, x);
+    BUS_TRACE_END(BUS_TRACE_I2C, self->port, x->dev_address >> 1, x->done,
+                  x->t_submit, x->busy, x->status != I2C_XFER_DONE);
+}
+
+const struct i2c_stats_s *i2c_get_stats(struct i2c_dev_s *self, uint16_t DevAddress)
+{
+    return i2c_stats_slot(self, DevAddress, 0);
+}
+
+void i2c_reset_stats(struct i2c_dev_s *self)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(self->stats, 0, sizeof(self->stats));
+    __set_PRIMASK(primask);
+}
+
+// starts the next chunk of x, the whole rest unless it may be split
+static HAL_StatusTypeDef i2c_hal_start(struct i2c_dev_s *self, struct i2c_xfer_s *x)
+{
+    I2C_HandleTypeDef *hi2c = self->hi2c;
+    int dma = !(x->flags & I2C_XFER_FLAG_NO_DMA);
+    uint16_t n = x->size - x->done;
+    if ((x->flags & I2C_XFER_FLAG_SPLIT) && self->split_size && n > self->split_size &&
+        (x->op == I2C_XFER_MEM_READ || x->op == I2C_XFER_MEM_WRITE))
+        n = self->split_size;
+    x->chunk = n;
+    uint8_t *data = x->data + x->done;
+    uint16_t mem_address = x->mem_address + x->done;
+    x->t_chunk = i2c_cycles();
+    if (!x->done)
+        x->t_start = x->t_chunk;
+
+    switch (x->op)
+    {
+    case I2C_XFER_MEM_READ:
+        if (dma && hi2c->hdmarx)
+            return HAL_I2C_Mem_Read_DMA(hi2c, x->dev_address, mem_address, x->mem_add_size, data, n);
+        return HAL_I2C_Mem_Read_IT(hi2c, x->dev_address, mem_address, x->mem_add_size, data, n);
+    case I2C_XFER_MEM_WRITE:
+        if (dma && hi2c->hdmatx)
+            return HAL_I2C_Mem_Write_DMA(hi2c, x->dev_address, mem_address, x->mem_add_size, data, n);
+        return HAL_I2C_Mem_Write_IT(hi2c, x->dev_address, mem_address, x->mem_add_size, data, n);
+    case I2C_XFER_TRANSMIT:
+        if (dma && hi2c->hdmatx)
+            return HAL_I2C_Master_Transmit_DMA(hi2c, x->dev_address, x->data, x->size);
+        return HAL_I2C_Master_Transmit_IT(hi2c, x->dev_address, x->data, x->size);
+    case I2C_XFER_RECEIVE:
+        if (dma && hi2c->hdmarx)
+            return HAL_I2C_Master_Receive_DMA(hi2c, x->dev_address, x->data, x->size);
+        return HAL_I2C_Master_Receive_IT(hi2c, x->dev_address, x->data, x->size);
+    default:
+        return HAL_ERROR;
+    }
+}
+
+// Completes the active transaction. status is written before the callback, so
+// the callback may submit the descriptor again.
+static void i2c_finish(struct i2c_dev_s *self, enum i2c_xfer_status status, uint32_t hal_error)
+{
+    struct i2c_xfer_s *x = self->active;
+    if (!x)
+        return; //transfer started past the queue, e.g. by dpm_service
+    self->active = NULL;
+    if (status != I2C_XFER_DONE)
+        x->busy += i2c_cycles() - x->t_chunk;
+    x->hal_error = hal_error;
+    x->status = status;
+    i2c_account(self, x);
+    if (x->complete)
+        x->complete(x);
+}
+
+// A chunk is on the wire, the rest of a split transaction competes for the bus again.
+static void i2c_chunk_done(struct i2c_dev_s *self)
+{
+    struct i2c_xfer_s *x = self->active;
+    if (!x)
+        return;
+    x->busy += i2c_cycles() - x->t_chunk;
+    x->done += x->chunk;
+    if (x->done >= x->size)
+    {
+        i2c_finish(self, I2C_XFER_DONE, HAL_I2C_ERROR_NONE);
+        return;
+    }
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    self->active = NULL;
+    x->status = I2C_XFER_QUEUED;
+    i2c_enqueue(self, x);
+    __set_PRIMASK(primask);
+}
+
+// Starts the head of the queue if the bus is idle, runs in main loop and interrupt context.
+static void i2c_start_next(struct i2c_dev_s *self)
+{
+    while (1)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        struct i2c_xfer_s *x = self->head;
+        if (self->active || !x)
+        {
+            __set_PRIMASK(primask);
+            return;
+        }
+        self->head = x->next;
+        if (!self->head)
+            self->tail = NULL;
+        x->next = NULL;
+        x->status = I2C_XFER_BUSY;
+        self->active = x;
+        __set_PRIMASK(primask);
+
+        HAL_StatusTypeDef result = i2c_hal_start(self, x);
+        if (result == HAL_OK)
+            return;
+
+        if (result == HAL_BUSY)
+        {
+            // somebody else uses the bus, put it back and retry from i2c_service
+            primask = __get_PRIMASK();
+            __disable_irq();
+            if (self->active == x)
+            {
+                self->active = NULL;
+                x->status = I2C_XFER_QUEUED;
+                x->next = self->head;
+                self->head = x;
+                if (!self->tail)
+                    self->tail = x;
+            }
+            __set_PRIMASK(primask);
+            return;
+        }
+        i2c_finish(self, I2C_XFER_ERROR, HAL_I2C_GetError(self->hi2c));
+    }
+}
+
+int8_t i2c_submit(struct i2c_dev_s *self, struct i2c_xfer_s *xfer)
+{
+    if (xfer->status == I2C_XFER_QUEUED || xfer->status == I2C_XFER_BUSY)
+    {
+        errno = EBUSY;
         return -1;
     }
+    xfer->next = NULL;
+    xfer->hal_error = HAL_I2C_ERROR_NONE;
+    xfer->done = 0;
+    xfer->chunk = 0;
+    xfer->t_submit = i2c_cycles();
+    xfer->t_start = 0;
+    xfer->busy = 0;
+    xfer->status = I2C_XFER_QUEUED;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    i2c_enqueue(self, xfer);
+    __set_PRIMASK(primask);
+
+    i2c_start_next(self);
+    return 0;
 }
 
+void i2c_service(struct i2c_dev_s *self)
+{
+    i2c_start_next(self);
+}
 
-int8_t i2c_mem_write(struct i2c_dev_s *self, uint16_t DevAddress,
-                            uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
-{    
-    if (HAL_I2C_Mem_Write(self->hi2c, DevAddress, MemAddress, MemAddSize, pData, Size, Timeout)==HAL_OK)
+void i2c_cancel(struct i2c_dev_s *self, struct i2c_xfer_s *xfer)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (xfer->status == I2C_XFER_QUEUED)
     {
-        return 0;
+        struct i2c_xfer_s *prev = NULL;
+        for (struct i2c_xfer_s *x = self->head; x; prev = x, x = x->next)
+        {
+            if (x != xfer)
+                continue;
+            if (prev)
+                prev->next = x->next;
+            else
+                self->head = x->next;
+            if (self->tail == x)
+                self->tail = prev;
+            break;
+        }
+        xfer->next = NULL;
+        xfer->hal_error = HAL_I2C_ERROR_TIMEOUT;
+        xfer->status = I2C_XFER_ERROR;
+        i2c_account(self, xfer);
+        __set_PRIMASK(primask);
+        return;
+    }
+    if (self->active != xfer)
+    {
+        __set_PRIMASK(primask);
+        return;
+    }
+    __set_PRIMASK(primask);
+
+    // the abort ends in HAL_I2C_AbortCpltCallback, which completes the transaction
+    if (HAL_I2C_Master_Abort_IT(self->hi2c, xfer->dev_address) == HAL_OK)
+    {
+        struct deadline_s deadline;
+        deadline_start(&deadline, I2C_ABORT_TIMEOUT_MS);
+        while (self->active == xfer && !deadline_expired(&deadline)) {}
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (self->active == xfer)
+    {
+        self->active = NULL;
+        xfer->busy += i2c_cycles() - xfer->t_chunk;
+        xfer->hal_error = HAL_I2C_ERROR_TIMEOUT;
+        xfer->status = I2C_XFER_ERROR;
+        i2c_account(self, xfer);
+        __set_PRIMASK(primask);
+        // the peripheral did not stop, reset it so nothing refers to xfer any more
+        HAL_I2C_DeInit(self->hi2c);
+        HAL_I2C_Init(self->hi2c);
     }
     else
     {
-        errno = EIO; //TODO: use/translate error returned from HAL
+        __set_PRIMASK(primask);
+    }
+    i2c_start_next(self);
+}
+
+static void i2c_xfer_cplt(I2C_HandleTypeDef *hi2c)
+{
+    struct i2c_dev_s *self = i2c_lookup(hi2c);
+    if (!self)
+        return;
+    i2c_chunk_done(self);
+    i2c_start_next(self);
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    i2c_xfer_cplt(hi2c);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    i2c_xfer_cplt(hi2c);
+}
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    i2c_xfer_cplt(hi2c);
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    i2c_xfer_cplt(hi2c);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+    struct i2c_dev_s *self = i2c_lookup(hi2c);
+    if (!self)
+        return;
+    i2c_finish(self, I2C_XFER_ERROR, HAL_I2C_GetError(hi2c));
+    i2c_start_next(self);
+}
+
+void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    struct i2c_dev_s *self = i2c_lookup(hi2c);
+    if (!self)
+        return;
+    i2c_finish(self, I2C_XFER_ERROR, HAL_I2C_GetError(hi2c) | HAL_I2C_ERROR_TIMEOUT);
+    i2c_start_next(self);
+}
+
+void i2c_init(struct i2c_dev_s *self, I2C_HandleTypeDef *hi2c)
+{
+    self->hi2c = hi2c;
+    self->mem_read = &i2c_mem_read;
+    self->mem_write = &i2c_mem_write;
+    self->master_transmit = &i2c_master_transmit;
+    self->burst_read = &i2c_burst_read;
+    self->transfer = &i2c_transfer;
+    self->submit = &i2c_submit;
+    self->service = &i2c_service;
+    self->head = NULL;
+    self->tail = NULL;
+    self->active = NULL;
+    self->split_size = I2C_SPLIT_SIZE;
+    self->port = 0;
+    self->scl_port = NULL;
+    self->sda_port = NULL;
+    self->recoveries = 0;
+    memset(self->stats, 0, sizeof(self->stats));
+    i2c_register(self);
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55; //unlock, required on some Cortex-M7
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void i2c_set_recovery_pins(struct i2c_dev_s *self, GPIO_TypeDef *scl_port, uint16_t scl_pin,
+                           GPIO_TypeDef *sda_port, uint16_t sda_pin)
+{
+    self->scl_port = scl_port;
+    self->scl_pin = scl_pin;
+    self->sda_port = sda_port;
+    self->sda_pin = sda_pin;
+}
+
+// the peripheral is idle but a slave pulls SDA low
+static int i2c_sda_stuck(struct i2c_dev_s *self)
+{
+    return self->sda_port && HAL_I2C_GetState(self->hi2c) == HAL_I2C_STATE_READY &&
+           HAL_GPIO_ReadPin(self->sda_port, self->sda_pin) == GPIO_PIN_RESET;
+}
+
+int8_t i2c_recover(struct i2c_dev_s *self)
+{
+    if (!self->scl_port || !self->sda_port)
+    {
+        errno = ENOTSUP;
         return -1;
     }
+    HAL_I2C_DeInit(self->hi2c);
+    HAL_GPIO_WritePin(self->scl_port, self->scl_pin, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(self->sda_port, self->sda_pin, GPIO_PIN_SET);
+    GPIO_InitTypeDef gpio = {0};
+    gpio.Mode = GPIO_MODE_OUTPUT_OD;
+    gpio.Pull = GPIO_PULLUP;
+    gpio.Speed = GPIO_SPEED_FREQ_LOW;
+    gpio.Pin = self->scl_pin;
+    HAL_GPIO_Init(self->scl_port, &gpio);
+    gpio.Pin = self->sda_pin;
+    HAL_GPIO_Init(self->sda_port, &gpio);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+
+    // every clock lets the slave shift out one more bit of the byte it is stuck in
+    for (int i = 0; i < 9 && HAL_GPIO_ReadPin(self->sda_port, self->sda_pin) == GPIO_PIN_RESET; i++)
+    {
+        HAL_GPIO_WritePin(self->scl_port, self->scl_pin, GPIO_PIN_RESET);
+        i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+        HAL_GPIO_WritePin(self->scl_port, self->scl_pin, GPIO_PIN_SET);
+        i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    }
+    // STOP: SDA rises while SCL is high
+    HAL_GPIO_WritePin(self->scl_port, self->scl_pin, GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(self->sda_port, self->sda_pin, GPIO_PIN_RESET);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    HAL_GPIO_WritePin(self->scl_port, self->scl_pin, GPIO_PIN_SET);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    HAL_GPIO_WritePin(self->sda_port, self->sda_pin, GPIO_PIN_SET);
+    i2c_delay_us(I2C_RECOVERY_HALF_PERIOD_US);
+    int released = HAL_GPIO_ReadPin(self->sda_port, self->sda_pin) == GPIO_PIN_SET;
+
+    HAL_GPIO_DeInit(self->scl_port, self->scl_pin);
+    HAL_GPIO_DeInit(self->sda_port, self->sda_pin);
+    HAL_I2C_Init(self->hi2c);
+    self->recoveries++;
+    if (!released)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    errno = 0;
+    return 0;
 }
 
-int8_t i2c_master_transmit(struct i2c_dev_s *self, uint16_t DevAddress,
-                            uint8_t *pData, uint16_t Size, uint32_t Timeout)
-{    
-    if (HAL_I2C_Master_Transmit(self->hi2c, DevAddress, pData, Size, Timeout)==HAL_OK)
+int8_t i2c_transfer(struct i2c_dev_s *self, struct i2c_xfer_s *xfer, uint32_t Timeout)
+{
+    xfer->flags |= I2C_XFER_FLAG_NO_DMA;
+    xfer->complete = NULL;
+    xfer->status = I2C_XFER_IDLE;
+    struct deadline_s deadline;
+    deadline_start(&deadline, Timeout);
+    if (i2c_submit(self, xfer) < 0)
+        return -1;
+    // the tick is read in every pass, the host simulation lets time pass with it
+    while (!i2c_xfer_finished(xfer))
     {
-        return 0;
+        if (deadline_expired(&deadline))
+        {
+            int on_bus = self->active == xfer;
+            i2c_cancel(self, xfer);
+            if (xfer->status != I2C_XFER_DONE)
+            {
+                // A slave holding SDA would fail all further transfers as well. A
+                // transfer that only waited in the queue, e.g. behind one started past
+                // the queue by dpm_service, says nothing about the bus then.
+                if (!self->active && (on_bus || i2c_sda_stuck(self)))
+                    i2c_recover(self);
+                errno = ETIMEDOUT;
+                return -1;
+            }
+        }
+        i2c_service(self);
     }
-    else
+    if (xfer->status != I2C_XFER_DONE)
     {
-        errno = EIO; //TODO: use/translate error returned from HAL
+        errno = i2c_errno(xfer->hal_error);
         return -1;
     }
-}
\ No newline at end of file
+    errno = 0;
+    return 0;
+}
+
+int8_t i2c_mem_read(struct i2c_dev_s *self, uint16_t DevAddress,
+                            uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    struct i2c_xfer_s xfer = {
+        .op = I2C_XFER_MEM_READ, .dev_address = DevAddress,
+        .mem_address = MemAddress, .mem_add_size = MemAddSize, .data = pData, .size = Size
+    };
+    return i2c_transfer(self, &xfer, Timeout);
+}
+
+
+int8_t i2c_mem_write(struct i2c_dev_s *self, uint16_t DevAddress,
+                            uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    struct i2c_xfer_s xfer = {
+        .op = I2C_XFER_MEM_WRITE, .dev_address = DevAddress,
+        .mem_address = MemAddress, .mem_add_size = MemAddSize, .data = pData, .size = Size
+    };
+    return i2c_transfer(self, &xfer, Timeout);
+}
+
+int8_t i2c_master_transmit(struct i2c_dev_s *self, uint16_t DevAddress,
+                            uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    struct i2c_xfer_s xfer = {
+        .op = I2C_XFER_TRANSMIT, .dev_address = DevAddress, .data = pData, .size = Size
+    };
+    return i2c_transfer(self, &xfer, Timeout);
+}
+
+int8_t i2c_burst_read(struct i2c_dev_s *self, uint16_t DevAddress, uint8_t MemAddress, uint8_t AutoInc,
+                            uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    struct i2c_xfer_s xfer = {0};
+    i2c_xfer_burst_read(&xfer, DevAddress, MemAddress, AutoInc, pData, Size);
+    return i2c_transfer(self, &xfer, Timeout);
+}
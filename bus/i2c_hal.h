@@ -8,9 +8,115 @@
 #define I2C_HAL_H
 
 #include "stm32h7xx_hal.h"
+#include "deadline.h"
+
+// number of I2C peripherals that can be active at the same time
+#ifndef I2C_MAX_INSTANCES
+#define I2C_MAX_INSTANCES (4)
+#endif
+#ifndef I2C_ABORT_TIMEOUT_MS
+#define I2C_ABORT_TIMEOUT_MS (2)
+#endif
+// timeout of a single register access of the chip drivers
+#ifndef I2C_TIMEOUT_MS
+#define I2C_TIMEOUT_MS (10)
+#endif
+// SCL half period of the bus recovery
+#ifndef I2C_RECOVERY_HALF_PERIOD_US
+#define I2C_RECOVERY_HALF_PERIOD_US (5)
+#endif
+// number of slave addresses per bus with latency statistics
+#ifndef I2C_STATS_DEVICES
+#define I2C_STATS_DEVICES (8)
+#endif
+// default chunk size of transfers with I2C_XFER_FLAG_SPLIT, 0 disables splitting
+#ifndef I2C_SPLIT_SIZE
+#define I2C_SPLIT_SIZE (8)
+#endif
+
+enum i2c_xfer_op
+{
+    I2C_XFER_MEM_READ,
+    I2C_XFER_MEM_WRITE,
+    I2C_XFER_TRANSMIT,
+    I2C_XFER_RECEIVE
+};
+
+enum i2c_xfer_status
+{
+    I2C_XFER_IDLE,   //not submitted yet
+    I2C_XFER_QUEUED, //waiting for the bus
+    I2C_XFER_BUSY,   //on the bus
+    I2C_XFER_DONE,
+    I2C_XFER_ERROR   //hal_error holds the HAL error code
+};
+
+// Scheduling: the queue is ordered by priority class, within a class the
+// transaction with the earliest deadline goes first, then those without one
+// in submission order. A running transfer is never preempted, so long reads
+// that may be split (I2C_XFER_FLAG_SPLIT) run in chunks of split_size bytes and
+// go back into the queue between the chunks.
+enum i2c_prio
+{
+    I2C_PRIO_NORMAL = 0, //configuration, ID reads, everything else
+    I2C_PRIO_HIGH = 1,   //periodic measurements
+    I2C_PRIO_URGENT = 2  //control writes, e.g. GPIO or supply updates
+};
+
+// Register address flag that makes a chip auto-increment during a multi byte
+// access. ST sensors (HTS221, LIS3MDL, ...) use the MSB of the sub-address,
+// others increment by default or by a configuration bit (LPS22HH: IF_ADD_INC).
+#define I2C_AUTOINC_NONE (0x00)
+#define I2C_AUTOINC_ST (0x80)
+
+// descriptor is not DMA safe, the transfer uses interrupts even if DMA is linked
+#define I2C_XFER_FLAG_NO_DMA (1 << 0)
+// MEM_READ/MEM_WRITE may be split into several transfers with increasing
+// register address, only for devices that auto-increment and have no
+// consistency requirement across the registers (no SMBus block reads)
+#define I2C_XFER_FLAG_SPLIT (1 << 1)
+
+// Transaction descriptor, owned by the caller and linked into the queue while
+// submitted. It and the data buffer have to stay valid until status is DONE or ERROR.
+struct i2c_xfer_s
+{
+    enum i2c_xfer_op op;
+    uint16_t dev_address;
+    uint16_t mem_address;   //MEM_READ/MEM_WRITE only
+    uint16_t mem_add_size;  //I2C_MEMADD_SIZE_8BIT or I2C_MEMADD_SIZE_16BIT
+    uint8_t *data;
+    uint16_t size;
+    uint8_t flags;
+    uint8_t prio;           //enum i2c_prio
+    uint32_t deadline_us;   //relative to submission, 0 for none
+    // called from interrupt context once the transfer finished, may be NULL
+    void (*complete) (struct i2c_xfer_s *xfer);
+    void *arg;              //free for the owner, e.g. the driver instance
+    volatile enum i2c_xfer_status status;
+    uint32_t hal_error;
+    // scheduler state
+    uint16_t done;          //bytes transferred by previous chunks
+    uint16_t chunk;         //bytes of the chunk on the bus
+    uint32_t t_submit, t_start;
+    uint32_t t_chunk;       //start of the chunk on the bus
+    uint32_t busy;          //cycles on the bus of the finished chunks
+    struct i2c_xfer_s *next;
+};
+
+// latency of one slave address, times in us
+struct i2c_stats_s
+{
+    uint16_t dev_address;
+    uint32_t count;
+    uint32_t errors;
+    uint32_t missed;       //completed after their deadline
+    uint32_t wait_max;     //submission to start of the first chunk
+    uint32_t latency_max;  //submission to completion
+    uint64_t latency_sum;
+};
 
 struct i2c_dev_s
-{    
+{
     I2C_HandleTypeDef *hi2c;
     int8_t (*mem_read) (struct i2c_dev_s *self, uint16_t DevAddress,
                             uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
@@ -18,15 +124,92 @@ struct i2c_dev_s
                             uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
     int8_t (*master_transmit) (struct i2c_dev_s *self, uint16_t DevAddress,
                                    uint8_t *pData, uint16_t Size, uint32_t Timeout);
+    int8_t (*burst_read) (struct i2c_dev_s *self, uint16_t DevAddress, uint8_t MemAddress, uint8_t AutoInc,
+                              uint8_t *pData, uint16_t Size, uint32_t Timeout);
+    int8_t (*transfer) (struct i2c_dev_s *self, struct i2c_xfer_s *xfer, uint32_t Timeout);
+    int8_t (*submit) (struct i2c_dev_s *self, struct i2c_xfer_s *xfer);
+    void (*service) (struct i2c_dev_s *self);
+    struct i2c_xfer_s *head, *tail; /**< queued transactions */
+    struct i2c_xfer_s *volatile active; /**< transaction on the bus */
+    uint16_t split_size; /**< chunk size for I2C_XFER_FLAG_SPLIT */
+    uint8_t port; /**< registry slot, identifies the bus in bus traces */
+    // pins for the bus recovery, NULL ports if not available
+    GPIO_TypeDef *scl_port, *sda_port;
+    uint16_t scl_pin, sda_pin;
+    uint32_t recoveries;
+    struct i2c_stats_s stats[I2C_STATS_DEVICES];
 };
 
+// The blocking calls queue a transaction and wait for it, Timeout in ms, e.g.
+// I2C_TIMEOUT_MS or deadline_remaining() of a longer sequence. They must not be
+// called from a completion callback or other interrupt. Errors:
+// ENXIO     no acknowledge, the chip is absent or rejected the register
+// ETIMEDOUT not finished in time, the bus was recovered if pins are set
+// EAGAIN    arbitration lost to another master
+// EOVERFLOW overrun/underrun
+// EIO       bus error and others
 int8_t i2c_mem_read(struct i2c_dev_s *self, uint16_t DevAddress,
                             uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
 int8_t i2c_mem_write(struct i2c_dev_s *self, uint16_t DevAddress,
                             uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
 int8_t i2c_master_transmit(struct i2c_dev_s *self, uint16_t DevAddress,
                             uint8_t *pData, uint16_t Size, uint32_t Timeout);
+// Reads Size consecutive 8 bit registers in one transaction, AutoInc is or-ed
+// to the register address if more than one byte is read.
+int8_t i2c_burst_read(struct i2c_dev_s *self, uint16_t DevAddress, uint8_t MemAddress, uint8_t AutoInc,
+                            uint8_t *pData, uint16_t Size, uint32_t Timeout);
+// Blocking call for a prepared descriptor, e.g. to set prio or deadline_us.
+// The buffer may be on the stack, interrupts are used instead of DMA.
+int8_t i2c_transfer(struct i2c_dev_s *self, struct i2c_xfer_s *xfer, uint32_t Timeout);
+
+// Queues xfer and returns at once. Completion is signaled by xfer->complete
+// and by xfer->status, which can be polled instead.
+int8_t i2c_submit(struct i2c_dev_s *self, struct i2c_xfer_s *xfer);
+// Restarts the queue after the bus was used past it (e.g. by dpm_service),
+// call periodically from the main loop if that can happen.
+void i2c_service(struct i2c_dev_s *self);
+// Removes xfer from the queue or aborts it if it is on the bus, its status is
+// ERROR afterwards unless it finished before. A peripheral that does not stop
+// within I2C_ABORT_TIMEOUT_MS is reset.
+void i2c_cancel(struct i2c_dev_s *self, struct i2c_xfer_s *xfer);
+
+// Pins of SCL and SDA for i2c_recover, which runs after a timeout. They are
+// used as open drain GPIOs while the peripheral is deinitialized, its MspInit
+// has to switch them back to I2C.
+void i2c_set_recovery_pins(struct i2c_dev_s *self, GPIO_TypeDef *scl_port, uint16_t scl_pin,
+                           GPIO_TypeDef *sda_port, uint16_t sda_pin);
+// Frees a bus that a slave holds by SDA low (e.g. reset in the middle of a
+// read): clocks SCL up to 9 times until SDA is released, then sends a STOP and
+// reinitializes the peripheral. Takes about 0.1 ms, no transfer may be active.
+// Returns -1 and ENOTSUP without pins, EBUSY if SDA stays low.
+int8_t i2c_recover(struct i2c_dev_s *self);
+
+// statistics of DevAddress, NULL if it was not seen or the table is full
+const struct i2c_stats_s *i2c_get_stats(struct i2c_dev_s *self, uint16_t DevAddress);
+void i2c_reset_stats(struct i2c_dev_s *self);
+
+// Prepares xfer for the asynchronous version of i2c_burst_read. Several of them
+// submitted together gather non-contiguous register blocks without waiting in between.
+static inline void i2c_xfer_burst_read(struct i2c_xfer_s *xfer, uint16_t DevAddress, uint8_t MemAddress,
+                                       uint8_t AutoInc, uint8_t *pData, uint16_t Size)
+{
+    xfer->op = I2C_XFER_MEM_READ;
+    xfer->dev_address = DevAddress;
+    xfer->mem_address = (Size > 1) ? (MemAddress | AutoInc) : MemAddress;
+    xfer->mem_add_size = I2C_MEMADD_SIZE_8BIT;
+    xfer->data = pData;
+    xfer->size = Size;
+}
+
+static inline int i2c_xfer_finished(const struct i2c_xfer_s *xfer)
+{
+    return xfer->status == I2C_XFER_DONE || xfer->status == I2C_XFER_ERROR;
+}
 
+// Transfers run with DMA if the handle has DMA channels linked (CubeMX), the
+// data buffers have to be DMA accessible then, otherwise use I2C_XFER_FLAG_NO_DMA.
+// The I2C event and error interrupts have to be enabled. Latencies are
+// measured with the DWT cycle counter, which is enabled here.
 void i2c_init(struct i2c_dev_s *self, I2C_HandleTypeDef *hi2c);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,148 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Register map with shadow cache, shared by the register based chip drivers */
+#include "regmap.h"
+#include <errno.h>
+#include <string.h>
+
+static inline int regmap_test(const uint32_t *map, uint16_t reg)
+{
+    return (map[reg / 32] >> (reg % 32)) & 1u;
+}
+
+static inline void regmap_mark(uint32_t *map, uint16_t reg, int on)
+{
+    if (on)
+        map[reg / 32] |= 1u << (reg % 32);
+    else
+        map[reg / 32] &= ~(1u << (reg % 32));
+}
+
+static inline enum regmap_policy regmap_policy(const struct regmap_s *self, uint16_t reg)
+{
+    return self->policy ? (enum regmap_policy)self->policy[reg] : REGMAP_CACHED;
+}
+
+void regmap_init(struct regmap_s *self, uint16_t *cache, uint32_t *dirty, uint32_t *valid,
+                 uint16_t num_regs, const uint8_t *policy)
+{
+    self->cache = cache;
+    self->dirty = dirty;
+    self->valid = valid;
+    self->num_regs = num_regs;
+    self->policy = policy;
+    memset(cache, 0, num_regs * sizeof(uint16_t));
+    memset(dirty, 0, REGMAP_BITMAP_WORDS(num_regs) * sizeof(uint32_t));
+    memset(valid, 0, REGMAP_BITMAP_WORDS(num_regs) * sizeof(uint32_t));
+}
+
+void regmap_set_defaults(struct regmap_s *self, const uint16_t *defaults)
+{
+    memcpy(self->cache, defaults, self->num_regs * sizeof(uint16_t));
+    memset(self->dirty, 0, REGMAP_BITMAP_WORDS(self->num_regs) * sizeof(uint32_t));
+    memset(self->valid, 0xFF, REGMAP_BITMAP_WORDS(self->num_regs) * sizeof(uint32_t));
+}
+
+void regmap_invalidate(struct regmap_s *self)
+{
+    memset(self->valid, 0, REGMAP_BITMAP_WORDS(self->num_regs) * sizeof(uint32_t));
+}
+
+int8_t regmap_read(struct regmap_s *self, uint16_t reg, uint16_t *val)
+{
+    if (reg >= self->num_regs)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    enum regmap_policy policy = regmap_policy(self, reg);
+    // staged values are returned as well, they are what the chip will hold
+    if (policy == REGMAP_WRITE_ONLY ||
+        (policy == REGMAP_CACHED && (regmap_test(self->valid, reg) || regmap_test(self->dirty, reg))))
+    {
+        *val = self->cache[reg];
+        errno = 0;
+        return 0;
+    }
+    if (!self->read_reg)
+    {
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (self->read_reg(self, reg, val))
+        return -1;
+    if (policy == REGMAP_CACHED)
+    {
+        self->cache[reg] = *val;
+        regmap_mark(self->valid, reg, 1);
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t regmap_set(struct regmap_s *self, uint16_t reg, uint16_t val)
+{
+    if (reg >= self->num_regs)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    // a known value that does not change is not written again
+    if (regmap_policy(self, reg) == REGMAP_VOLATILE || !regmap_test(self->valid, reg) ||
+        self->cache[reg] != val)
+    {
+        self->cache[reg] = val;
+        regmap_mark(self->dirty, reg, 1);
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t regmap_set_bits(struct regmap_s *self, uint16_t reg, uint16_t mask, uint16_t val)
+{
+    uint16_t old;
+    if (regmap_read(self, reg, &old))
+        return -1;
+    return regmap_set(self, reg, (old & ~mask) | (val & mask));
+}
+
+int8_t regmap_write(struct regmap_s *self, uint16_t reg, uint16_t val)
+{
+    if (regmap_set(self, reg, val))
+        return -1;
+    return regmap_sync(self);
+}
+
+int8_t regmap_update_bits(struct regmap_s *self, uint16_t reg, uint16_t mask, uint16_t val)
+{
+    if (regmap_set_bits(self, reg, mask, val))
+        return -1;
+    return regmap_sync(self);
+}
+
+int8_t regmap_sync(struct regmap_s *self)
+{
+    int8_t error = 0;
+    int error_code = 0;
+    for (uint16_t reg = 0; reg < self->num_regs; reg++)
+    {
+        if (!regmap_test(self->dirty, reg))
+            continue;
+        if (self->write_reg(self, reg, self->cache[reg]))
+        {
+            // keep it dirty for the next sync, go on with the others
+            error = -1;
+            error_code = errno;
+        }
+        else
+        {
+            regmap_mark(self->dirty, reg, 0);
+            regmap_mark(self->valid, reg, regmap_policy(self, reg) != REGMAP_VOLATILE);
+        }
+    }
+    errno = error_code;
+    return error;
+}
@@ -0,0 +1,59 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Register map with shadow cache, shared by the register based chip drivers */
+#ifndef REGMAP_H
+#define REGMAP_H
+
+#include <stdint.h>
+
+// Registers are staged in the cache with regmap_set/regmap_set_bits and marked
+// dirty if their value changed, regmap_sync then writes only the dirty ones,
+// one bus transaction each.
+enum regmap_policy
+{
+    REGMAP_CACHED = 0,   //read once from the chip, then served from the cache
+    REGMAP_VOLATILE,     //changes on its own (status, self clearing bits): always read, always written
+    REGMAP_WRITE_ONLY    //can not be read back, the cache is the only copy
+};
+
+// value of field mask (in place) set to val (right aligned)
+#define REGMAP_FIELD(mask, val) (((uint16_t)(val) << __builtin_ctz(mask)) & (mask))
+
+struct regmap_s
+{
+    // chip access for one register, returns 0 or -1 and errno
+    int8_t (*write_reg) (struct regmap_s *self, uint16_t reg, uint16_t val);
+    int8_t (*read_reg) (struct regmap_s *self, uint16_t reg, uint16_t *val); /**< NULL if the chip can not be read */
+    void *ctx; /**< driver instance, for the access functions */
+    uint16_t *cache;
+    const uint8_t *policy; /**< enum regmap_policy per register, NULL for all cached */
+    uint32_t *dirty; /**< bitmap, REGMAP_BITMAP_WORDS(num_regs) words */
+    uint32_t *valid; /**< bitmap, cache holds the chip value */
+    uint16_t num_regs;
+};
+
+#define REGMAP_BITMAP_WORDS(num_regs) (((num_regs) + 31) / 32)
+
+// Cache, dirty and valid are owned by the driver, nothing is valid afterwards.
+void regmap_init(struct regmap_s *self, uint16_t *cache, uint32_t *dirty, uint32_t *valid,
+                 uint16_t num_regs, const uint8_t *policy);
+// cache holds the reset values of the chip, e.g. after a software reset
+void regmap_set_defaults(struct regmap_s *self, const uint16_t *defaults);
+// forget the cache, e.g. after the chip lost power
+void regmap_invalidate(struct regmap_s *self);
+
+// reads from the cache if allowed by the policy, otherwise from the chip
+int8_t regmap_read(struct regmap_s *self, uint16_t reg, uint16_t *val);
+// staged in the cache, written by regmap_sync
+int8_t regmap_set(struct regmap_s *self, uint16_t reg, uint16_t val);
+int8_t regmap_set_bits(struct regmap_s *self, uint16_t reg, uint16_t mask, uint16_t val);
+// staged and written at once (including other dirty registers)
+int8_t regmap_write(struct regmap_s *self, uint16_t reg, uint16_t val);
+int8_t regmap_update_bits(struct regmap_s *self, uint16_t reg, uint16_t mask, uint16_t val);
+// writes all dirty registers in ascending address order
+int8_t regmap_sync(struct regmap_s *self);
+
+#endif
@@ -3,36 +3,416 @@
 // Johannes Kepler University Linz, Austria and all contributors
 // SPDX-License-Identifier: MIT
 
-/* Driver for I2C based on HAL functions */
+/* Driver for SPI based on HAL functions */
 
 #include <errno.h>
 #include "stm32h7xx_hal.h"
 #include "spi_hal.h"
+#include "bus_trace.h"
 
-int8_t spi_transmit(struct spi_dev_s *self,
-                            uint8_t *pData, uint16_t Size, uint32_t Timeout)
-{   
-    if (HAL_SPI_Transmit(self->hspi, pData, Size, Timeout)==HAL_OK)
+// handle -> instance map, required for the shared HAL callbacks
+static struct spi_dev_s *spi_registry[SPI_MAX_INSTANCES];
+
+static struct spi_dev_s *spi_lookup(SPI_HandleTypeDef *hspi)
+{
+    for (int i = 0; i < SPI_MAX_INSTANCES; i++)
+    {
+        if (spi_registry[i] && spi_registry[i]->hspi == hspi)
+            return spi_registry[i];
+    }
+    return NULL;
+}
+
+static void spi_register(struct spi_dev_s *self)
+{
+    int free_slot = -1;
+    for (int i = 0; i < SPI_MAX_INSTANCES; i++)
+    {
+        if (spi_registry[i] && spi_registry[i]->hspi == self->hspi)
+        {
+            spi_registry[i] = self;
+            self->port = i;
+            return;
+        }
+        if (!spi_registry[i] && free_slot < 0)
+            free_slot = i;
+    }
+    if (free_slot >= 0)
+    {
+        spi_registry[free_slot] = self;
+        self->port = free_slot;
+    }
+}
+
+static inline uint32_t spi_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+static int spi_errno(uint32_t hal_error)
+{
+    if (hal_error & HAL_SPI_ERROR_TIMEOUT)
+        return ETIMEDOUT;
+    if (hal_error & HAL_SPI_ERROR_OVR)
+        return EOVERFLOW;
+    return EIO;
+}
+
+static inline void spi_cs(const struct spi_slave_s *slave, GPIO_PinState state)
+{
+    if (slave && slave->cs_port)
+        HAL_GPIO_WritePin(slave->cs_port, slave->cs_pin, state);
+}
+
+// loads the settings of slave into the peripheral if they differ, bus idle
+static HAL_StatusTypeDef spi_configure(struct spi_dev_s *self, const struct spi_slave_s *slave)
+{
+    SPI_InitTypeDef *init = &self->hspi->Init;
+    if (!slave)
+        return HAL_OK;
+    uint32_t polarity = (slave->mode & 2) ? SPI_POLARITY_HIGH : SPI_POLARITY_LOW;
+    uint32_t phase = (slave->mode & 1) ? SPI_PHASE_2EDGE : SPI_PHASE_1EDGE;
+    if (init->CLKPolarity == polarity && init->CLKPhase == phase &&
+        init->BaudRatePrescaler == slave->prescaler && init->DataSize == slave->data_size)
+        return HAL_OK;
+    init->CLKPolarity = polarity;
+    init->CLKPhase = phase;
+    init->BaudRatePrescaler = slave->prescaler;
+    init->DataSize = slave->data_size;
+    self->reconfigs++;
+    return HAL_SPI_Init(self->hspi);
+}
+
+static HAL_StatusTypeDef spi_hal_start(struct spi_dev_s *self, struct spi_xfer_s *x)
+{
+    SPI_HandleTypeDef *hspi = self->hspi;
+    int dma = !(x->flags & SPI_XFER_FLAG_NO_DMA);
+    HAL_StatusTypeDef result = spi_configure(self, x->slave);
+    if (result != HAL_OK)
+        return result;
+    x->t_start = spi_cycles();
+    spi_cs(x->slave, GPIO_PIN_RESET);
+    // the HAL does not take const buffers, it does not write to tx though
+    uint8_t *tx = (uint8_t *)x->tx;
+    if (tx && x->rx)
     {
-        return 0;
+        if (dma && hspi->hdmatx && hspi->hdmarx)
+            result = HAL_SPI_TransmitReceive_DMA(hspi, tx, x->rx, x->size);
+        else
+            result = HAL_SPI_TransmitReceive_IT(hspi, tx, x->rx, x->size);
+    }
+    else if (tx)
+    {
+        if (dma && hspi->hdmatx)
+            result = HAL_SPI_Transmit_DMA(hspi, tx, x->size);
+        else
+            result = HAL_SPI_Transmit_IT(hspi, tx, x->size);
     }
     else
     {
-        errno = EIO; //TODO: use/translate error returned from HAL
+        if (dma && hspi->hdmarx)
+            result = HAL_SPI_Receive_DMA(hspi, x->rx, x->size);
+        else
+            result = HAL_SPI_Receive_IT(hspi, x->rx, x->size);
+    }
+    if (result != HAL_OK)
+        spi_cs(x->slave, GPIO_PIN_SET);
+    return result;
+}
+
+// Completes the active transaction. status is written before the callback, so
+// the callback may submit the descriptor again.
+static void spi_finish(struct spi_dev_s *self, enum spi_xfer_status status, uint32_t hal_error)
+{
+    struct spi_xfer_s *x = self->active;
+    if (!x)
+        return; //transfer started past the queue
+    spi_cs(x->slave, GPIO_PIN_SET);
+    self->active = NULL;
+    x->hal_error = hal_error;
+    x->status = status;
+    BUS_TRACE_END(BUS_TRACE_SPI, self->port, x->slave ? x->slave->trace_id : 0, x->size,
+                  x->t_submit, spi_cycles() - x->t_start, status != SPI_XFER_DONE);
+    if (x->complete)
+        x->complete(x);
+}
+
+// Starts the head of the queue if the bus is idle, runs in main loop and interrupt context.
+static void spi_start_next(struct spi_dev_s *self)
+{
+    while (1)
+    {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        struct spi_xfer_s *x = self->head;
+        if (self->active || !x)
+        {
+            __set_PRIMASK(primask);
+            return;
+        }
+        self->head = x->next;
+        if (!self->head)
+            self->tail = NULL;
+        x->next = NULL;
+        x->status = SPI_XFER_BUSY;
+        self->active = x;
+        __set_PRIMASK(primask);
+
+        HAL_StatusTypeDef result = spi_hal_start(self, x);
+        if (result == HAL_OK)
+            return;
+
+        if (result == HAL_BUSY)
+        {
+            // somebody else uses the bus, put it back and retry from spi_service
+            primask = __get_PRIMASK();
+            __disable_irq();
+            if (self->active == x)
+            {
+                self->active = NULL;
+                x->status = SPI_XFER_QUEUED;
+                x->next = self->head;
+                self->head = x;
+                if (!self->tail)
+                    self->tail = x;
+            }
+            __set_PRIMASK(primask);
+            return;
+        }
+        spi_finish(self, SPI_XFER_ERROR, HAL_SPI_GetError(self->hspi));
+    }
+}
+
+int8_t spi_submit(struct spi_dev_s *self, struct spi_xfer_s *xfer)
+{
+    if (xfer->status == SPI_XFER_QUEUED || xfer->status == SPI_XFER_BUSY)
+    {
+        errno = EBUSY;
         return -1;
     }
+    xfer->next = NULL;
+    xfer->hal_error = HAL_SPI_ERROR_NONE;
+    xfer->t_submit = spi_cycles();
+    xfer->t_start = 0;
+    xfer->status = SPI_XFER_QUEUED;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (self->tail)
+        self->tail->next = xfer;
+    else
+        self->head = xfer;
+    self->tail = xfer;
+    __set_PRIMASK(primask);
+
+    spi_start_next(self);
+    return 0;
+}
+
+void spi_service(struct spi_dev_s *self)
+{
+    spi_start_next(self);
+}
+
+void spi_cancel(struct spi_dev_s *self, struct spi_xfer_s *xfer)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (xfer->status == SPI_XFER_QUEUED)
+    {
+        struct spi_xfer_s *prev = NULL;
+        for (struct spi_xfer_s *x = self->head; x; prev = x, x = x->next)
+        {
+            if (x != xfer)
+                continue;
+            if (prev)
+                prev->next = x->next;
+            else
+                self->head = x->next;
+            if (self->tail == x)
+                self->tail = prev;
+            break;
+        }
+        xfer->next = NULL;
+        xfer->hal_error = HAL_SPI_ERROR_TIMEOUT;
+        xfer->status = SPI_XFER_ERROR;
+        __set_PRIMASK(primask);
+        return;
+    }
+    if (self->active != xfer)
+    {
+        __set_PRIMASK(primask);
+        return;
+    }
+    __set_PRIMASK(primask);
+
+    // HAL_SPI_Abort stops the DMA and the peripheral before it returns
+    HAL_SPI_Abort(self->hspi);
+    primask = __get_PRIMASK();
+    __disable_irq();
+    if (self->active == xfer)
+        spi_finish(self, SPI_XFER_ERROR, HAL_SPI_ERROR_TIMEOUT);
+    __set_PRIMASK(primask);
+    spi_start_next(self);
+}
+
+int8_t spi_transfer(struct spi_dev_s *self, struct spi_xfer_s *xfer, uint32_t Timeout)
+{
+    xfer->flags |= SPI_XFER_FLAG_NO_DMA;
+    xfer->complete = NULL;
+    xfer->status = SPI_XFER_IDLE;
+    if (spi_submit(self, xfer) < 0)
+        return -1;
+    return spi_wait(self, xfer, Timeout);
+}
+
+int8_t spi_wait(struct spi_dev_s *self, struct spi_xfer_s *xfer, uint32_t Timeout)
+{
+    struct deadline_s deadline;
+    deadline_start(&deadline, Timeout);
+    while (!spi_xfer_finished(xfer))
+    {
+        if (deadline_expired(&deadline))
+        {
+            spi_cancel(self, xfer);
+            if (xfer->status != SPI_XFER_DONE)
+            {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+        }
+        spi_service(self);
+    }
+    if (xfer->status != SPI_XFER_DONE)
+    {
+        errno = spi_errno(xfer->hal_error);
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t spi_transmit(struct spi_dev_s *self,
+                            uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    struct spi_xfer_s xfer = {.slave = self->slave, .tx = pData, .size = Size};
+    return spi_transfer(self, &xfer, Timeout);
 }
 
 int8_t spi_transmitReceive(struct spi_dev_s *self, uint8_t *pTxData,
                             uint8_t *pRxData, uint16_t Size, uint32_t Timeout)
-{   
-    if (HAL_SPI_TransmitReceive(self->hspi, pTxData, pRxData, Size, Timeout)==HAL_OK)
+{
+    struct spi_xfer_s xfer = {.slave = self->slave, .tx = pTxData, .rx = pRxData, .size = Size};
+    return spi_transfer(self, &xfer, Timeout);
+}
+
+volatile uint32_t *spi_stream_begin(struct spi_dev_s *self, const struct spi_slave_s *slave)
+{
+    if (slave && slave->cs_port)
     {
-        return 0;
+        errno = EINVAL;
+        return NULL;
     }
-    else
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (self->active || self->head)
     {
-        errno = EIO; //TODO: use/translate error returned from HAL
-        return -1;
+        __set_PRIMASK(primask);
+        errno = EBUSY;
+        return NULL;
     }
-}
\ No newline at end of file
+    self->stream.slave = slave;
+    self->stream.status = SPI_XFER_BUSY;
+    self->active = &self->stream;
+    __set_PRIMASK(primask);
+
+    SPI_HandleTypeDef *hspi = self->hspi;
+    SPI_TypeDef *spi = hspi->Instance;
+    spi_configure(self, slave);
+    __HAL_SPI_DISABLE(hspi);
+    self->stream_cfg2 = spi->CFG2;
+    MODIFY_REG(spi->CFG2, SPI_CFG2_COMM, SPI_CFG2_COMM_0); //simplex transmitter, no RX overrun
+    MODIFY_REG(spi->CR2, SPI_CR2_TSIZE, 0);                //endless
+    hspi->State = HAL_SPI_STATE_BUSY_TX;                   //direct HAL calls get HAL_BUSY
+    __HAL_SPI_ENABLE(hspi);
+    SET_BIT(spi->CR1, SPI_CR1_CSTART);
+    errno = 0;
+    return &spi->TXDR;
+}
+
+void spi_stream_end(struct spi_dev_s *self)
+{
+    SPI_HandleTypeDef *hspi = self->hspi;
+    SPI_TypeDef *spi = hspi->Instance;
+    struct deadline_s deadline;
+    deadline_start(&deadline, SPI_TIMEOUT_MS);
+    while (!(spi->SR & SPI_SR_TXC) && !deadline_expired(&deadline)) {}
+    SET_BIT(spi->CR1, SPI_CR1_CSUSP);
+    while (!(spi->SR & SPI_SR_SUSP) && !deadline_expired(&deadline)) {}
+    __HAL_SPI_DISABLE(hspi);
+    SET_BIT(spi->IFCR, SPI_IFCR_SUSPC);
+    spi->CFG2 = self->stream_cfg2;
+    hspi->State = HAL_SPI_STATE_READY;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    self->stream.status = SPI_XFER_DONE;
+    self->active = NULL;
+    __set_PRIMASK(primask);
+    spi_start_next(self);
+}
+
+static void spi_xfer_cplt(SPI_HandleTypeDef *hspi)
+{
+    struct spi_dev_s *self = spi_lookup(hspi);
+    if (!self)
+        return;
+    spi_finish(self, SPI_XFER_DONE, HAL_SPI_ERROR_NONE);
+    spi_start_next(self);
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    spi_xfer_cplt(hspi);
+}
+
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    spi_xfer_cplt(hspi);
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    spi_xfer_cplt(hspi);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+    struct spi_dev_s *self = spi_lookup(hspi);
+    if (!self)
+        return;
+    spi_finish(self, SPI_XFER_ERROR, HAL_SPI_GetError(hspi));
+    spi_start_next(self);
+}
+
+void spi_init(struct spi_dev_s *self, SPI_HandleTypeDef *hspi)
+{
+    self->hspi = hspi;
+    self->transmit = &spi_transmit;
+    self->transmitReceive = &spi_transmitReceive;
+    self->transfer = &spi_transfer;
+    self->submit = &spi_submit;
+    self->service = &spi_service;
+    self->slave = NULL;
+    self->head = NULL;
+    self->tail = NULL;
+    self->active = NULL;
+    self->stream.status = SPI_XFER_IDLE;
+    self->port = 0;
+    self->reconfigs = 0;
+    spi_register(self);
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55; //unlock, required on some Cortex-M7
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
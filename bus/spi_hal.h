@@ -3,26 +3,138 @@
 // Johannes Kepler University Linz, Austria and all contributors
 // SPDX-License-Identifier: MIT
 
-/* Driver for I2C based on HAL functions */
+/* Driver for SPI based on HAL functions */
 #ifndef SPI_HAL_H
 #define SPI_HAL_H
 
 #include "stm32h7xx_hal.h"
+#include "deadline.h"
+
+// number of SPI peripherals that can be active at the same time
+#ifndef SPI_MAX_INSTANCES
+#define SPI_MAX_INSTANCES (4)
+#endif
+// timeout of a single register access of the chip drivers
+#ifndef SPI_TIMEOUT_MS
+#define SPI_TIMEOUT_MS (2)
+#endif
+
+// A chip on the bus: its chip select and the bus settings it needs. The
+// peripheral is reconfigured when a transfer for a chip with other settings
+// starts, chips with equal settings follow each other without that.
+struct spi_slave_s
+{
+    GPIO_TypeDef *cs_port; //NULL if CS is the hardware NSS or fixed
+    uint16_t cs_pin;       //active low
+    uint8_t mode;          //0..3, CPOL << 1 | CPHA
+    uint32_t prescaler;    //SPI_BAUDRATEPRESCALER_x
+    uint32_t data_size;    //SPI_DATASIZE_xBIT, size of one data word
+    uint8_t trace_id;      //chip select index in bus traces, unique per bus
+};
+
+enum spi_xfer_status
+{
+    SPI_XFER_IDLE,   //not submitted yet
+    SPI_XFER_QUEUED, //waiting for the bus
+    SPI_XFER_BUSY,   //on the bus
+    SPI_XFER_DONE,
+    SPI_XFER_ERROR   //hal_error holds the HAL error code
+};
+
+// descriptor is not DMA safe, the transfer uses interrupts even if DMA is linked
+#define SPI_XFER_FLAG_NO_DMA (1 << 0)
+
+// Transaction descriptor, owned by the caller and linked into the queue while
+// submitted. It and the buffers have to stay valid until status is DONE or ERROR.
+// A software CS is asserted for the whole transaction, with the hardware NSS in
+// pulse mode every data word is a frame of its own.
+struct spi_xfer_s
+{
+    const struct spi_slave_s *slave; //NULL: bus settings as they are, no CS
+    const uint8_t *tx;      //NULL to receive only
+    uint8_t *rx;            //NULL to transmit only
+    uint16_t size;          //data words, not bytes
+    uint8_t flags;
+    // called from interrupt context once the transfer finished, may be NULL
+    void (*complete) (struct spi_xfer_s *xfer);
+    void *arg;              //free for the owner, e.g. the driver instance
+    volatile enum spi_xfer_status status;
+    uint32_t hal_error;
+    uint32_t t_submit, t_start;
+    struct spi_xfer_s *next;
+};
 
 struct spi_dev_s
-{    
+{
     SPI_HandleTypeDef *hspi;
     int8_t (*transmit) (struct spi_dev_s *self,
                                    uint8_t *pData, uint16_t Size, uint32_t Timeout);
     int8_t (*transmitReceive) (struct spi_dev_s *self, uint8_t *pTxData,
                                     uint8_t *pRxData, uint16_t Size, uint32_t Timeout);
-    //TODO: consider using a vtable
+    int8_t (*transfer) (struct spi_dev_s *self, struct spi_xfer_s *xfer, uint32_t Timeout);
+    int8_t (*submit) (struct spi_dev_s *self, struct spi_xfer_s *xfer);
+    void (*service) (struct spi_dev_s *self);
+    const struct spi_slave_s *slave; /**< chip of transmit/transmitReceive, NULL for none */
+    struct spi_xfer_s *head, *tail; /**< queued transactions */
+    struct spi_xfer_s *volatile active; /**< transaction on the bus */
+    struct spi_xfer_s stream; /**< placeholder in active while streaming */
+    uint32_t stream_cfg2; /**< CFG2 to restore after streaming */
+    uint8_t port; /**< registry slot, identifies the bus in bus traces */
+    uint32_t reconfigs; /**< peripheral reinitialized for other chip settings */
 };
 
+// The blocking calls queue a transaction and wait for it, Timeout in ms, e.g.
+// SPI_TIMEOUT_MS or deadline_remaining() of a longer sequence. They must not be
+// called from a completion callback or other interrupt. Errors:
+// EBUSY     descriptor still submitted
+// ETIMEDOUT not finished in time, the transfer was aborted
+// EOVERFLOW overrun
+// EIO       mode fault and others
 int8_t spi_transmit(struct spi_dev_s *self,
                             uint8_t *pData, uint16_t Size, uint32_t Timeout);
 
 int8_t spi_transmitReceive(struct spi_dev_s *self, uint8_t *pTxData,
                             uint8_t *pRxData, uint16_t Size, uint32_t Timeout);
+// Blocking call for a prepared descriptor, e.g. for a chip other than self->slave.
+// The buffers may be on the stack, interrupts are used instead of DMA.
+int8_t spi_transfer(struct spi_dev_s *self, struct spi_xfer_s *xfer, uint32_t Timeout);
+// Blocking wait for a submitted descriptor, e.g. one with DMA buffers, with
+// the errors of the blocking calls. It is canceled on the timeout.
+int8_t spi_wait(struct spi_dev_s *self, struct spi_xfer_s *xfer, uint32_t Timeout);
+
+// Queues xfer and returns at once, transactions run in submission order and
+// the next one is started from the completion interrupt of the previous one.
+// Completion is signaled by xfer->complete and by xfer->status.
+int8_t spi_submit(struct spi_dev_s *self, struct spi_xfer_s *xfer);
+// Restarts the queue after the peripheral was used past it, call periodically
+// from the main loop if that can happen.
+void spi_service(struct spi_dev_s *self);
+// Removes xfer from the queue or aborts it if it is on the bus, its status is
+// ERROR afterwards unless it finished before.
+void spi_cancel(struct spi_dev_s *self, struct spi_xfer_s *xfer);
+
+// Hands the bus to an external DMA request source, e.g. a timer update, that
+// writes data words to the returned TXDR address. The peripheral runs as
+// continuous transmitter, every word becomes a frame with the hardware NSS
+// pulsed in between (NSSP), so slave must not use a software CS. Queued
+// transfers wait until spi_stream_end. Returns NULL and EBUSY if the bus is in
+// use, EINVAL for a software CS.
+volatile uint32_t *spi_stream_begin(struct spi_dev_s *self, const struct spi_slave_s *slave);
+// Waits for the last frame (up to SPI_TIMEOUT_MS), restores the peripheral and
+// restarts the queue. The DMA has to be stopped before.
+void spi_stream_end(struct spi_dev_s *self);
+
+static inline int spi_xfer_finished(const struct spi_xfer_s *xfer)
+{
+    return xfer->status == SPI_XFER_DONE || xfer->status == SPI_XFER_ERROR;
+}
+
+// Transfers run with DMA if the handle has DMA channels linked (CubeMX), with
+// the DMA data width matching the largest data_size. The buffers have to be
+// DMA accessible then (DMA_BUFFER section), otherwise use SPI_XFER_FLAG_NO_DMA.
+// The SPI interrupt has to be enabled. Software CS pins are configured as
+// outputs at high level by the application. Transfers are time stamped with
+// the DWT cycle counter, which is enabled here.
+void spi_init(struct spi_dev_s *self, SPI_HandleTypeDef *hspi);
 
-#endif
\ No newline at end of file
+#endif
@@ -11,12 +11,140 @@
     __attribute__((section(".dma_buffer"))) __attribute__ ((aligned (4)))
 
 DMA_BUFFER uint32_t dac81408_dma_buffer[DAC81408_BUFFER_LENGTH]; //configure datawidth for DMA as word (=32 bit), because of 24 bit transfers
+DMA_BUFFER static uint32_t dac81408_readback_tx[DAC81408_READBACK_MAX+1];
+DMA_BUFFER static uint32_t dac81408_readback_rx[DAC81408_READBACK_MAX+1];
 
+// DACRANGE field and output span of enum dac81408_range
+static const struct
+{
+    uint8_t code;
+    int32_t min_mv;
+    int32_t span_mv;
+} dac81408_ranges[] =
+{
+    [unip_5]   = {0b0000, 0, 5000},
+    [bipo_10]  = {0b1010, -10000, 20000},
+    [unip_10]  = {0b0001, 0, 10000},
+    [unip_20]  = {0b0010, 0, 20000},
+    [unip_40]  = {0b0100, 0, 40000},
+    [bipo_2_5] = {0b1110, -2500, 5000},
+    [bipo_5]   = {0b1001, -5000, 10000},
+    [bipo_20]  = {0b1100, -20000, 40000},
+};
+
+// code = round((volts_q16 - min) * mul / 2^32) + add with the range minimum in Q16 (exact,
+// all are multiples of 125 mV) and only the integer offset in add, so there is a
+// single rounding. The smallest span of 5 V and DAC81408_CAL_GAIN_MAX keep mul below 2^31.
+static void dac81408_update_conv(struct dac81408_dev_s *self, uint8_t n)
+{
+    int64_t gain = self->cal[n].gain ? self->cal[n].gain : 65536;
+    int32_t span_mv = dac81408_ranges[self->range[n]].span_mv;
+    self->conv_mul[n] = (int32_t)(((gain << 32) / 65536 * 1000 + span_mv / 2) / span_mv);
+    self->conv_min[n] = dac81408_ranges[self->range[n]].min_mv * 65536 / 1000;
+    self->conv_add[n] = self->cal[n].offset;
+}
+
+static inline uint16_t dac81408_conv(int32_t volts, int32_t min, int32_t mul, int32_t add)
+{
+#if defined(__ARM_FEATURE_DSP)
+    int32_t code;
+    volts = __QSUB(volts, min); //saturated, full scale inputs stay full scale
+    // most significant word multiply accumulate, rounded, no CMSIS intrinsic for it
+    __ASM ("smmlar %0, %1, %2, %3" : "=r" (code) : "r" (volts), "r" (mul), "r" (add));
+    return (uint16_t)__USAT(code, 16);
+#else
+    int32_t code = (int32_t)((((int64_t)volts - min) * mul + 0x80000000LL) >> 32) + add;
+    return code < 0 ? 0 : (code > 0xFFFF ? 0xFFFF : (uint16_t)code);
+#endif
+}
+
+// DMA handle -> instance map, required for the DMA callbacks
+static struct dac81408_dev_s *dac81408_streams[DAC81408_MAX_STREAMS];
+
+static struct dac81408_dev_s *dac81408_stream_lookup(DMA_HandleTypeDef *hdma)
+{
+    for(int i=0; i<DAC81408_MAX_STREAMS; i++)
+    {
+        if(dac81408_streams[i] && dac81408_streams[i]->stream.hdma == hdma)
+        {
+            return dac81408_streams[i];
+        }
+    }
+    return NULL;
+}
+
+static int8_t dac81408_stream_register(struct dac81408_dev_s *self)
+{
+    int free_slot = -1;
+    for(int i=0; i<DAC81408_MAX_STREAMS; i++)
+    {
+        if(dac81408_streams[i] == self)
+        {
+            return 0;
+        }
+        if(!dac81408_streams[i] && free_slot < 0)
+        {
+            free_slot = i;
+        }
+    }
+    if(free_slot < 0)
+    {
+        return -1;
+    }
+    dac81408_streams[free_slot] = self;
+    return 0;
+}
+
+static void dac81408_stream_unregister(struct dac81408_dev_s *self)
+{
+    for(int i=0; i<DAC81408_MAX_STREAMS; i++)
+    {
+        if(dac81408_streams[i] == self)
+        {
+            dac81408_streams[i] = NULL;
+        }
+    }
+}
+
+
+static inline uint32_t dac81408_frame(uint8_t adr, uint16_t val)
+{
+    return ((uint32_t)(adr&(0b111111))<<16) | val;
+}
+
+// one 24 bit frame, with the settings of self->slave if set
+static int8_t dac81408_xfer(struct dac81408_dev_s *self, uint32_t *tx, uint32_t *rx, uint32_t timeout)
+{
+    if(self->slave)
+    {
+        struct spi_xfer_s xfer = {.slave = self->slave, .tx = (uint8_t*) tx, .rx = (uint8_t*) rx, .size = 1};
+        return spi_transfer(self->spi_dev, &xfer, timeout);
+    }
+    if(rx)
+    {
+        return self->spi_dev->transmitReceive(self->spi_dev, (uint8_t*) tx, (uint8_t*) rx, 1, timeout);
+    }
+    return self->spi_dev->transmit(self->spi_dev, (uint8_t*) tx, 1, timeout);
+}
+
+static int8_t dac81408_write_frame(struct dac81408_dev_s *self, uint8_t adr, uint16_t val, uint32_t timeout)
+{
+    uint32_t data=dac81408_frame(adr, val);
+    if(dac81408_xfer(self, &data, NULL, timeout))
+    {
+        return -1;
+    }
+    if(adr < DAC81408_TRIGGER)
+    {
+        self->shadow[adr] = val;
+        self->shadow_valid |= 1<<adr;
+    }
+    return 0;
+}
 
 int8_t dac81408_writeReg(struct dac81408_dev_s *self, uint8_t adr, uint16_t val)
 {
-    uint32_t data=((adr&(0b111111))<<16) | (val);
-    return self->spi_dev->spi_transmit(self->spi_dev, (uint8_t*) &data, 1, 0xFFFFFFFF);      
+    return dac81408_write_frame(self, adr, val, SPI_TIMEOUT_MS);
 }
 
 int8_t dac81408_readReg(struct dac81408_dev_s *self, uint8_t adr, uint16_t *retval)
@@ -24,9 +152,19 @@ int8_t dac81408_readReg(struct dac81408_dev_s *self, uint8_t adr, uint16_t *retv
     int8_t error;
     uint32_t dataRx;    
     uint32_t dataTx=(1<<23)|((adr&(0b111111))<<16)|(0);
+    struct deadline_s d; //both frames share one budget
+    deadline_start(&d, SPI_TIMEOUT_MS);
 
-    self->spi_dev->spi_transmit(self->spi_dev, (uint8_t*) &dataTx, 1, 0xFFFFFFFF);    
-    error=self->spi_dev->spi_transmitReceive(self->spi_dev, (uint8_t*) &dataTx, &dataRx, 1, 0xFFFFFFFF);
+    error=dac81408_xfer(self, &dataTx, NULL, deadline_remaining(&d));
+    if(error)
+    {
+        return error; //errno set by the bus
+    }
+    error=dac81408_xfer(self, &dataTx, &dataRx, deadline_remaining(&d));
+    if(error)
+    {
+        return error;
+    }
     *retval=(uint16_t)((dataRx)&(0xFFFF));
     uint8_t adr_rx=(int8_t)(((dataRx&(~(1<<23)))&(0xFF0000))>>16);
     if(adr_rx!=adr)
@@ -37,11 +175,121 @@ int8_t dac81408_readReg(struct dac81408_dev_s *self, uint8_t adr, uint16_t *retv
     return error;
 }
 
+int8_t dac81408_read_regs(struct dac81408_dev_s *self, const uint8_t *adr, uint16_t *vals, uint8_t n)
+{
+    const struct spi_slave_s *slave = self->slave ? self->slave : self->spi_dev->slave;
+    uint32_t *tx = dac81408_readback_tx;
+    uint32_t *rx = dac81408_readback_rx;
+    struct deadline_s d; //all frames share one budget
+    deadline_start(&d, SPI_TIMEOUT_MS);
+    if(!n || n > DAC81408_READBACK_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(uint8_t i=0; i<n; i++)
+    {
+        tx[i] = (1<<23) | dac81408_frame(adr[i], 0);
+    }
+    tx[n] = 0; //NOP, clocks out the last response
+    if(!slave || !slave->cs_port)
+    {
+        struct spi_xfer_s xfer = {.slave = slave, .tx = (uint8_t*) tx, .rx = (uint8_t*) rx, .size = n+1};
+        if(spi_submit(self->spi_dev, &xfer) || spi_wait(self->spi_dev, &xfer, deadline_remaining(&d)))
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        for(uint8_t i=0; i<=n; i++)
+        {
+            if(dac81408_xfer(self, &tx[i], &rx[i], deadline_remaining(&d)))
+            {
+                return -1;
+            }
+        }
+    }
+    for(uint8_t i=0; i<n; i++)
+    {
+        uint32_t r = rx[i+1];
+        if((((r&(~(1<<23)))&(0xFF0000))>>16) != adr[i])
+        {
+            errno = EIO;
+            return -1;
+        }
+        vals[i] = r & 0xFFFF;
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t dac81408_verify(struct dac81408_dev_s *self, uint8_t *repaired)
+{
+    uint8_t adr[DAC81408_TRIGGER];
+    uint16_t vals[DAC81408_TRIGGER];
+    uint8_t n=0;
+    uint8_t count=0;
+    for(uint8_t a=0; a<DAC81408_TRIGGER; a++)
+    {
+        if(self->shadow_valid & (1<<a))
+        {
+            adr[n++] = a;
+        }
+    }
+    if(repaired)
+    {
+        *repaired = 0;
+    }
+    if(!n)
+    {
+        errno = 0;
+        return 0;
+    }
+    if(dac81408_read_regs(self, adr, vals, n))
+    {
+        // SDO or the SPI mode may be upset, restore SPICONFIG and try again
+        if(errno != EIO || !(self->shadow_valid & (1<<DAC81408_SPICONFIG)))
+        {
+            return -1;
+        }
+        if(dac81408_writeReg(self, DAC81408_SPICONFIG, self->shadow[DAC81408_SPICONFIG]) ||
+           dac81408_read_regs(self, adr, vals, n))
+        {
+            return -1;
+        }
+        count++;
+    }
+    for(uint8_t i=0; i<n; i++)
+    {
+        if(vals[i] != self->shadow[adr[i]])
+        {
+            if(dac81408_writeReg(self, adr[i], self->shadow[adr[i]]))
+            {
+                return -1;
+            }
+            count++;
+        }
+    }
+    if(repaired)
+    {
+        *repaired = count;
+    }
+    errno = 0;
+    return 0;
+}
+
 int8_t dac81408_init(struct dac81408_dev_s *self)
 {
     uint16_t tmp;
     int8_t error=0;
-    error+=dac81408_writeReg(self, DAC81408_SPICONFIG, 0b0101010100100 & ~(1<<5)); //disable power down
+    uint16_t spiconfig = 0b0101010100100 & ~(1<<5); //disable power down
+    self->shadow_valid = 0;
+    if(self->burst_slave)
+    {
+        spiconfig |= DAC81408_SPICONFIG_STR_EN; //frames of 24 bit are not affected
+    }
+    error+=dac81408_writeReg(self, DAC81408_SPICONFIG, spiconfig);
     error+=dac81408_readReg(self, DAC81408_DEVICEID, &tmp);
     if((tmp>>2) != 0x298)
     {
@@ -53,25 +301,752 @@ int8_t dac81408_init(struct dac81408_dev_s *self)
     error+=dac81408_writeReg(self, DAC81408_DACPWDWN, 0xF00F); //disable power down    
     error+=dac81408_writeReg(self, DAC81408_GENCONFIG, 0b0011111100000000); //enable internal reference
     error+=dac81408_writeReg(self, DAC81408_SYNCCONFIG, 0x0); //asynchronous mode
+    self->sync_mask = 0;
     error+=dac81408_writeReg(self, DAC81408_BRDCONFIG, 0b1111000000001111); //ignore BRDCAST commands
+    self->brd_mask = 0;
+    error+=dac81408_writeReg(self, DAC81408_TOGGCONFIG0, 0x0); //toggle mode off
+    error+=dac81408_writeReg(self, DAC81408_TOGGCONFIG1, 0x0);
+    self->toggconfig[0] = 0;
+    self->toggconfig[1] = 0;
     return error;
 }
 
 int8_t dac81408_set_range(struct dac81408_dev_s *self, enum dac81408_range range)
 {
-    uint16_t val;
+    return dac81408_set_channel_range(self, 0xFF, range);
+}
+
+int8_t dac81408_set_channel_range(struct dac81408_dev_s *self, uint8_t channel_mask, enum dac81408_range range)
+{
+    struct deadline_s d;
+    deadline_start(&d, SPI_TIMEOUT_MS);
+    uint16_t dacrange[2];
+    uint16_t pwdwn = 0;
+    int8_t error=0;
+    if(range > bipo_20)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(uint8_t i=0; i<2; i++)
+    {
+        dacrange[i] = 0;
+        for(uint8_t k=0; k<4; k++)
+        {
+            uint8_t n = (1-i)*4 + k; //DACRANGE0 holds DAC[7:4]
+            uint8_t r = (channel_mask & (1<<n)) ? range : self->range[n];
+            dacrange[i] |= dac81408_ranges[r].code << (4*k);
+        }
+    }
+    // powered up channels are powered down for the change
+    if(self->shadow_valid & (1<<DAC81408_DACPWDWN))
+    {
+        for(uint8_t n=0; n<8; n++)
+        {
+            if((channel_mask & (1<<n)) && !(self->shadow[DAC81408_DACPWDWN] & DAC81408_CH_BIT(n)))
+            {
+                pwdwn |= DAC81408_CH_BIT(n);
+            }
+        }
+    }
+    if(pwdwn)
+    {
+        error = dac81408_write_frame(self, DAC81408_DACPWDWN, self->shadow[DAC81408_DACPWDWN] | pwdwn,
+                                     deadline_remaining(&d));
+        self->shadow[DAC81408_DACPWDWN] &= ~pwdwn; //as it is to be restored
+    }
+    if(!error)
+    {
+        error = dac81408_write_frame(self, DAC81408_DACRANGE0, dacrange[0], deadline_remaining(&d));
+    }
+    if(!error)
+    {
+        error = dac81408_write_frame(self, DAC81408_DACRANGE1, dacrange[1], deadline_remaining(&d));
+    }
+    if(pwdwn && dac81408_write_frame(self, DAC81408_DACPWDWN, self->shadow[DAC81408_DACPWDWN], deadline_remaining(&d)))
+    {
+        error = -1;
+    }
+    if(error)
+    {
+        return -1; //errno from the bus
+    }
+    for(uint8_t n=0; n<8; n++)
+    {
+        if(channel_mask & (1<<n))
+        {
+            self->range[n] = range;
+            dac81408_update_conv(self, n);
+        }
+    }
+    return 0;
+}
+
+int8_t dac81408_set_cal(struct dac81408_dev_s *self, uint8_t channel, const struct dac81408_cal_s *cal)
+{
+    if(channel >= 8 || (cal->gain && (cal->gain < DAC81408_CAL_GAIN_MIN || cal->gain > DAC81408_CAL_GAIN_MAX)) ||
+       cal->offset < -0xFFFF || cal->offset > 0xFFFF)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    self->cal[channel] = *cal;
+    dac81408_update_conv(self, channel);
+    return 0;
+}
+
+void dac81408_q16_to_codes(const struct dac81408_dev_s *self, uint8_t channel_mask, const int32_t *volts,
+                           uint16_t *codes, uint16_t samples)
+{
+    int32_t min[8], mul[8], add[8];
+    uint8_t nch=0;
+    for(uint8_t n=0; n<8; n++)
+    {
+        if(channel_mask & (1<<n))
+        {
+            min[nch] = self->conv_min[n];
+            mul[nch] = self->conv_mul[n];
+            add[nch] = self->conv_add[n];
+            nch++;
+        }
+    }
+    for(uint16_t s=0; s<samples; s++)
+    {
+        for(uint8_t i=0; i<nch; i++)
+        {
+            *codes++ = dac81408_conv(*volts++, min[i], mul[i], add[i]);
+        }
+    }
+}
+
+void dac81408_volts_to_codes(const struct dac81408_dev_s *self, uint8_t channel_mask, const float_t *volts,
+                             uint16_t *codes, uint16_t samples)
+{
+    int32_t min[8], mul[8], add[8];
+    uint8_t nch=0;
+    for(uint8_t n=0; n<8; n++)
+    {
+        if(channel_mask & (1<<n))
+        {
+            min[nch] = self->conv_min[n];
+            mul[nch] = self->conv_mul[n];
+            add[nch] = self->conv_add[n];
+            nch++;
+        }
+    }
+    for(uint16_t s=0; s<samples; s++)
+    {
+        for(uint8_t i=0; i<nch; i++)
+        {
+            float_t v = *volts++;
+            // clamped far outside every range, so the Q16 value cannot overflow
+            v = v > 64.0f ? 64.0f : (v < -64.0f ? -64.0f : v);
+            *codes++ = dac81408_conv((int32_t)(v * 65536.0f), min[i], mul[i], add[i]);
+        }
+    }
+}
+
+int8_t dac81408_ldac(struct dac81408_dev_s *self)
+{
+    if(self->ldac_port)
+    {
+        // active low, the pulse of two port writes is longer than the minimum of 20 ns
+        HAL_GPIO_WritePin(self->ldac_port, self->ldac_pin, GPIO_PIN_RESET);
+        HAL_GPIO_WritePin(self->ldac_port, self->ldac_pin, GPIO_PIN_SET);
+        errno = 0;
+        return 0;
+    }
+    return dac81408_writeReg(self, DAC81408_TRIGGER, DAC81408_TRIGGER_LDAC);
+}
+
+// adjacent channels first..first+n-1 in one transfer: the first frame carries
+// the address, every further 16 bit word goes to the next DAC data register
+static int8_t dac81408_write_burst(struct dac81408_dev_s *self, uint8_t first, uint8_t n, const uint16_t *codes,
+                                   uint32_t timeout)
+{
+    uint8_t buf[1+2*8];
+    buf[0] = DAC81408_DAC0 + first;
+    for(uint8_t i=0; i<n; i++)
+    {
+        buf[1+2*i] = codes[i]>>8;
+        buf[2+2*i] = codes[i]&0xFF;
+    }
+    struct spi_xfer_s xfer = {.slave = self->burst_slave, .tx = buf, .size = 1+2*n};
+    return spi_transfer(self->spi_dev, &xfer, timeout);
+}
+
+int8_t dac81408_write_sync(struct dac81408_dev_s *self, uint8_t channel_mask, const uint16_t *codes)
+{
+    struct deadline_s d; //the whole update shares one budget
+    deadline_start(&d, SPI_TIMEOUT_MS);
+    if(!channel_mask)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if((self->sync_mask & channel_mask) != channel_mask)
+    {
+        uint16_t syncconfig = 0;
+        for(uint8_t n=0; n<8; n++)
+        {
+            if((self->sync_mask | channel_mask) & (1<<n))
+            {
+                syncconfig |= DAC81408_CH_BIT(n);
+            }
+        }
+        if(dac81408_write_frame(self, DAC81408_SYNCCONFIG, syncconfig, deadline_remaining(&d)))
+        {
+            return -1;
+        }
+        self->sync_mask |= channel_mask;
+    }
+    uint8_t n=0;
+    while(n<8)
+    {
+        if(!(channel_mask & (1<<n)))
+        {
+            n++;
+            continue;
+        }
+        uint8_t first=n;
+        while(n<8 && (channel_mask & (1<<n)))
+        {
+            n++;
+        }
+        int8_t error;
+        if(self->burst_slave)
+        {
+            error = dac81408_write_burst(self, first, n-first, codes, deadline_remaining(&d));
+            codes += n-first;
+        }
+        else
+        {
+            error = 0;
+            for(uint8_t ch=first; ch<n && !error; ch++)
+            {
+                error = dac81408_write_frame(self, DAC81408_DAC0 + ch, *codes++, deadline_remaining(&d));
+            }
+        }
+        if(error)
+        {
+            return -1; //errno from the bus
+        }
+    }
+    if(self->ldac_port)
+    {
+        return dac81408_ldac(self);
+    }
+    return dac81408_write_frame(self, DAC81408_TRIGGER, DAC81408_TRIGGER_LDAC, deadline_remaining(&d));
+}
+
+int8_t dac81408_broadcast(struct dac81408_dev_s *self, uint8_t channel_mask, uint16_t code)
+{
+    struct deadline_s d;
+    deadline_start(&d, SPI_TIMEOUT_MS);
+    if(!channel_mask)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(self->brd_mask != channel_mask)
+    {
+        uint16_t brdconfig = 0b1111000000001111;
+        for(uint8_t n=0; n<8; n++)
+        {
+            if(channel_mask & (1<<n))
+            {
+                brdconfig |= DAC81408_CH_BIT(n);
+            }
+        }
+        if(dac81408_write_frame(self, DAC81408_BRDCONFIG, brdconfig, deadline_remaining(&d)))
+        {
+            return -1;
+        }
+        self->brd_mask = channel_mask;
+    }
+    return dac81408_write_frame(self, DAC81408_BRDCAST, code, deadline_remaining(&d));
+}
+
+int8_t dac81408_set_toggle(struct dac81408_dev_s *self, uint8_t channel_mask, enum dac81408_toggle pin,
+                           uint16_t code_a, uint16_t code_b)
+{
+    struct deadline_s d;
+    deadline_start(&d, SPI_TIMEOUT_MS);
+    uint16_t toggconfig[2] = {self->toggconfig[0], self->toggconfig[1]};
+    int8_t error=0;
+    if(!channel_mask || pin > DAC81408_TOGGLE2)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    for(uint8_t n=0; n<8; n++)
+    {
+        if(channel_mask & (1<<n))
+        {
+            uint8_t i = DAC81408_TOGGCONFIG(n) - DAC81408_TOGGCONFIG0;
+            toggconfig[i] &= ~(0b11 << DAC81408_TOGG_SHIFT(n));
+            toggconfig[i] |= pin << DAC81408_TOGG_SHIFT(n);
+        }
+    }
+    // levels first, so the pin does not switch to a stale one
+    for(uint8_t n=0; n<8 && !error; n++)
+    {
+        if(channel_mask & (1<<n))
+        {
+            error = dac81408_write_frame(self, DAC81408_DAC0 + n, code_a, deadline_remaining(&d));
+        }
+    }
+    if(!error && pin != DAC81408_TOGGLE_OFF)
+    {
+        error = dac81408_write_frame(self, DAC81408_TRIGGER, DAC81408_TRIGGER_AB_TOG_EN, deadline_remaining(&d));
+        for(uint8_t n=0; n<8 && !error; n++)
+        {
+            if(channel_mask & (1<<n))
+            {
+                error = dac81408_write_frame(self, DAC81408_DAC0 + n, code_b, deadline_remaining(&d));
+            }
+        }
+        if(dac81408_write_frame(self, DAC81408_TRIGGER, 0, deadline_remaining(&d))) //back to register A
+        {
+            error = -1;
+        }
+    }
+    for(uint8_t i=0; i<2 && !error; i++)
+    {
+        if(toggconfig[i] != self->toggconfig[i])
+        {
+            error = dac81408_write_frame(self, DAC81408_TOGGCONFIG0 + i, toggconfig[i], deadline_remaining(&d));
+            if(!error)
+            {
+                self->toggconfig[i] = toggconfig[i];
+            }
+        }
+    }
+    return error ? -1 : 0; //errno from the bus
+}
+
+int8_t dac81408_toggle_start(struct tim_dev_s *tim_dev, uint32_t Channel, uint32_t freq)
+{
+    if(freq < TIM_FREQ_MIN || freq > TIM_FREQ_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(tim_dev->set_freq(tim_dev, freq))
+    {
+        return -1; //errno from the timer
+    }
+    return tim_dev->start_pwm(tim_dev, Channel, 0x8000); //errno from the timer
+}
+
+int8_t dac81408_toggle_stop(struct tim_dev_s *tim_dev, uint32_t Channel)
+{
+    return tim_dev->stop_pwm(tim_dev, Channel);
+}
+
+
+//// daisy chain
+
+static int8_t dac81408_chain_xfer(struct dac81408_chain_s *self, uint32_t *tx, uint32_t *rx, uint32_t timeout)
+{
+    struct spi_xfer_s xfer = {.slave = self->slave, .tx = (uint8_t*) tx, .rx = (uint8_t*) rx, .size = self->n};
+    return spi_transfer(self->spi_dev, &xfer, timeout);
+}
+
+static void dac81408_chain_shadow(struct dac81408_chain_s *self, uint8_t chip, uint8_t adr, uint16_t val)
+{
+    if(adr < DAC81408_CHAIN_REGS && adr != DAC81408_TRIGGER)
+    {
+        self->shadow[chip][adr] = val;
+    }
+}
+
+int8_t dac81408_chain_writeReg(struct dac81408_chain_s *self, uint8_t chip, uint8_t adr, uint16_t val)
+{
+    uint32_t tx[DAC81408_CHAIN_MAX] = {0}; //NOP
+    if(chip >= self->n)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    tx[self->n-1-chip] = dac81408_frame(adr, val);
+    if(dac81408_chain_xfer(self, tx, NULL, SPI_TIMEOUT_MS))
+    {
+        return -1;
+    }
+    dac81408_chain_shadow(self, chip, adr, val);
+    return 0;
+}
+
+int8_t dac81408_chain_write_all(struct dac81408_chain_s *self, uint8_t adr, uint16_t val)
+{
+    uint32_t tx[DAC81408_CHAIN_MAX];
+    for(uint8_t j=0; j<self->n; j++)
+    {
+        tx[j] = dac81408_frame(adr, val);
+    }
+    if(dac81408_chain_xfer(self, tx, NULL, SPI_TIMEOUT_MS))
+    {
+        return -1;
+    }
+    for(uint8_t k=0; k<self->n; k++)
+    {
+        dac81408_chain_shadow(self, k, adr, val);
+    }
+    return 0;
+}
+
+// read command to the chips of chip_mask, the responses come with the next transfer
+static int8_t dac81408_chain_read(struct dac81408_chain_s *self, uint8_t chip_mask, uint8_t adr, uint16_t *vals)
+{
+    uint32_t tx[DAC81408_CHAIN_MAX] = {0};
+    uint32_t rx[DAC81408_CHAIN_MAX];
+    struct deadline_s d; //both transfers share one budget
+    deadline_start(&d, SPI_TIMEOUT_MS);
+    for(uint8_t k=0; k<self->n; k++)
+    {
+        if(chip_mask & (1<<k))
+        {
+            tx[self->n-1-k] = (1<<23) | dac81408_frame(adr, 0);
+        }
+    }
+    if(dac81408_chain_xfer(self, tx, NULL, deadline_remaining(&d)))
+    {
+        return -1;
+    }
+    for(uint8_t j=0; j<self->n; j++)
+    {
+        tx[j] = 0; //NOP
+    }
+    if(dac81408_chain_xfer(self, tx, rx, deadline_remaining(&d)))
+    {
+        return -1;
+    }
+    for(uint8_t k=0; k<self->n; k++)
+    {
+        if(!(chip_mask & (1<<k)))
+        {
+            continue;
+        }
+        uint32_t r = rx[self->n-1-k];
+        if(((r >> 16) & 0b111111) != adr)
+        {
+            errno = EIO; //chain broken or chip not responding
+            return -1;
+        }
+        *vals++ = r & 0xFFFF;
+        dac81408_chain_shadow(self, k, adr, r & 0xFFFF);
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t dac81408_chain_readReg(struct dac81408_chain_s *self, uint8_t chip, uint8_t adr, uint16_t *retval)
+{
+    if(chip >= self->n)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return dac81408_chain_read(self, 1<<chip, adr, retval);
+}
+
+int8_t dac81408_chain_read_all(struct dac81408_chain_s *self, uint8_t adr, uint16_t *vals)
+{
+    return dac81408_chain_read(self, (1<<self->n)-1, adr, vals);
+}
+
+int8_t dac81408_chain_init(struct dac81408_chain_s *self)
+{
+    uint16_t id[DAC81408_CHAIN_MAX];
     int8_t error=0;
-    switch(range)
-    {
-        case bipo_10:
-            val=0xAAAA;
-        break;
-        default:
-            error=-1;
-            return error;
-        break;
-    }
-    error+=dac81408_writeReg(self, DAC81408_DACRANGE0, val);    
-    error+=dac81408_writeReg(self, DAC81408_DACRANGE1, val);
+    if(!self->n || self->n > DAC81408_CHAIN_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    self->pending = 0;
+    // SDO is enabled after reset, which the chain relies on
+    error+=dac81408_chain_write_all(self, DAC81408_SPICONFIG, 0b0101010100100 & ~(1<<5)); //disable power down
+    error+=dac81408_chain_read_all(self, DAC81408_DEVICEID, id);
+    if(error)
+    {
+        return -1;
+    }
+    for(uint8_t k=0; k<self->n; k++)
+    {
+        if((id[k]>>2) != 0x298)
+        {
+            //wrong device ID
+            errno = ENODEV;
+            return -1;
+        }
+    }
+    error+=dac81408_chain_write_all(self, DAC81408_DACRANGE0, 0xAAAA); //-10 to 10 V
+    error+=dac81408_chain_write_all(self, DAC81408_DACRANGE1, 0xAAAA);
+    error+=dac81408_chain_write_all(self, DAC81408_DACPWDWN, 0xF00F); //disable power down
+    error+=dac81408_chain_write_all(self, DAC81408_GENCONFIG, 0b0011111100000000); //enable internal reference
+    error+=dac81408_chain_write_all(self, DAC81408_SYNCCONFIG, 0x0FF0); //synchronous mode
+    error+=dac81408_chain_write_all(self, DAC81408_BRDCONFIG, 0b1111000000001111); //ignore BRDCAST commands
+    error+=dac81408_chain_write_all(self, DAC81408_TOGGCONFIG0, 0x0);
+    error+=dac81408_chain_write_all(self, DAC81408_TOGGCONFIG1, 0x0);
+    return error ? -1 : 0;
+}
+
+static void dac81408_chain_done(struct spi_xfer_s *xfer)
+{
+    struct dac81408_chain_s *self = (struct dac81408_chain_s *) xfer->arg;
+    if(xfer->status == SPI_XFER_ERROR)
+    {
+        self->hal_error = xfer->hal_error ? xfer->hal_error : HAL_SPI_ERROR_ABORT;
+    }
+    self->pending--;
+}
+
+int8_t dac81408_chain_update(struct dac81408_chain_s *self, uint8_t channel_mask, const uint16_t *codes)
+{
+    uint8_t nch=0;
+    uint8_t r=0;
+    if(!channel_mask)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(self->pending)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    for(uint8_t n=0; n<8; n++)
+    {
+        nch += (channel_mask >> n) & 1;
+    }
+    for(uint8_t n=0, i=0; n<8; n++)
+    {
+        if(!(channel_mask & (1<<n)))
+        {
+            continue;
+        }
+        for(uint8_t k=0; k<self->n; k++)
+        {
+            uint16_t code = codes[k*nch + i];
+            self->frames[r][self->n-1-k] = dac81408_frame(DAC81408_DAC0 + n, code);
+            dac81408_chain_shadow(self, k, DAC81408_DAC0 + n, code);
+        }
+        i++;
+        r++;
+    }
+    for(uint8_t j=0; j<self->n; j++)
+    {
+        self->frames[r][j] = dac81408_frame(DAC81408_TRIGGER, DAC81408_TRIGGER_LDAC);
+    }
+    r++;
+    self->hal_error = 0;
+    self->pending = r;
+    for(uint8_t i=0; i<r; i++)
+    {
+        struct spi_xfer_s *x = &self->xfer[i];
+        x->slave = self->slave;
+        x->tx = (uint8_t*) self->frames[i];
+        x->rx = NULL;
+        x->size = self->n;
+        x->flags = self->xfer_flags;
+        x->complete = dac81408_chain_done;
+        x->arg = self;
+        x->status = SPI_XFER_IDLE;
+        spi_submit(self->spi_dev, x); //cannot fail, none of them is queued
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t dac81408_chain_wait(struct dac81408_chain_s *self, uint32_t Timeout)
+{
+    struct deadline_s d;
+    deadline_start(&d, Timeout);
+    while(self->pending)
+    {
+        if(deadline_expired(&d))
+        {
+            // the queued ones first, so aborting the active one starts none of them
+            for(int8_t i=8; i>=0; i--)
+            {
+                spi_cancel(self->spi_dev, &self->xfer[i]);
+            }
+            self->pending = 0; //the queued ones complete without callback
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        spi_service(self->spi_dev);
+    }
+    if(self->hal_error)
+    {
+        errno = EIO;
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
+
+
+//// streaming
+
+// the DMA finished reading half, it plays the other one now
+static void dac81408_stream_half_done(DMA_HandleTypeDef *hdma, uint8_t half)
+{
+    struct dac81408_dev_s *self = dac81408_stream_lookup(hdma);
+    if(!self)
+    {
+        return;
+    }
+    if(self->stream.free_half >= 0)
+    {
+        self->stream.underruns++; //the half now playing was not refilled
+    }
+    self->stream.free_half = half;
+    if(self->stream.refill)
+    {
+        self->stream.refill(self, half);
+    }
+}
+
+static void dac81408_stream_half_cplt(DMA_HandleTypeDef *hdma)
+{
+    dac81408_stream_half_done(hdma, 0);
+}
+
+static void dac81408_stream_cplt(DMA_HandleTypeDef *hdma)
+{
+    dac81408_stream_half_done(hdma, 1);
+}
+
+static void dac81408_stream_error(DMA_HandleTypeDef *hdma)
+{
+    struct dac81408_dev_s *self = dac81408_stream_lookup(hdma);
+    if(self)
+    {
+        self->stream.underruns++;
+    }
+}
+
+int8_t dac81408_stream_setup(struct dac81408_dev_s *self, struct tim_dev_s *tim_dev, DMA_HandleTypeDef *hdma,
+                             uint8_t channel_mask, uint16_t samples, uint32_t *table, uint16_t table_len)
+{
+    struct dac81408_stream_s *st = &self->stream;
+    st->nch = 0;
+    for(uint8_t n=0; n<8; n++)
+    {
+        if(channel_mask & (1<<n))
+        {
+            st->channel[st->nch++] = n;
+        }
+    }
+    if(!st->nch || !samples)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(2ul*samples*st->nch > table_len)
+    {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    st->tim_dev = tim_dev;
+    st->hdma = hdma;
+    st->table = table;
+    st->nframes = samples*st->nch;
+    st->free_half = -1;
+    st->underruns = 0;
+    // the addresses stay, only the codes change with every fill
+    for(uint16_t i=0; i<2*st->nframes; i++)
+    {
+        st->table[i] = dac81408_frame(DAC81408_DAC0 + st->channel[i % st->nch], 0);
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t dac81408_stream_fill(struct dac81408_dev_s *self, uint8_t half, const uint16_t *codes)
+{
+    struct dac81408_stream_s *st = &self->stream;
+    if(half > 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t *frame = st->table + half*st->nframes;
+    for(uint16_t i=0; i<st->nframes; i++)
+    {
+        frame[i] = dac81408_frame(DAC81408_DAC0 + st->channel[i % st->nch], codes[i]);
+    }
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if(st->free_half == half)
+    {
+        st->free_half = -1;
+    }
+    __set_PRIMASK(primask);
+    errno = 0;
+    return 0;
+}
+
+int8_t dac81408_stream_start(struct dac81408_dev_s *self, uint32_t rate_hz)
+{
+    struct dac81408_stream_s *st = &self->stream;
+    // frame rate rate_hz * nch, checked without overflow
+    if(!st->nch || rate_hz < (TIM_FREQ_MIN + st->nch - 1u) / st->nch || rate_hz > TIM_FREQ_MAX / st->nch)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if(st->tim_dev->set_freq(st->tim_dev, rate_hz*st->nch))
+    {
+        return -1; //errno from the timer
+    }
+    if(dac81408_stream_register(self))
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    volatile uint32_t *txdr = spi_stream_begin(self->spi_dev, self->slave);
+    if(!txdr)
+    {
+        dac81408_stream_unregister(self);
+        return -1; //errno from the bus
+    }
+    st->free_half = -1;
+    st->hdma->XferHalfCpltCallback = dac81408_stream_half_cplt;
+    st->hdma->XferCpltCallback = dac81408_stream_cplt;
+    st->hdma->XferErrorCallback = dac81408_stream_error;
+    if(HAL_DMA_Start_IT(st->hdma, (uintptr_t)st->table, (uintptr_t)txdr, 2*st->nframes) != HAL_OK)
+    {
+        spi_stream_end(self->spi_dev);
+        dac81408_stream_unregister(self);
+        errno = EBUSY;
+        return -1;
+    }
+    if(st->tim_dev->start_dma_request(st->tim_dev))
+    {
+        int error = errno;
+        HAL_DMA_Abort(st->hdma);
+        spi_stream_end(self->spi_dev);
+        dac81408_stream_unregister(self);
+        errno = error;
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
+
+int8_t dac81408_stream_stop(struct dac81408_dev_s *self)
+{
+    struct dac81408_stream_s *st = &self->stream;
+    int8_t error = st->tim_dev->stop_dma_request(st->tim_dev);
+    int error_code = errno;
+    HAL_DMA_Abort(st->hdma);
+    spi_stream_end(self->spi_dev);
+    dac81408_stream_unregister(self);
+    st->free_half = -1;
+    errno = error ? error_code : 0;
     return error;
 }
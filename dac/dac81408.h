@@ -9,7 +9,9 @@
 #define DAC81408_H
 
 #include <stdint.h>
+#include <math.h>
 #include "spi_hal.h"
+#include "tim_hal.h"
 
 /* Register addresses */
 #define DAC81408_NOP          (0x00)    //NOP Register
@@ -37,25 +39,231 @@
 #define DAC81408_OFFSET0      (0x21)    //DAC[6-7;4-5] Differential Offset Register
 #define DAC81408_OFFSET1      (0x22)    //DAC[2-3;0-1] Differential Offset Register
 
-struct dac81408_dev_s
+/* Register bits */
+#define DAC81408_SPICONFIG_STR_EN (1<<3)  //streaming: data words after the first frame go to the next address
+#define DAC81408_TRIGGER_LDAC     (1<<4)  //loads the DACs in synchronous mode
+#define DAC81408_TRIGGER_AB_TOG_EN (1<<7) //toggle mode: DAC data writes go to register B while set
+#define DAC81408_CH_BIT(n)        (1u<<((n)+4)) //channel n in SYNCCONFIG, BRDCONFIG and DACPWDWN
+// 2 bit toggle field of channel n: register and shift
+#define DAC81408_TOGGCONFIG(n)    ((n)>=4 ? DAC81408_TOGGCONFIG0 : DAC81408_TOGGCONFIG1)
+#define DAC81408_TOGG_SHIFT(n)    (2*(((n)+4)%8))
+
+struct dac81408_dev_s;
+
+// number of DACs that can stream at the same time
+#ifndef DAC81408_MAX_STREAMS
+#define DAC81408_MAX_STREAMS (2)
+#endif
+
+// Waveform output without the CPU: every update event of the timer makes its
+// DMA write the next 24 bit frame of table to the SPI, the table holds the
+// frames of the streamed channels interleaved and is played circularly. While
+// the DMA plays one half the application refills the other one.
+struct dac81408_stream_s
 {
-    struct spi_dev_s *spi_dev; /**< SPI device */
-    // TODO: Add function pointers
+    struct tim_dev_s *tim_dev;  /**< update events pace the frames */
+    DMA_HandleTypeDef *hdma;    /**< DMA of the timer update request: circular, word, memory to peripheral */
+    uint32_t *table;            /**< 2 halves of nframes, DMA accessible */
+    uint16_t nframes;           /**< frames per half, samples * nch */
+    uint8_t channel[8];
+    uint8_t nch;
+    volatile int8_t free_half;  /**< half the application may fill, -1 none */
+    volatile uint32_t underruns; /**< halves played again because they were not refilled */
+    // called from the DMA interrupt when a half becomes free, may be NULL
+    void (*refill) (struct dac81408_dev_s *self, uint8_t half);
+};
+
+// TOGGLE pin a channel in toggle mode follows: register A at low, B at high
+enum dac81408_toggle
+{
+DAC81408_TOGGLE_OFF,
+DAC81408_TOGGLE0,
+DAC81408_TOGGLE1,
+DAC81408_TOGGLE2
 };
 
 enum dac81408_range
 {
-unip_5, //0 to 5 V
-bipo_10 //-10 to 10 V
+unip_5,   //0 to 5 V
+bipo_10,  //-10 to 10 V
+unip_10,  //0 to 10 V
+unip_20,  //0 to 20 V
+unip_40,  //0 to 40 V
+bipo_2_5, //-2.5 to 2.5 V
+bipo_5,   //-5 to 5 V
+bipo_20   //-20 to 20 V
+};
+
+// Calibration of a channel, applied to the ideal code c of a voltage:
+// c * gain / 65536 + offset. A zeroed one is the identity.
+#define DAC81408_CAL_GAIN_MIN (32768) //0.5
+#define DAC81408_CAL_GAIN_MAX (98304) //1.5
+struct dac81408_cal_s
+{
+    int32_t gain;   /**< Q16, 65536 = 1, 0 for 1, otherwise DAC81408_CAL_GAIN_MIN..MAX */
+    int32_t offset; /**< codes, -65535..65535 */
+};
+
+struct dac81408_dev_s
+{
+    struct spi_dev_s *spi_dev; /**< SPI device */
+    // bus settings of the 24 bit frames, for register access and the stream.
+    // NULL to keep the current ones, which is not possible with burst_slave.
+    const struct spi_slave_s *slave;
+    // 8 bit data with CS held for the whole transfer (software CS or NSS
+    // without pulses), lets dac81408_write_sync send adjacent channels in one
+    // streaming mode burst. NULL for one 24 bit frame per channel.
+    const struct spi_slave_s *burst_slave;
+    GPIO_TypeDef *ldac_port; /**< LDAC pin, NULL to trigger by the TRIGGER register */
+    uint16_t ldac_pin;
+    uint8_t sync_mask; /**< channels in synchronous mode, bit n for DACn */
+    uint8_t brd_mask; /**< channels taking BRDCAST */
+    uint16_t toggconfig[2]; /**< TOGGCONFIG0, TOGGCONFIG1 */
+    uint16_t shadow[DAC81408_TRIGGER]; /**< configuration registers as written, for dac81408_verify */
+    uint16_t shadow_valid; /**< bit adr set once shadow[adr] was written */
+    uint8_t range[8]; /**< enum dac81408_range of DACn */
+    struct dac81408_cal_s cal[8]; /**< set by dac81408_set_cal, kept by init */
+    int32_t conv_min[8], conv_mul[8], conv_add[8]; /**< volts in Q16 to code, from range and cal */
+    struct dac81408_stream_s stream;
+    // TODO: Add function pointers
 };
 
 int8_t dac81408_writeReg(struct dac81408_dev_s *self, uint8_t adr, uint16_t val);
 int8_t dac81408_readReg(struct dac81408_dev_s *self, uint8_t adr, uint16_t *retval);
 int8_t dac81408_init(struct dac81408_dev_s *self);
+// all channels
 int8_t dac81408_set_range(struct dac81408_dev_s *self, enum dac81408_range range);
+// The channels in channel_mask get range. Powered up ones are powered down
+// during the change, their outputs take the new range with the next code.
+int8_t dac81408_set_channel_range(struct dac81408_dev_s *self, uint8_t channel_mask, enum dac81408_range range);
+// channel 0..7 and cal in the ranges of struct dac81408_cal_s, EINVAL otherwise
+int8_t dac81408_set_cal(struct dac81408_dev_s *self, uint8_t channel, const struct dac81408_cal_s *cal);
+
+// Volts to codes for the channels in channel_mask, with their range and
+// calibration, saturated to 0..0xFFFF. The arrays hold samples sets of one
+// value per channel in ascending channel order, like dac81408_stream_fill and
+// dac81408_write_sync take them. Fixed point with the DSP instructions of the
+// Cortex-M7 (SMMLAR, USAT) if available, portable C with the same results
+// otherwise. The codes are rounded to the nearest.
+void dac81408_q16_to_codes(const struct dac81408_dev_s *self, uint8_t channel_mask, const int32_t *volts,
+                           uint16_t *codes, uint16_t samples); //volts in Q16.16
+void dac81408_volts_to_codes(const struct dac81408_dev_s *self, uint8_t channel_mask, const float_t *volts,
+                             uint16_t *codes, uint16_t samples);
+
+// registers of one dac81408_read_regs call
+#ifndef DAC81408_READBACK_MAX
+#define DAC81408_READBACK_MAX (16)
+#endif
+// Reads the n registers adr[i] into vals[i] with n+1 frames: every frame
+// carries the next read command and returns the response to the previous one.
+// Without a software CS all frames go in one DMA transaction (hardware NSS in
+// pulse mode), else one transfer per frame. Not reentrant, the DMA buffers are
+// shared. Errors: EINVAL n out of range, EIO an address did not match.
+int8_t dac81408_read_regs(struct dac81408_dev_s *self, const uint8_t *adr, uint16_t *vals, uint8_t n);
+// Reads back the configuration registers written since init and rewrites the
+// ones that differ, repaired returns their number (may be NULL). If the
+// readback itself fails, SPICONFIG is rewritten once and the check repeated.
+// Cheap enough to run periodically, e.g. as upset check.
+int8_t dac81408_verify(struct dac81408_dev_s *self, uint8_t *repaired);
+
+// Writes codes[i] to DACn for the bits n of channel_mask in ascending order and
+// loads all of them at once, by LDAC or the TRIGGER register. The channels are
+// switched to synchronous mode on the first use and stay in it, later plain
+// writes to them wait for the next dac81408_ldac.
+int8_t dac81408_write_sync(struct dac81408_dev_s *self, uint8_t channel_mask, const uint16_t *codes);
+// loads the channels in synchronous mode
+int8_t dac81408_ldac(struct dac81408_dev_s *self);
+
+// Sets the channels of channel_mask to code with one BRDCAST frame. BRDCONFIG
+// is rewritten only if the mask differs from the previous call, channels in
+// synchronous mode take the code with the next dac81408_ldac.
+int8_t dac81408_broadcast(struct dac81408_dev_s *self, uint8_t channel_mask, uint16_t code);
+
+// Puts the channels of channel_mask into toggle mode on pin with the two
+// levels code_a and code_b, DAC81408_TOGGLE_OFF returns them to code_a as
+// normal output. The output then changes with the pin only, without SPI.
+int8_t dac81408_set_toggle(struct dac81408_dev_s *self, uint8_t channel_mask, enum dac81408_toggle pin,
+                           uint16_t code_a, uint16_t code_b);
+// Drives a TOGGLE pin with the PWM of the timer output Channel (TIM_CHANNEL_x)
+// wired to it: a square wave of freq, the channels on it alternate between
+// their levels at that rate. The timer is not shared with a stream then.
+// Errors: EINVAL freq outside TIM_FREQ_MIN..TIM_FREQ_MAX, else from the timer.
+int8_t dac81408_toggle_start(struct tim_dev_s *tim_dev, uint32_t Channel, uint32_t freq);
+int8_t dac81408_toggle_stop(struct tim_dev_s *tim_dev, uint32_t Channel);
+
+// Daisy chain: SDO of chip k feeds SDI of chip k+1, all share SCLK and CS.
+// A transfer carries one 24 bit frame per chip under a single CS assertion,
+// every chip executes the frame it holds when CS rises. Frame j of a transfer
+// reaches chip n-1-j, frame j read back comes from the same chip.
+#ifndef DAC81408_CHAIN_MAX
+#define DAC81408_CHAIN_MAX (4)
+#endif
+#define DAC81408_CHAIN_REGS (DAC81408_OFFSET1 + 1)
 
-#define DAC81408_BUFFER_LENGTH (128)
+struct dac81408_chain_s
+{
+    struct spi_dev_s *spi_dev;
+    // 24 bit data, CS held for the whole transfer: software CS or NSS without pulses
+    const struct spi_slave_s *slave;
+    uint8_t n; /**< chips, chip 0 is at MOSI, chip n-1 drives MISO */
+    uint8_t xfer_flags; /**< SPI_XFER_FLAG_NO_DMA if the instance is not in the DMA_BUFFER section */
+    uint16_t shadow[DAC81408_CHAIN_MAX][DAC81408_CHAIN_REGS]; /**< last written or read register values */
+    // queued update: one transfer per channel and one for LDAC
+    uint32_t frames[8+1][DAC81408_CHAIN_MAX];
+    struct spi_xfer_s xfer[8+1];
+    volatile uint8_t pending; /**< transfers of the update not finished yet */
+    volatile uint32_t hal_error; /**< of a failed update transfer, 0 if none */
+};
+
+// Configures all chips like dac81408_init, but with every channel in
+// synchronous mode, so the outputs change with the LDAC of an update only.
+int8_t dac81408_chain_init(struct dac81408_chain_s *self);
+// one chip, the others get a NOP
+int8_t dac81408_chain_writeReg(struct dac81408_chain_s *self, uint8_t chip, uint8_t adr, uint16_t val);
+int8_t dac81408_chain_readReg(struct dac81408_chain_s *self, uint8_t chip, uint8_t adr, uint16_t *retval);
+// the same register of every chip in one transfer, vals has n entries
+int8_t dac81408_chain_write_all(struct dac81408_chain_s *self, uint8_t adr, uint16_t val);
+int8_t dac81408_chain_read_all(struct dac81408_chain_s *self, uint8_t adr, uint16_t *vals);
+// Queues the update of the channels in channel_mask on every chip and returns.
+// codes holds per chip the codes in ascending channel order, chip 0 first.
+// The transfers, one per channel plus the LDAC, follow each other from the
+// completion interrupt, with DMA unless xfer_flags says otherwise.
+// Errors: EBUSY previous update still running, EINVAL no channel.
+int8_t dac81408_chain_update(struct dac81408_chain_s *self, uint8_t channel_mask, const uint16_t *codes);
+static inline int dac81408_chain_busy(const struct dac81408_chain_s *self)
+{
+    return self->pending != 0;
+}
+// Waits up to Timeout ms for the update. Errors: ETIMEDOUT (the rest of the
+// update is canceled), EIO a transfer failed.
+int8_t dac81408_chain_wait(struct dac81408_chain_s *self, uint32_t Timeout);
+
+// frames of dac81408_dma_buffer, a table for dac81408_stream_setup
+#ifndef DAC81408_BUFFER_LENGTH
+#define DAC81408_BUFFER_LENGTH (1024)
+#endif
 extern uint32_t dac81408_dma_buffer[];
 
+// Prepares streaming of the channels in channel_mask (bit n for DACn) with
+// samples per half of table, which has table_len frames. The SPI has to use
+// the hardware NSS in pulse mode and 24 bit data. Errors: EINVAL no channel,
+// EOVERFLOW table too short.
+int8_t dac81408_stream_setup(struct dac81408_dev_s *self, struct tim_dev_s *tim_dev, DMA_HandleTypeDef *hdma,
+                             uint8_t channel_mask, uint16_t samples, uint32_t *table, uint16_t table_len);
+// Writes samples * nch codes, interleaved per sample in ascending channel
+// order, to half (0 or 1) of the table. Fill both before the start.
+int8_t dac81408_stream_fill(struct dac81408_dev_s *self, uint8_t half, const uint16_t *codes);
+// half the application has to fill next, -1 if none is free
+static inline int8_t dac81408_stream_due(const struct dac81408_dev_s *self)
+{
+    return self->stream.free_half;
+}
+// Starts the output with rate_hz samples per channel, the frames of one sample
+// go out at nch * rate_hz. The SPI bus is taken over until the stop, other
+// transfers on it wait. Errors: EINVAL not set up or nch * rate_hz outside
+// TIM_FREQ_MIN..TIM_FREQ_MAX, EBUSY bus in use, else from the timer.
+int8_t dac81408_stream_start(struct dac81408_dev_s *self, uint32_t rate_hz);
+int8_t dac81408_stream_stop(struct dac81408_dev_s *self);
+
 
 #endif
\ No newline at end of file
@@ -9,16 +9,13 @@
 
 int8_t ht221tr_writeReg(struct ht221tr_dev_s *self, uint8_t regadr, uint16_t val)
 {
-    // uint8_t data[2];
-    // data[0]=((regadr&0x7F)<<1)+((val&0x0100)>>8); //left 7 bits are register adr, one data bit (MSB) right
-    // data[1]=val&0x00FF; //8 lower data bits
-    // return self->i2c_dev->i2c_master_transmit(self->i2c_dev, self->hw_adr, &data[0], 2, 0xFFFFFFFF);
-    return 0;
+    uint8_t data=val&0x00FF;
+    return self->i2c_dev->mem_write(self->i2c_dev, self->hw_adr, regadr, 1, &data, 1, I2C_TIMEOUT_MS);
 }
 
 int8_t ht221tr_readReg(struct ht221tr_dev_s *self, uint8_t adr, uint8_t *val)
 {
-    return self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr, adr, 1, val, 1, 0xFFFFFFFF);
+    return self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr, adr, 1, val, 1, I2C_TIMEOUT_MS);
 }
 
 int8_t ht221tr_whoami(struct ht221tr_dev_s *self)
@@ -28,7 +25,11 @@ int8_t ht221tr_whoami(struct ht221tr_dev_s *self)
     error+=ht221tr_readReg(self, HTS221TR_WHO_AM_I, &val);
     if(error)
     {
-        errno=EIO;
+        return -1; //errno from the bus
+    }
+    else if(val!=HTS221TR_WHO_AM_I_VAL)
+    {
+        errno=ENODEV;
         return -1;
     }
     else
@@ -38,9 +39,57 @@ int8_t ht221tr_whoami(struct ht221tr_dev_s *self)
     }
 }
 
+static int8_t ht221tr_read_calibration(struct ht221tr_dev_s *self)
+{
+    uint8_t c[HTS221TR_CALIB_LEN]; //0x30..0x3F in one transfer
+    if(self->i2c_dev->burst_read(self->i2c_dev, self->hw_adr, HTS221TR_CALIB_0, I2C_AUTOINC_ST,
+                                 c, HTS221TR_CALIB_LEN, I2C_TIMEOUT_MS))
+    {
+        return -1; //errno from the bus
+    }
+    self->h0_rh = c[0x0]/2.0f;
+    self->h1_rh = c[0x1]/2.0f;
+    self->t0_degc = (c[0x2] | ((c[0x5]&0x03)<<8))/8.0f;
+    self->t1_degc = (c[0x3] | ((c[0x5]&0x0C)<<6))/8.0f;
+    self->h0_t0_out = (int16_t)(c[0x6] | (c[0x7]<<8));
+    self->h1_t0_out = (int16_t)(c[0xA] | (c[0xB]<<8));
+    self->t0_out = (int16_t)(c[0xC] | (c[0xD]<<8));
+    self->t1_out = (int16_t)(c[0xE] | (c[0xF]<<8));
+    errno=0;
+    return 0;
+}
+
+int8_t ht221tr_read_sample(struct ht221tr_dev_s *self, float_t *humidity, float_t *temperature)
+{
+    uint8_t buf[4]; //HUMIDITY_OUT_L/H, TEMP_OUT_L/H
+    if(self->h1_t0_out == self->h0_t0_out || self->t1_out == self->t0_out)
+    {
+        errno=ENODATA; //calibration not read or invalid, the bus is fine
+        return -1;
+    }
+    if(self->i2c_dev->burst_read(self->i2c_dev, self->hw_adr, HTS221TR_HUMIDITY_OUT_L, I2C_AUTOINC_ST,
+                                 buf, 4, I2C_TIMEOUT_MS))
+    {
+        return -1; //errno from the bus
+    }
+    int16_t h_out = (int16_t)(buf[0] | (buf[1]<<8));
+    int16_t t_out = (int16_t)(buf[2] | (buf[3]<<8));
+    // linear interpolation between the calibration points
+    *humidity = self->h0_rh + (self->h1_rh-self->h0_rh)*(h_out-self->h0_t0_out)/(float_t)(self->h1_t0_out-self->h0_t0_out);
+    *temperature = self->t0_degc + (self->t1_degc-self->t0_degc)*(t_out-self->t0_out)/(float_t)(self->t1_out-self->t0_out);
+    errno=0;
+    return 0;
+}
+
 int8_t ht221tr_init(struct ht221tr_dev_s *self)
 {
     int8_t error=0;
+    self->read_sample = &ht221tr_read_sample;
     error+=ht221tr_whoami(self);
+    if(!error)
+        error+=ht221tr_read_calibration(self);
+    if(!error)
+        error+=ht221tr_writeReg(self, HTS221TR_CTRL_REG1,
+                                (1<<HTS221TR_PD_BIT_NUM) | (1<<HTS221TR_BDU_BIT_NUM) | (1<<HTS221TR_ODR_BIT_NUM)); //on, 1 Hz
     return error;
-}
\ No newline at end of file
+}
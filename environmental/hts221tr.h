@@ -9,6 +9,7 @@
 #define HTS221TR_H
 
 #include <stdint.h>
+#include <math.h>
 #include "i2c_hal.h"
 
 /* Register addresses */
@@ -22,6 +23,15 @@
 #define HTS221TR_HUMIDITY_OUT_H (0x29)
 #define HTS221TR_TEMP_OUT_L (0x2A)
 #define HTS221TR_TEMP_OUT_H (0x2B)
+#define HTS221TR_CALIB_0 (0x30)
+#define HTS221TR_CALIB_LEN (16)
+#define HTS221TR_WHO_AM_I_VAL (0xBC)
+
+/* CTRL_REG1 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
+#define HTS221TR_PD_BIT_NUM (7u)
+#define HTS221TR_BDU_BIT_NUM (2u)
+#define HTS221TR_ODR_BIT_NUM (0u)
+#define HTS221TR_ODR_MASK (0b00000011)
 
 /* AV_CONF entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
 #define HTS221TR_AVGT2_BIT_NUM (5u)
@@ -40,6 +50,10 @@ struct ht221tr_dev_s
     //struct sai_dev_s *sai_dev; /**< SAI device */
     uint8_t hw_adr; /**< hardware address of chip */
     //uint16_t reg[16]; /**<  */
+    int8_t (*read_sample) (struct ht221tr_dev_s *self, float_t *humidity, float_t *temperature);
+    // factory calibration, two points for each quantity (datasheet: "Interpreting humidity and temperature readings")
+    float_t h0_rh, h1_rh, t0_degc, t1_degc;
+    int16_t h0_t0_out, h1_t0_out, t0_out, t1_out;
 
     // TODO: Add function pointers
 };
@@ -48,6 +62,11 @@ int8_t ht221tr_writeReg(struct ht221tr_dev_s *self, uint8_t adr, uint16_t val);
 int8_t ht221tr_readReg(struct ht221tr_dev_s *self, uint8_t adr, uint8_t *val);
 
 int8_t ht221tr_whoami(struct ht221tr_dev_s *self);
+// checks the ID, reads the calibration and starts continuous conversion at 1 Hz
 int8_t ht221tr_init(struct ht221tr_dev_s *self);
+// humidity in %rH and temperature in degC from one burst of the four output registers
+// ENODATA if the calibration of init is missing or invalid, nothing is read then,
+// EIO and the other bus errors only come from the transfer
+int8_t ht221tr_read_sample(struct ht221tr_dev_s *self, float_t *humidity, float_t *temperature);
 
 #endif
\ No newline at end of file
@@ -9,16 +9,13 @@
 
 int8_t lis3mdl_writeReg(struct lis3mdl_dev_s *self, uint8_t regadr, uint16_t val)
 {
-    // uint8_t data[2];
-    // data[0]=((regadr&0x7F)<<1)+((val&0x0100)>>8); //left 7 bits are register adr, one data bit (MSB) right
-    // data[1]=val&0x00FF; //8 lower data bits
-    // return self->i2c_dev->i2c_master_transmit(self->i2c_dev, self->hw_adr, &data[0], 2, 0xFFFFFFFF);
-    return 0;
+    uint8_t data=val&0x00FF;
+    return self->i2c_dev->mem_write(self->i2c_dev, self->hw_adr, regadr, 1, &data, 1, I2C_TIMEOUT_MS);
 }
 
 int8_t lis3mdl_readReg(struct lis3mdl_dev_s *self, uint8_t adr, uint8_t *val)
 {
-    return self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr, adr, 1, val, 1, 0xFFFFFFFF);
+    return self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr, adr, 1, val, 1, I2C_TIMEOUT_MS);
 }
 
 int8_t lis3mdl_whoami(struct lis3mdl_dev_s *self)
@@ -29,7 +26,11 @@ int8_t lis3mdl_whoami(struct lis3mdl_dev_s *self)
     // val should be 0b00111101
     if(error)
     {
-        errno=EIO;
+        return -1; //errno from the bus
+    }
+    else if(val!=LIS3MDL_WHO_AM_I_VAL)
+    {
+        errno=ENODEV;
         return -1;
     }
     else
@@ -39,9 +40,33 @@ int8_t lis3mdl_whoami(struct lis3mdl_dev_s *self)
     }
 }
 
+int8_t lis3mdl_read_sample(struct lis3mdl_dev_s *self, float_t *mag, float_t *temperature)
+{
+    uint8_t buf[8]; //OUT_X_L .. OUT_Z_H, TEMP_OUT_L/H
+    if(self->i2c_dev->burst_read(self->i2c_dev, self->hw_adr, LIS3MDL_OUT_X_L, I2C_AUTOINC_ST,
+                                 buf, 8, I2C_TIMEOUT_MS))
+    {
+        return -1; //errno from the bus
+    }
+    for(int i=0; i<3; i++)
+    {
+        mag[i] = (int16_t)(buf[2*i] | (buf[2*i+1]<<8))/LIS3MDL_LSB_PER_GAUSS_4;
+    }
+    *temperature = (int16_t)(buf[6] | (buf[7]<<8))/8.0f + 25.0f;  //8 LSB/degC, 0 at 25 degC
+    errno=0;
+    return 0;
+}
+
 int8_t lis3mdl_init(struct lis3mdl_dev_s *self)
 {
     int8_t error=0;
+    self->read_sample = &lis3mdl_read_sample;
     error+=lis3mdl_whoami(self);
+    if(!error)
+        error+=lis3mdl_writeReg(self, LIS3MDL_CTRL_REG1, (1<<LIS3MDL_TEMP_EN_BIT_NUM) | (4<<LIS3MDL_DO_BIT_NUM)); //temperature on, 10 Hz
+    if(!error)
+        error+=lis3mdl_writeReg(self, LIS3MDL_CTRL_REG5, (1<<LIS3MDL_BDU_BIT_NUM)); //block data update
+    if(!error)
+        error+=lis3mdl_writeReg(self, LIS3MDL_CTRL_REG3, 0); //continuous conversion
     return error;
-}
\ No newline at end of file
+}
@@ -9,10 +9,36 @@
 #define LIS3MDL_H
 
 #include <stdint.h>
+#include <math.h>
 #include "i2c_hal.h"
 
 /* Register addresses */
 #define LIS3MDL_WHO_AM_I (0x0F)
+#define LIS3MDL_CTRL_REG1 (0x20)
+#define LIS3MDL_CTRL_REG2 (0x21)
+#define LIS3MDL_CTRL_REG3 (0x22)
+#define LIS3MDL_CTRL_REG4 (0x23)
+#define LIS3MDL_CTRL_REG5 (0x24)
+#define LIS3MDL_STATUS_REG (0x27)
+#define LIS3MDL_OUT_X_L (0x28)
+#define LIS3MDL_TEMP_OUT_L (0x2E)
+#define LIS3MDL_WHO_AM_I_VAL (0x3D)
+
+/* CTRL_REG1 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
+#define LIS3MDL_TEMP_EN_BIT_NUM (7u)
+#define LIS3MDL_OM_BIT_NUM (5u)
+#define LIS3MDL_OM_MASK (0b01100000)
+#define LIS3MDL_DO_BIT_NUM (2u)
+#define LIS3MDL_DO_MASK (0b00011100)
+
+/* CTRL_REG3 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
+#define LIS3MDL_MD_BIT_NUM (0u)
+#define LIS3MDL_MD_MASK (0b00000011)
+
+/* CTRL_REG5 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
+#define LIS3MDL_BDU_BIT_NUM (6u)
+
+#define LIS3MDL_LSB_PER_GAUSS_4 (6842.0f) //full scale +-4 gauss (reset value of FS)
 
 
 struct lis3mdl_dev_s
@@ -21,6 +47,7 @@ struct lis3mdl_dev_s
     //struct sai_dev_s *sai_dev; /**< SAI device */
     uint8_t hw_adr; /**< hardware address of chip */
     //uint16_t reg[16]; /**<  */
+    int8_t (*read_sample) (struct lis3mdl_dev_s *self, float_t *mag, float_t *temperature);
 
     // TODO: Add function pointers
 };
@@ -29,6 +56,9 @@ int8_t lis3mdl_writeReg(struct lis3mdl_dev_s *self, uint8_t adr, uint16_t val);
 int8_t lis3mdl_readReg(struct lis3mdl_dev_s *self, uint8_t adr, uint8_t *val);
 
 int8_t lis3mdl_whoami(struct lis3mdl_dev_s *self);
+// checks the ID and starts continuous conversion at 10 Hz, +-4 gauss
 int8_t lis3mdl_init(struct lis3mdl_dev_s *self);
+// mag[0..2] (X, Y, Z) in gauss and temperature in degC from one burst of the eight output registers
+int8_t lis3mdl_read_sample(struct lis3mdl_dev_s *self, float_t *mag, float_t *temperature);
 
 #endif
\ No newline at end of file
@@ -9,16 +9,13 @@
 
 int8_t lps22hh_writeReg(struct lps22hh_dev_s *self, uint8_t regadr, uint16_t val)
 {
-    // uint8_t data[2];
-    // data[0]=((regadr&0x7F)<<1)+((val&0x0100)>>8); //left 7 bits are register adr, one data bit (MSB) right
-    // data[1]=val&0x00FF; //8 lower data bits
-    // return self->i2c_dev->i2c_master_transmit(self->i2c_dev, self->hw_adr, &data[0], 2, 0xFFFFFFFF);
-    return 0;
+    uint8_t data=val&0x00FF;
+    return self->i2c_dev->mem_write(self->i2c_dev, self->hw_adr, regadr, 1, &data, 1, I2C_TIMEOUT_MS);
 }
 
 int8_t lps22hh_readReg(struct lps22hh_dev_s *self, uint8_t adr, uint8_t *val)
 {
-    return self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr, adr, 1, val, 1, 0xFFFFFFFF);
+    return self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr, adr, 1, val, 1, I2C_TIMEOUT_MS);
 }
 
 int8_t lps22hh_whoami(struct lps22hh_dev_s *self)
@@ -29,7 +26,11 @@ int8_t lps22hh_whoami(struct lps22hh_dev_s *self)
     // val should be 0b10110011
     if(error)
     {
-        errno=EIO;
+        return -1; //errno from the bus
+    }
+    else if(val!=LPS22HH_WHO_AM_I_VAL)
+    {
+        errno=ENODEV;
         return -1;
     }
     else
@@ -39,9 +40,31 @@ int8_t lps22hh_whoami(struct lps22hh_dev_s *self)
     }
 }
 
+int8_t lps22hh_read_sample(struct lps22hh_dev_s *self, float_t *pressure, float_t *temperature)
+{
+    uint8_t buf[5]; //PRESS_OUT_XL/L/H, TEMP_OUT_L/H
+    // the address increments by IF_ADD_INC (CTRL_REG2), not by a sub-address bit
+    if(self->i2c_dev->burst_read(self->i2c_dev, self->hw_adr, LPS22HH_PRESS_OUT_XL, I2C_AUTOINC_NONE,
+                                 buf, 5, I2C_TIMEOUT_MS))
+    {
+        return -1; //errno from the bus
+    }
+    int32_t p_out = (int32_t)((uint32_t)buf[0]<<8 | (uint32_t)buf[1]<<16 | (uint32_t)buf[2]<<24) >> 8; //sign extended 24 bit
+    int16_t t_out = (int16_t)(buf[3] | (buf[4]<<8));
+    *pressure = p_out/4096.0f;  //4096 LSB/hPa
+    *temperature = t_out/100.0f;  //100 LSB/degC
+    errno=0;
+    return 0;
+}
+
 int8_t lps22hh_init(struct lps22hh_dev_s *self)
 {
     int8_t error=0;
+    self->read_sample = &lps22hh_read_sample;
     error+=lps22hh_whoami(self);
+    if(!error)
+        error+=lps22hh_writeReg(self, LPS22HH_CTRL_REG2, (1<<LPS22HH_IF_ADD_INC_BIT_NUM)); //reset value, made explicit for burst reads
+    if(!error)
+        error+=lps22hh_writeReg(self, LPS22HH_CTRL_REG1, (1<<LPS22HH_ODR_BIT_NUM) | (1<<LPS22HH_BDU_BIT_NUM)); //1 Hz, block data update
     return error;
-}
\ No newline at end of file
+}
@@ -9,10 +9,28 @@
 #define LPS22HH_H
 
 #include <stdint.h>
+#include <math.h>
 #include "i2c_hal.h"
 
 /* Register addresses */
 #define LPS22HH_WHO_AM_I (0x0F)
+#define LPS22HH_CTRL_REG1 (0x10)
+#define LPS22HH_CTRL_REG2 (0x11)
+#define LPS22HH_STATUS (0x27)
+#define LPS22HH_PRESS_OUT_XL (0x28)
+#define LPS22HH_PRESS_OUT_L (0x29)
+#define LPS22HH_PRESS_OUT_H (0x2A)
+#define LPS22HH_TEMP_OUT_L (0x2B)
+#define LPS22HH_TEMP_OUT_H (0x2C)
+#define LPS22HH_WHO_AM_I_VAL (0xB3)
+
+/* CTRL_REG1 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
+#define LPS22HH_ODR_BIT_NUM (4u)
+#define LPS22HH_ODR_MASK (0b01110000)
+#define LPS22HH_BDU_BIT_NUM (1u)
+
+/* CTRL_REG2 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
+#define LPS22HH_IF_ADD_INC_BIT_NUM (4u)
 
 
 struct lps22hh_dev_s
@@ -21,6 +39,7 @@ struct lps22hh_dev_s
     //struct sai_dev_s *sai_dev; /**< SAI device */
     uint8_t hw_adr; /**< hardware address of chip */
     //uint16_t reg[16]; /**<  */
+    int8_t (*read_sample) (struct lps22hh_dev_s *self, float_t *pressure, float_t *temperature);
 
     // TODO: Add function pointers
 };
@@ -29,6 +48,9 @@ int8_t lps22hh_writeReg(struct lps22hh_dev_s *self, uint8_t adr, uint16_t val);
 int8_t lps22hh_readReg(struct lps22hh_dev_s *self, uint8_t adr, uint8_t *val);
 
 int8_t lps22hh_whoami(struct lps22hh_dev_s *self);
+// checks the ID and starts continuous conversion at 1 Hz
 int8_t lps22hh_init(struct lps22hh_dev_s *self);
+// pressure in hPa and temperature in degC from one burst of the five output registers
+int8_t lps22hh_read_sample(struct lps22hh_dev_s *self, float_t *pressure, float_t *temperature);
 
 #endif
\ No newline at end of file
@@ -8,30 +8,65 @@
 #include <errno.h>
 #include <math.h>
 
-int8_t tca9534_writeReg(struct tca9534_dev_s *self, uint8_t adr, uint8_t val)
+// input port changes with the pins, the others only by writes
+static const uint8_t tca9534_policy[TCA9534_NUM_REGS] = {
+    REGMAP_VOLATILE, REGMAP_CACHED, REGMAP_CACHED, REGMAP_CACHED
+};
+
+static int8_t tca9534_regmap_write(struct regmap_s *map, uint16_t reg, uint16_t val16)
+{
+    struct tca9534_dev_s *self = (struct tca9534_dev_s *)map->ctx;
+    uint8_t val = (uint8_t)val16;
+    // pin updates are control writes, they go ahead of measurements on the bus
+    struct i2c_xfer_s xfer = {
+        .op = I2C_XFER_MEM_WRITE, .dev_address = self->hw_adr, .mem_address = reg,
+        .mem_add_size = I2C_MEMADD_SIZE_8BIT, .data = &val, .size = 1, .prio = I2C_PRIO_URGENT
+    };
+    return self->i2c_dev->transfer(self->i2c_dev, &xfer, I2C_TIMEOUT_MS);
+}
+
+static int8_t tca9534_regmap_read(struct regmap_s *map, uint16_t reg, uint16_t *val16)
 {
-    int8_t result;
-    result = self->i2c_dev->i2c_mem_write(self->i2c_dev, self->hw_adr, adr, 1, &val, 1, 0xFFFFFFFF);    
+    struct tca9534_dev_s *self = (struct tca9534_dev_s *)map->ctx;
+    uint8_t val;
+    int8_t result = self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr, reg, 1, &val, 1, I2C_TIMEOUT_MS);
+    *val16 = val;
     return result;
 }
 
+int8_t tca9534_writeReg(struct tca9534_dev_s *self, uint8_t adr, uint8_t val)
+{
+    return regmap_write(&self->map, adr, val);
+}
+
 int8_t tca9534_readReg(struct tca9534_dev_s *self, uint8_t adr, uint8_t *val)
 {
-    int8_t result;
-    result = self->i2c_dev->i2c_mem_read(self->i2c_dev, self->hw_adr, adr, 1, val, 1, 0xFFFFFFFF);    
+    uint16_t val16;
+    int8_t result = regmap_read(&self->map, adr, &val16);
+    *val = (uint8_t)val16;
     return result;
 }
 
-// int8_t i2c_mem_read(struct i2c_dev_s *self, uint16_t DevAddress,
-//                             uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
-
 int8_t tca9534_set_port(struct tca9534_dev_s *self, uint8_t val)
 {
     int8_t error = tca9534_writeReg(self, TCA9534_OUTPORT_REG_ADR, val);
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
+    }
+    else
+    {
+        errno=0;
+        return 0;
+    }
+}
+
+int8_t tca9534_update_port(struct tca9534_dev_s *self, uint8_t mask, uint8_t val)
+{
+    int8_t error = regmap_update_bits(&self->map, TCA9534_OUTPORT_REG_ADR, mask, val);
+    if(error)
+    {
+        return -1; //errno from the bus
     }
     else
     {
@@ -45,8 +80,7 @@ int8_t tca9534_get_port(struct tca9534_dev_s *self, uint8_t *val)
     int8_t error = tca9534_readReg(self, TCA9534_INPORT_REG_ADR, val);
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -57,11 +91,10 @@ int8_t tca9534_get_port(struct tca9534_dev_s *self, uint8_t *val)
 
 int8_t tca9534_set_output(struct tca9534_dev_s *self, uint8_t mask)
 {
-    int8_t error = tca9534_writeReg(self, TCA9534_CONF_REG_ADR, ~mask);
+    int8_t error = tca9534_writeReg(self, TCA9534_CONF_REG_ADR, (uint8_t)~mask);
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
@@ -72,15 +105,19 @@ int8_t tca9534_set_output(struct tca9534_dev_s *self, uint8_t mask)
 
 int8_t tca9534_init(struct tca9534_dev_s *self)
 {
+    regmap_init(&self->map, self->reg, self->reg_dirty, self->reg_valid, TCA9534_NUM_REGS, tca9534_policy);
+    self->map.ctx = self;
+    self->map.write_reg = &tca9534_regmap_write;
+    self->map.read_reg = &tca9534_regmap_read;
+
     int8_t error = tca9534_writeReg(self, TCA9534_POLINV_REG_ADR, 0); //disable polarity inversion
     if(error)
     {
-        errno=EIO;
-        return -1;
+        return -1; //errno from the bus
     }
     else
     {
         errno=0;
         return 0;
     }
-}
\ No newline at end of file
+}
@@ -9,28 +9,38 @@
 
 #include <stdint.h>
 #include "i2c_hal.h"
+#include "regmap.h"
 
 /* Register addresses */
 #define TCA9534_INPORT_REG_ADR (0x0)
 #define TCA9534_OUTPORT_REG_ADR (0x1)
 #define TCA9534_POLINV_REG_ADR (0x2)
 #define TCA9534_CONF_REG_ADR (0x3)
+#define TCA9534_NUM_REGS (4)
 
 struct tca9534_dev_s
 {
     struct i2c_dev_s *i2c_dev; /**< I2C device */
     uint8_t hw_adr; /**<  */
-    //uint8_t reg0; /**<  */
+    struct regmap_s map; /**< shadow of the registers, output writes are skipped if nothing changes */
+    uint16_t reg[TCA9534_NUM_REGS];
+    uint32_t reg_dirty[REGMAP_BITMAP_WORDS(TCA9534_NUM_REGS)];
+    uint32_t reg_valid[REGMAP_BITMAP_WORDS(TCA9534_NUM_REGS)];
 
     // TODO: Add function pointers
 };
 
 int8_t tca9534_writeReg(struct tca9534_dev_s *self, uint8_t adr, uint8_t val);
-//int8_t tca9534_readReg(struct tca9534_dev_s *self, uint8_t adr, uint8_t val);
+int8_t tca9534_readReg(struct tca9534_dev_s *self, uint8_t adr, uint8_t *val);
 
+// i2c_dev and hw_adr have to be set before
 int8_t tca9534_init(struct tca9534_dev_s *self);
 int8_t tca9534_set_port(struct tca9534_dev_s *self, uint8_t val);
+// changes only the pins in mask, the output port is read once to fill the
+// cache (the chip may have kept its outputs over an MCU reset), later calls
+// do not read it back
+int8_t tca9534_update_port(struct tca9534_dev_s *self, uint8_t mask, uint8_t val);
 int8_t tca9534_set_output(struct tca9534_dev_s *self, uint8_t mask);
 int8_t tca9534_get_port(struct tca9534_dev_s *self, uint8_t *val);
 
-#endif
\ No newline at end of file
+#endif
@@ -44,7 +44,7 @@ void isl28023_init(struct isl28023_dev_s *self, struct i2c_dev_s *i2c_dev, uint8
 int8_t isl28023_read_ID(struct isl28023_dev_s *self, uint8_t *buf)
 {
 	return self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr,
-								   ISL28023_REG_IC_DEVICE_ID, I2C_MEMADD_SIZE_8BIT, buf, 9, HAL_MAX_DELAY);
+								   ISL28023_REG_IC_DEVICE_ID, I2C_MEMADD_SIZE_8BIT, buf, 9, I2C_TIMEOUT_MS);
 }
 
 int8_t isl28023_read_vshunt(struct isl28023_dev_s *self, float_t *data)
@@ -52,7 +52,7 @@ int8_t isl28023_read_vshunt(struct isl28023_dev_s *self, float_t *data)
 	// datasheet p. 35
 	uint8_t buf[3];
 	int8_t error = self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr,
-								   ISL28023_REG_READ_VSHUNT_OUT, I2C_MEMADD_SIZE_8BIT, &buf[0], 3, HAL_MAX_DELAY);
+								   ISL28023_REG_READ_VSHUNT_OUT, I2C_MEMADD_SIZE_8BIT, &buf[0], 3, I2C_TIMEOUT_MS);
 	int16_t sign = (buf[1] & 0b10000000)>>7;  //sign bit
 	int16_t reg_val = ((buf[1] & 0b01111111)<<8) + buf[2] - (sign*(1<<15));  // integer result
 	*data = reg_val * self->vshunt_lsb;  // final result
@@ -64,7 +64,7 @@ int8_t isl28023_read_vout(struct isl28023_dev_s *self, float_t *data)
 	// datasheet p. 35
 	uint8_t buf[3];
 	int8_t error = self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr,
-								   ISL28023_REG_READ_VOUT, I2C_MEMADD_SIZE_8BIT, &buf[0], 3, HAL_MAX_DELAY);
+								   ISL28023_REG_READ_VOUT, I2C_MEMADD_SIZE_8BIT, &buf[0], 3, I2C_TIMEOUT_MS);
 	int16_t reg_val = ((buf[1])<<8) + buf[2];  // integer result
 	*data = reg_val * self->vbus_lsb;  // final result
 	return error;
@@ -75,7 +75,7 @@ int8_t isl28023_read_iout(struct isl28023_dev_s *self, float_t *data)
 	// datasheet p. 35
 	uint8_t buf[3];
 	int8_t error = self->i2c_dev->mem_read(self->i2c_dev, self->hw_adr,
-								   ISL28023_REG_READ_IOUT, I2C_MEMADD_SIZE_8BIT, &buf[0], 3, HAL_MAX_DELAY);
+								   ISL28023_REG_READ_IOUT, I2C_MEMADD_SIZE_8BIT, &buf[0], 3, I2C_TIMEOUT_MS);
 	int16_t sign = (buf[1] & 0b10000000)>>7;  //sign bit
 	int16_t reg_val = ((buf[1] & 0b01111111)<<8) + buf[2] - (sign*(1<<15));  // integer result
 	*data = reg_val * self->current_lsb;  // final result
@@ -176,7 +176,16 @@ DPM_STAT dpm_write(uint8_t devAddr, uint8_t regAddr, uint8_t *pData, uint8_t siz
 		WsDpm.busStat = DPM_READY;
 		return DPM_ERROR;
 	}
-	while (HAL_I2C_GetState(WsDpm.DpmI2cHandle) != HAL_I2C_STATE_READY) {}
+	struct deadline_s d;
+	deadline_start(&d, I2C_TIMEOUT_MS);
+	while (HAL_I2C_GetState(WsDpm.DpmI2cHandle) != HAL_I2C_STATE_READY)
+	{
+		if (deadline_expired(&d))
+		{
+			WsDpm.busStat = DPM_READY;
+			return DPM_TIMEOUT;
+		}
+	}
 
 	WsDpm.busStat = DPM_READY;
 	return DPM_OK;
@@ -123,7 +123,8 @@ typedef enum {
 	DPM_BUSY,
 	DPM_READY,
 	DPM_ERROR,
-	DPM_BUFFER_FULL
+	DPM_BUFFER_FULL,
+	DPM_TIMEOUT
 } DPM_STAT;
 
 typedef struct DPM_BUF
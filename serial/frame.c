@@ -0,0 +1,184 @@
+// Copyright 2019-2021, Philipp Peterseil,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+#include "frame.h"
+#include <errno.h>
+#include <string.h>
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), one nibble per table lookup
+static const uint16_t frame_crc_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t *data, uint16_t len){
+    while(len--){
+        crc = (crc << 4) ^ frame_crc_table[(crc >> 12) ^ (*data >> 4)];
+        crc = (crc << 4) ^ frame_crc_table[(crc >> 12) ^ (*data & 0x0F)];
+        data++;
+    }
+    return crc;
+}
+
+// streaming COBS encoder, code_idx is the position of the code byte of the open block
+struct frame_cobs_s {
+    uint8_t *enc;
+    uint16_t pos;
+    uint16_t code_idx;
+    uint8_t code;
+    uint16_t crc;
+};
+
+static void frame_cobs_put(struct frame_cobs_s *c, uint8_t byte){
+    c->crc = frame_crc16(c->crc, &byte, 1);
+    if(byte){
+        c->enc[c->pos++] = byte;
+        c->code++;
+    }
+    if(!byte || c->code == 0xFF){
+        c->enc[c->code_idx] = c->code;
+        c->code_idx = c->pos++;
+        c->code = 1;
+    }
+}
+
+static void frame_cobs_put_buf(struct frame_cobs_s *c, const uint8_t *buf, uint16_t len){
+    while(len--){
+        frame_cobs_put(c, *buf++);
+    }
+}
+
+uint16_t frame_encode(uint8_t *enc, uint16_t seq, uint8_t type, const void *hdr, uint16_t hdr_len,
+                      const void *data, uint16_t data_len){
+    if(!hdr) hdr_len = 0;
+    if(!data) data_len = 0;
+    if((uint32_t)hdr_len + data_len > FRAME_MAX_PAYLOAD) return 0;
+
+    struct frame_cobs_s c = {.enc = enc, .pos = 1, .code_idx = 0, .code = 1, .crc = 0xFFFF};
+    frame_cobs_put(&c, type);
+    frame_cobs_put(&c, seq & 0xFF);
+    frame_cobs_put(&c, seq >> 8);
+    frame_cobs_put_buf(&c, (const uint8_t*)hdr, hdr_len);
+    frame_cobs_put_buf(&c, (const uint8_t*)data, data_len);
+    uint16_t crc = c.crc;
+    frame_cobs_put(&c, crc & 0xFF);
+    frame_cobs_put(&c, crc >> 8);
+    enc[c.code_idx] = c.code;
+    enc[c.pos++] = 0x00;
+    return c.pos;
+}
+
+void frame_decoder_init(struct frame_decoder_s *dec){
+    memset(dec, 0, sizeof(*dec));
+}
+
+static int8_t frame_decoder_finish(struct frame_decoder_s *dec, struct frame_s *frame){
+    if(dec->overflow || dec->remaining || dec->len < FRAME_HEADER_LEN + FRAME_CRC_LEN){
+        dec->bad_frames++;
+        return -1;
+    }
+    uint16_t n = dec->len - FRAME_CRC_LEN;
+    uint16_t crc = dec->buf[n] | (dec->buf[n + 1] << 8);
+    if(frame_crc16(0xFFFF, dec->buf, n) != crc){
+        dec->crc_errors++;
+        return -1;
+    }
+    frame->type = dec->buf[0];
+    frame->seq = dec->buf[1] | (dec->buf[2] << 8);
+    frame->payload = &dec->buf[FRAME_HEADER_LEN];
+    frame->len = n - FRAME_HEADER_LEN;
+    if(dec->synced){
+        dec->lost += (uint16_t)(frame->seq - dec->next_seq);
+    }
+    dec->next_seq = frame->seq + 1;
+    dec->synced = 1;
+    dec->frames++;
+    return 1;
+}
+
+int8_t frame_decode(struct frame_decoder_s *dec, uint8_t byte, struct frame_s *frame){
+    int8_t result = 0;
+    if(!byte){
+        // delimiter, an empty frame is just a resync
+        if(dec->len || dec->remaining || dec->overflow){
+            result = frame_decoder_finish(dec, frame);
+        }
+        dec->len = 0;
+        dec->remaining = 0;
+        dec->zero_pending = 0;
+        dec->overflow = 0;
+        return result;
+    }
+    if(dec->overflow){
+        return 0;
+    }
+    if(!dec->remaining){
+        // code byte, the zero of the previous block is only real if data follows
+        if(dec->zero_pending){
+            if(dec->len >= FRAME_MAX_RAW){
+                dec->overflow = 1;
+                return 0;
+            }
+            dec->buf[dec->len++] = 0x00;
+        }
+        dec->remaining = byte - 1;
+        dec->zero_pending = (byte != 0xFF);
+        return 0;
+    }
+    if(dec->len >= FRAME_MAX_RAW){
+        dec->overflow = 1;
+        return 0;
+    }
+    dec->buf[dec->len++] = byte;
+    dec->remaining--;
+    return 0;
+}
+
+int8_t frame_send(struct frame_dev_s *self, uint8_t type, const void *hdr, uint16_t hdr_len,
+                  const void *data, uint16_t data_len){
+    uint16_t n = frame_encode(self->enc, self->tx_seq, type, hdr, hdr_len, data, data_len);
+    if(!n){
+        errno = EMSGSIZE;
+        return -1;
+    }
+    // a partially sent frame would only be dropped by the receiver
+    if(self->serial->available_for_write(self->serial) < n){
+        errno = EAGAIN;
+        return -1;
+    }
+    if(self->serial->write(self->serial, self->enc, n) != n){
+        errno = EIO;
+        return -1;
+    }
+    self->tx_seq++;
+    errno = 0;
+    return 0;
+}
+
+int8_t frame_poll(struct frame_dev_s *self, struct frame_s *frame){
+    while(1){
+        if(self->rx_pos >= self->rx_len){
+            int n = self->serial->read(self->serial, self->rx_chunk, sizeof(self->rx_chunk));
+            if(n <= 0) return 0;
+            self->rx_pos = 0;
+            self->rx_len = n;
+        }
+        while(self->rx_pos < self->rx_len){
+            if(frame_decode(&self->dec, self->rx_chunk[self->rx_pos++], frame) == 1){
+                return 1;
+            }
+        }
+    }
+}
+
+void frame_init(struct frame_dev_s *self, struct serial_dev_s *serial){
+    self->serial = serial;
+    self->send = &frame_send;
+    self->poll = &frame_poll;
+    self->tx_seq = 0;
+    self->rx_pos = 0;
+    self->rx_len = 0;
+    frame_decoder_init(&self->dec);
+}
@@ -0,0 +1,116 @@
+// Copyright 2019-2021, Philipp Peterseil,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <stdint.h>
+#include "serial.h"
+
+// Binary framing on top of any serial_dev_s.
+// A frame before encoding is
+//     type (1) | seq (2) | payload (0..FRAME_MAX_PAYLOAD) | crc (2)
+// with all multi-byte values little endian and crc being CRC-16/CCITT-FALSE
+// over type, seq and payload. It is COBS encoded, so it contains no 0x00, and
+// terminated by a single 0x00 delimiter. The receiver detects lost frames by
+// gaps in seq. The decoder only depends on the C library and builds on the host.
+
+#ifndef FRAME_MAX_PAYLOAD
+#define FRAME_MAX_PAYLOAD (512)
+#endif
+#define FRAME_HEADER_LEN (3)
+#define FRAME_CRC_LEN (2)
+#define FRAME_MAX_RAW (FRAME_HEADER_LEN + FRAME_MAX_PAYLOAD + FRAME_CRC_LEN)
+// one COBS code byte per started block of 254 bytes plus the delimiter
+#define FRAME_MAX_ENCODED (FRAME_MAX_RAW + FRAME_MAX_RAW / 254 + 2)
+
+enum frame_type
+{
+    FRAME_TYPE_TEXT = 0x01,      //plain text, e.g. console output
+    FRAME_TYPE_ADC_BLOCK = 0x10, //struct frame_adc_block_s followed by the samples
+    FRAME_TYPE_POWER = 0x11,     //struct frame_power_s
+    FRAME_TYPE_MUX_DATA = 0x20,  //channel data, see mux.h
+    FRAME_TYPE_MUX_CREDIT = 0x21,//channel flow control, see mux.h
+    FRAME_TYPE_USER = 0x80       //application defined types start here
+};
+
+// typed record headers, little endian on the wire
+struct frame_adc_block_s
+{
+    uint32_t timestamp; //sample clock count of the first sample
+    uint8_t channel;
+    uint8_t sample_bytes; //size of one sample: 2 or 4
+    uint16_t nsamp;
+} __attribute__((packed));
+
+struct frame_power_s
+{
+    uint32_t timestamp; //ms
+    uint8_t channel;
+    float vbus;   //V
+    float vshunt; //V
+    float current;//A
+} __attribute__((packed));
+
+// a received frame, payload points into the decoder buffer and is valid until
+// the next byte is decoded
+struct frame_s
+{
+    uint8_t type;
+    uint16_t seq;
+    const uint8_t *payload;
+    uint16_t len;
+};
+
+struct frame_decoder_s
+{
+    uint8_t buf[FRAME_MAX_RAW];
+    uint16_t len;        //decoded bytes of the current frame
+    uint8_t remaining;   //bytes left in the current COBS block
+    uint8_t zero_pending;//current block ends with an implicit 0x00
+    uint8_t overflow;    //current frame is too long, drop it
+    uint8_t synced;      //a valid frame was seen, next_seq is valid
+    uint16_t next_seq;
+    uint32_t frames;     //valid frames
+    uint32_t crc_errors; //frames dropped because of a wrong crc
+    uint32_t bad_frames; //frames dropped because of length or COBS errors
+    uint32_t lost;       //frames missing according to seq
+};
+
+struct frame_dev_s
+{
+    struct serial_dev_s *serial; /**< underlying link, UART or VCP */
+    int8_t (*send) (struct frame_dev_s *self, uint8_t type, const void *hdr, uint16_t hdr_len,
+                    const void *data, uint16_t data_len);
+    int8_t (*poll) (struct frame_dev_s *self, struct frame_s *frame);
+    uint16_t tx_seq;
+    uint8_t enc[FRAME_MAX_ENCODED];
+    struct frame_decoder_s dec;
+    uint8_t rx_chunk[32];
+    uint8_t rx_pos, rx_len;
+};
+
+void frame_init(struct frame_dev_s *self, struct serial_dev_s *serial);
+
+// Sends one frame, payload is hdr followed by data (either may be NULL).
+// The frame is only queued if the link can take all of it, otherwise errno is
+// EAGAIN and nothing is sent.
+int8_t frame_send(struct frame_dev_s *self, uint8_t type, const void *hdr, uint16_t hdr_len,
+                  const void *data, uint16_t data_len);
+// Reads what the link has available, returns 1 and fills frame once a complete
+// valid frame was received, 0 otherwise.
+int8_t frame_poll(struct frame_dev_s *self, struct frame_s *frame);
+
+// encoder/decoder without a serial_dev_s, e.g. for host side tools
+uint16_t frame_encode(uint8_t *enc, uint16_t seq, uint8_t type, const void *hdr, uint16_t hdr_len,
+                      const void *data, uint16_t data_len);
+void frame_decoder_init(struct frame_decoder_s *dec);
+// feeds one received byte, returns 1 if it completed a valid frame, -1 if it
+// completed an invalid one and 0 otherwise
+int8_t frame_decode(struct frame_decoder_s *dec, uint8_t byte, struct frame_s *frame);
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t *data, uint16_t len);
+
+#endif
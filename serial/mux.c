@@ -0,0 +1,247 @@
+// Copyright 2019-2021, Philipp Peterseil,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+#include "mux.h"
+#include <errno.h>
+#include <string.h>
+#include <stm32h7xx_hal.h>
+
+static struct mux_channel_s* mux_find(struct mux_dev_s* self, uint8_t id){
+    for(int i = 0; i < self->nch; i++){
+        if(self->ch[i]->id == id) return self->ch[i];
+    }
+    return NULL;
+}
+
+// everything before this offset was read by the user or skipped
+static uint32_t mux_rx_consumed(struct mux_channel_s* ch){
+    return ch->rx_offset - rb_count((struct rb_handle_s*)ch->dev.rxbuffer);
+}
+
+static uint16_t mux_tx_credit(struct mux_channel_s* ch){
+    if(!ch->tx_credit_valid) return 0;
+    uint32_t outstanding = ch->tx_offset - ch->tx_acked;
+    return (outstanding >= ch->tx_window) ? 0 : ch->tx_window - outstanding;
+}
+
+static int8_t mux_send_credit(struct mux_dev_s* self, struct mux_channel_s* ch){
+    struct mux_credit_s c = {
+        .channel = ch->id,
+        .window = ((struct rb_handle_s*)ch->dev.rxbuffer)->size,
+        .consumed = mux_rx_consumed(ch)
+    };
+    if(frame_send(&self->frame, FRAME_TYPE_MUX_CREDIT, &c, sizeof(c), NULL, 0) < 0) return -1;
+    ch->rx_reported = c.consumed;
+    ch->rx_report_tick = HAL_GetTick();
+    return 0;
+}
+
+// credit goes out once a quarter of the window was read, and periodically
+static int8_t mux_send_credits(struct mux_dev_s* self){
+    uint32_t now = HAL_GetTick();
+    for(int i = 0; i < self->nch; i++){
+        struct mux_channel_s* ch = self->ch[i];
+        uint16_t window = ((struct rb_handle_s*)ch->dev.rxbuffer)->size;
+        if(mux_rx_consumed(ch) - ch->rx_reported >= window / 4u ||
+           now - ch->rx_report_tick >= MUX_CREDIT_INTERVAL_MS){
+            if(mux_send_credit(self, ch) < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+// sends one chunk straight from the tx ring, returns 1 if sent, -1 if the link is full
+static int8_t mux_send_chunk(struct mux_dev_s* self, struct mux_channel_s* ch){
+    struct rb_handle_s* tx = (struct rb_handle_s*)ch->dev.txbuffer;
+    char* span;
+    uint16_t n = rb_peek_contiguous(tx, &span);
+    uint16_t credit = mux_tx_credit(ch);
+    if(n > credit) n = credit;
+    if(n > MUX_CHUNK) n = MUX_CHUNK;
+    if(!n) return 0;
+
+    struct mux_data_hdr_s hdr = {.channel = ch->id, .offset = ch->tx_offset};
+    if(frame_send(&self->frame, FRAME_TYPE_MUX_DATA, &hdr, sizeof(hdr), span, n) < 0) return -1;
+    rb_consume(tx, n);
+    ch->tx_offset += n;
+    return 1;
+}
+
+// sends credit and then data chunks by priority until the link or the credit is exhausted
+static void mux_pump(struct mux_dev_s* self){
+    if(self->busy) return;
+    self->busy = 1;
+    if(mux_send_credits(self) == 0){
+        while(1){
+            struct mux_channel_s* best = NULL;
+            uint8_t best_idx = 0;
+            // start after the channel that sent last, so equal priorities take turns
+            for(int k = 1; k <= self->nch; k++){
+                uint8_t i = (self->rr + k) % self->nch;
+                struct mux_channel_s* ch = self->ch[i];
+                if(!rb_count((struct rb_handle_s*)ch->dev.txbuffer) || !mux_tx_credit(ch)) continue;
+                if(!best || ch->priority < best->priority){
+                    best = ch;
+                    best_idx = i;
+                }
+            }
+            if(!best || mux_send_chunk(self, best) <= 0) break;
+            self->rr = best_idx;
+        }
+    }
+    self->busy = 0;
+}
+
+static void mux_receive_data(struct mux_dev_s* self, const struct frame_s* f){
+    struct mux_data_hdr_s hdr;
+    if(f->len < sizeof(hdr)) return;
+    memcpy(&hdr, f->payload, sizeof(hdr));
+    struct mux_channel_s* ch = mux_find(self, hdr.channel);
+    if(!ch) return;
+
+    const uint8_t* data = f->payload + sizeof(hdr);
+    uint16_t n = f->len - sizeof(hdr);
+    int32_t gap = (int32_t)(hdr.offset - ch->rx_offset);
+    if(gap > 0){
+        // frames were lost, skip their data so the sender gets the credit back
+        ch->rx_lost += gap;
+        ch->rx_offset = hdr.offset;
+    }
+    else if(gap < 0){
+        // repeated data, keep only what is new
+        if((uint32_t)-gap >= n) return;
+        data += -gap;
+        n -= -gap;
+    }
+    uint16_t written = rb_write((struct rb_handle_s*)ch->dev.rxbuffer, (const char*)data, n);
+    // only a peer ignoring the credit can overflow the ring
+    ch->rx_lost += n - written;
+    ch->rx_offset += n;
+}
+
+static void mux_receive_credit(struct mux_dev_s* self, const struct frame_s* f){
+    struct mux_credit_s c;
+    if(f->len < sizeof(c)) return;
+    memcpy(&c, f->payload, sizeof(c));
+    struct mux_channel_s* ch = mux_find(self, c.channel);
+    if(!ch) return;
+
+    if(!ch->tx_credit_valid || (int32_t)(c.consumed - ch->tx_acked) > 0){
+        ch->tx_acked = c.consumed;
+    }
+    // the peer is ahead after we restarted, continue at its offset
+    if((int32_t)(ch->tx_acked - ch->tx_offset) > 0){
+        ch->tx_offset = ch->tx_acked;
+    }
+    ch->tx_window = c.window;
+    ch->tx_credit_valid = 1;
+}
+
+void mux_service(struct mux_dev_s* self){
+    struct frame_s f;
+    while(frame_poll(&self->frame, &f) == 1){
+        if(f.type == FRAME_TYPE_MUX_DATA){
+            mux_receive_data(self, &f);
+        }
+        else if(f.type == FRAME_TYPE_MUX_CREDIT){
+            mux_receive_credit(self, &f);
+        }
+        else if(self->frame_cb){
+            self->frame_cb(self, &f);
+        }
+    }
+    mux_pump(self);
+}
+
+
+//// serial_dev_s of a channel, handle is the struct mux_channel_s
+
+static int mux_dev_read(struct serial_dev_s* s, void* pBuffer, int size){
+    if(size <= 0) return 0;
+    return rb_read((struct rb_handle_s*)s->rxbuffer, (char*)pBuffer, (uint16_t)(size > 0xFFFF ? 0xFFFF : size));
+}
+
+static int mux_dev_writev(struct serial_dev_s* s, const struct serial_iovec_s* iov, int iovcnt){
+    struct mux_channel_s* ch = (struct mux_channel_s*)s->handle;
+    int done = 0;
+    for(int i = 0; i < iovcnt; i++){
+        if(iov[i].len <= 0) continue;
+        uint16_t n = rb_write((struct rb_handle_s*)s->txbuffer, (const char*)iov[i].base, (uint16_t)(iov[i].len > 0xFFFF ? 0xFFFF : iov[i].len));
+        done += n;
+        if(n != iov[i].len) break;
+    }
+    mux_pump(ch->mux);
+    return done;
+}
+
+static int mux_dev_write(struct serial_dev_s* s, const void* pBuffer, int size){
+    struct serial_iovec_s iov = {pBuffer, size};
+    return mux_dev_writev(s, &iov, 1);
+}
+
+static int mux_dev_available(struct serial_dev_s* s){
+    return rb_count((struct rb_handle_s*)s->rxbuffer);
+}
+
+static int mux_dev_available_for_write(struct serial_dev_s* s){
+    return rb_free((struct rb_handle_s*)s->txbuffer);
+}
+
+// sends what the credit allows, data waiting for credit stays queued
+static void mux_dev_flush(struct serial_dev_s* s){
+    struct mux_channel_s* ch = (struct mux_channel_s*)s->handle;
+    mux_pump(ch->mux);
+    ch->mux->frame.serial->flush(ch->mux->frame.serial);
+}
+
+// the physical link is initialized by its owner
+static void mux_dev_init(struct serial_dev_s* s){}
+static void mux_dev_deinit(struct serial_dev_s* s){}
+static int mux_dev_setup(struct serial_dev_s* s, int baud, int data, int parity, int stop){ return 0; }
+
+int8_t mux_channel_init(struct mux_dev_s* self, struct mux_channel_s* ch, uint8_t id, uint8_t priority,
+                        struct rb_handle_s* rxbuffer, struct rb_handle_s* txbuffer){
+    if(mux_find(self, id)){
+        errno = EINVAL;
+        return -1;
+    }
+    if(self->nch >= MUX_MAX_CHANNELS){
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(ch, 0, sizeof(*ch));
+    ch->mux = self;
+    ch->id = id;
+    ch->priority = priority;
+    // announce the window with the next service call
+    ch->rx_report_tick = HAL_GetTick() - MUX_CREDIT_INTERVAL_MS;
+
+    struct serial_dev_s* s = &ch->dev;
+    serial_dev_default_init(s);
+    s->handle = (void*)ch;
+    s->rxbuffer = (void*)rxbuffer;
+    s->txbuffer = (void*)txbuffer;
+    s->init = mux_dev_init;
+    s->deinit = mux_dev_deinit;
+    s->read = mux_dev_read;
+    s->write = mux_dev_write;
+    s->writev = mux_dev_writev;
+    s->available = mux_dev_available;
+    s->available_for_write = mux_dev_available_for_write;
+    s->flush = mux_dev_flush;
+    s->setup = mux_dev_setup;
+
+    self->ch[self->nch++] = ch;
+    errno = 0;
+    return 0;
+}
+
+void mux_init(struct mux_dev_s* self, struct serial_dev_s* link){
+    frame_init(&self->frame, link);
+    self->nch = 0;
+    self->rr = 0;
+    self->busy = 0;
+    self->frame_cb = NULL;
+}
@@ -0,0 +1,98 @@
+// Copyright 2019-2021, Philipp Peterseil,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+#ifndef __MUX_H__
+#define __MUX_H__
+
+#include <stdint.h>
+#include "serial.h"
+#include "frame.h"
+#include "rb.h"
+
+// Several logical channels over one serial_dev_s, e.g. console, telemetry and
+// bulk data over the VCP. Every channel is a serial_dev_s of its own with rx and
+// tx rings, data is carried in FRAME_TYPE_MUX_DATA frames of at most MUX_CHUNK
+// bytes, so a long bulk transfer never blocks the link for more than one chunk.
+//
+// Scheduling: among the channels with data and credit the one with the lowest
+// priority value sends next, channels of equal priority take turns.
+//
+// Flow control: the receiver grants credit with FRAME_TYPE_MUX_CREDIT frames
+// that carry the size of its rx ring and the absolute stream offset it consumed
+// up to. A sender never has more than that window outstanding, so a channel whose
+// reader is slow stalls alone and can not fill the link for the others. All
+// values are absolute, a lost credit frame is made up by the next one; data lost
+// on the link is skipped by the receiver using the offset in every data frame.
+//
+// Both ends run the same protocol, the peer must send credit before anything is
+// sent on a channel. All functions, including those of the channel devices, are
+// for main loop context.
+
+#ifndef MUX_MAX_CHANNELS
+#define MUX_MAX_CHANNELS (4)
+#endif
+// payload of one data frame, bounds the latency a bulk channel adds to the others
+#ifndef MUX_CHUNK
+#define MUX_CHUNK (64)
+#endif
+// credit is re-sent at least this often, also recovers lost credit frames
+#ifndef MUX_CREDIT_INTERVAL_MS
+#define MUX_CREDIT_INTERVAL_MS (100)
+#endif
+
+// data frame payload: struct mux_data_hdr_s followed by the data
+struct mux_data_hdr_s
+{
+    uint8_t channel;
+    uint32_t offset; //stream offset of the first data byte
+} __attribute__((packed));
+
+struct mux_credit_s
+{
+    uint8_t channel;
+    uint16_t window;   //size of the receivers rx ring
+    uint32_t consumed; //stream offset read (or skipped) by the receiver
+} __attribute__((packed));
+
+struct mux_dev_s;
+
+struct mux_channel_s
+{
+    struct serial_dev_s dev; /**< device handed to the user of the channel */
+    struct mux_dev_s *mux;
+    uint8_t id;
+    uint8_t priority;        //0 is the most urgent
+    // transmit side
+    uint32_t tx_offset;      //stream offset of the next byte to send
+    uint32_t tx_acked;       //peer consumed everything before this offset
+    uint16_t tx_window;
+    uint8_t tx_credit_valid; //peer announced its window
+    // receive side
+    uint32_t rx_offset;      //stream offset of the next expected byte
+    uint32_t rx_reported;    //consumed offset last announced to the peer
+    uint32_t rx_report_tick;
+    uint32_t rx_lost;        //bytes skipped because of lost or overflowing frames
+};
+
+struct mux_dev_s
+{
+    struct frame_dev_s frame; /**< framing on the physical link */
+    struct mux_channel_s *ch[MUX_MAX_CHANNELS];
+    uint8_t nch;
+    uint8_t rr;              //channel that sent last, for round robin among equal priorities
+    uint8_t busy;            //guards against re-entry from a channel write
+    // frames of other types, may be NULL
+    void (*frame_cb) (struct mux_dev_s *self, const struct frame_s *frame);
+};
+
+void mux_init(struct mux_dev_s *self, struct serial_dev_s *link);
+// Adds a channel, its device is ch->dev afterwards. id has to match on both ends.
+// Returns -1 with errno EINVAL for a used id or ENOMEM if all channels are in use.
+int8_t mux_channel_init(struct mux_dev_s *self, struct mux_channel_s *ch, uint8_t id, uint8_t priority,
+                        struct rb_handle_s *rxbuffer, struct rb_handle_s *txbuffer);
+// Receives and dispatches frames, sends credit and queued data, call periodically.
+void mux_service(struct mux_dev_s *self);
+
+#endif
@@ -4,23 +4,37 @@
 // SPDX-License-Identifier: MIT
 
 #include "rb.h"
+#include <string.h>
+
+// the producer publishes head after the data is written, the consumer publishes
+// tail after the data is read; acquire/release keeps both ordered
+#define RB_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define RB_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+// the consumer publishes tail only if an overwriting producer did not move it meanwhile
+#define RB_CAS(x, expected, v) \
+	__atomic_compare_exchange_n(&(x), &(expected), (v), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
 
 struct rb_handle_s rb_init(char* mem, uint16_t size){
 	struct rb_handle_s h;
+	uint16_t pow2 = 1;
+	while(pow2 <= size / 2 && pow2 < 0x8000){
+		pow2 <<= 1;
+	}
 	h.mem = mem;
-	h.size = size;
-	h.back = 0;
-	h.front = 0;
-	h.count = 0;
+	h.size = size ? pow2 : 0;
+	h.mask = h.size ? h.size - 1 : 0;
+	h.head = 0;
+	h.tail = 0;
+	h.dropped = 0;
 	return h;
 }
 
 
 bool rb_put(struct rb_handle_s* h, char e){
-	if(h->count < h->size){
-		h->mem[h->front++] = e;
-		h->front = h->front % h->size;
-		h->count++;
+	uint16_t head = h->head;
+	if((uint16_t)(head - RB_LOAD(h->tail)) < h->size){
+		h->mem[head & h->mask] = e;
+		RB_STORE(h->head, (uint16_t)(head + 1));
 		return true;
 	}
 	else{
@@ -29,24 +43,115 @@ bool rb_put(struct rb_handle_s* h, char e){
 }
 
 bool rb_get(struct rb_handle_s* h, char* e){
-	if(rb_peek(h, e)){
-		h->back = ++h->back % h->size;
-		h->count--;
-		return true;
-	}
-	return false;
+	uint16_t tail = RB_LOAD(h->tail);
+	do{
+		if(RB_LOAD(h->head) == tail){
+			return false;
+		}
+		if(e){
+			*e = h->mem[tail & h->mask];
+		}
+	}while(!RB_CAS(h->tail, tail, (uint16_t)(tail + 1)));
+	return true;
 }
 bool rb_peek(struct rb_handle_s* h, char* e){
-	if(h->count){
+	uint16_t tail = h->tail;
+	if(RB_LOAD(h->head) != tail){
 		if(e){
-			*e = h->mem[h->back];
+			*e = h->mem[tail & h->mask];
 		}
 		return true;
 	}
 	return false;
-		
+
 }
 
-uint8_t rb_count(struct rb_handle_s* h){
-	return h->count;
-}
\ No newline at end of file
+uint16_t rb_write(struct rb_handle_s* h, const char* buf, uint16_t n){
+	uint16_t head = h->head;
+	uint16_t free = h->size - (uint16_t)(head - RB_LOAD(h->tail));
+	if(n > free){
+		n = free;
+	}
+	// copy in at most two spans: up to the end of mem, then from its start
+	uint16_t idx = head & h->mask;
+	uint16_t first = h->size - idx;
+	if(first > n){
+		first = n;
+	}
+	memcpy(&h->mem[idx], buf, first);
+	memcpy(&h->mem[0], buf + first, n - first);
+	RB_STORE(h->head, (uint16_t)(head + n));
+	return n;
+}
+
+uint16_t rb_read(struct rb_handle_s* h, char* buf, uint16_t n){
+	uint16_t want = n;
+	uint16_t tail = RB_LOAD(h->tail);
+	do{
+		uint16_t count = (uint16_t)(RB_LOAD(h->head) - tail);
+		n = want > count ? count : want;
+		uint16_t idx = tail & h->mask;
+		uint16_t first = h->size - idx;
+		if(first > n){
+			first = n;
+		}
+		memcpy(buf, &h->mem[idx], first);
+		memcpy(buf + first, &h->mem[0], n - first);
+	}while(!RB_CAS(h->tail, tail, (uint16_t)(tail + n)));
+	return n;
+}
+
+uint16_t rb_reserve_contiguous(struct rb_handle_s* h, char** span){
+	uint16_t head = h->head;
+	uint16_t free = h->size - (uint16_t)(head - RB_LOAD(h->tail));
+	uint16_t idx = head & h->mask;
+	uint16_t n = h->size - idx;
+	if(span){
+		*span = &h->mem[idx];
+	}
+	return n < free ? n : free;
+}
+
+void rb_commit(struct rb_handle_s* h, uint16_t n){
+	RB_STORE(h->head, (uint16_t)(h->head + n));
+}
+
+uint16_t rb_commit_overwrite(struct rb_handle_s* h, uint16_t n){
+	uint16_t head = (uint16_t)(h->head + n);
+	uint16_t tail = RB_LOAD(h->tail);
+	uint16_t drop = 0;
+	// n <= size, so dropping brings the count back to size
+	while((uint16_t)(head - tail) > h->size){
+		drop = (uint16_t)(head - h->size - tail);
+		if(RB_CAS(h->tail, tail, (uint16_t)(head - h->size))){
+			h->dropped += drop;
+			break;
+		}
+		drop = 0;
+	}
+	RB_STORE(h->head, head);
+	return drop;
+}
+
+uint16_t rb_peek_contiguous(struct rb_handle_s* h, char** span){
+	uint16_t tail = h->tail;
+	uint16_t count = (uint16_t)(RB_LOAD(h->head) - tail);
+	uint16_t idx = tail & h->mask;
+	uint16_t n = h->size - idx;
+	if(span){
+		*span = &h->mem[idx];
+	}
+	return n < count ? n : count;
+}
+
+void rb_consume(struct rb_handle_s* h, uint16_t n){
+	RB_STORE(h->tail, (uint16_t)(h->tail + n));
+}
+
+uint16_t rb_count(struct rb_handle_s* h){
+	return (uint16_t)(RB_LOAD(h->head) - RB_LOAD(h->tail));
+}
+
+uint16_t rb_free(struct rb_handle_s* h){
+	return h->size - rb_count(h);
+}
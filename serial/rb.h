@@ -9,12 +9,18 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Lock-free single-producer/single-consumer ring buffer.
+// head is only written by the producer, tail only by the consumer, so one side
+// may run in an ISR while the other runs in the main loop without locking.
+// Both indices run freely and are masked on access, the usable size is
+// therefore rounded down to a power of two (max. 32768).
 struct rb_handle_s {
 	char* mem;
 	uint16_t size;
-	uint16_t count;
-	uint16_t front;
-	uint16_t back;
+	uint16_t mask;
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	volatile uint32_t dropped; //bytes lost by rb_commit_overwrite
 };
 
 struct rb_handle_s rb_init(char* mem, uint16_t size);
@@ -24,6 +30,25 @@ bool rb_put(struct rb_handle_s* h, char e);
 bool rb_get(struct rb_handle_s* h, char* e);
 bool rb_peek(struct rb_handle_s* h, char* e);
 
-uint8_t rb_count(struct rb_handle_s* h);
+uint16_t rb_write(struct rb_handle_s* h, const char* buf, uint16_t n);
+uint16_t rb_read(struct rb_handle_s* h, char* buf, uint16_t n);
 
-#endif
\ No newline at end of file
+// zero-copy access: reserve/commit for the producer, peek/consume for the
+// consumer. The returned span is contiguous, it ends at the end of mem at the
+// latest, so a wrapped region needs two calls.
+uint16_t rb_reserve_contiguous(struct rb_handle_s* h, char** span);
+void rb_commit(struct rb_handle_s* h, uint16_t n);
+uint16_t rb_peek_contiguous(struct rb_handle_s* h, char** span);
+void rb_consume(struct rb_handle_s* h, uint16_t n);
+
+// For a producer that can not wait, e.g. a circular DMA: commits n bytes and,
+// if the reader is behind, moves tail on so that at most size bytes stay
+// readable, the oldest ones are dropped and counted. The reader of such a ring
+// uses rb_get/rb_read, which notice a moved tail and read again; the
+// span functions are not safe against it.
+uint16_t rb_commit_overwrite(struct rb_handle_s* h, uint16_t n);
+
+uint16_t rb_count(struct rb_handle_s* h);
+uint16_t rb_free(struct rb_handle_s* h);
+
+#endif
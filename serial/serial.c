@@ -4,6 +4,9 @@
 // SPDX-License-Identifier: MIT
 
 #include "serial.h"
+#include "rb.h"
+#include <stdarg.h>
+#include <stdbool.h>
 #include <string.h>
 
 int serial_print(struct serial_dev_s* s, const char* str){
@@ -11,13 +14,260 @@ int serial_print(struct serial_dev_s* s, const char* str){
 }
 
 int serial_println(struct serial_dev_s* s, const char* str){
+    struct serial_iovec_s iov[2] = {
+        {str, strlen(str)},
+        {EOL, sizeof(EOL) - 1}
+    };
+    return s->writev(s, iov, 2);
+}
+
+// fallback for devices without a queue, one write per fragment
+int serial_writev(struct serial_dev_s* s, const struct serial_iovec_s* iov, int iovcnt){
     int len = 0;
-    len += s->print(s, str);
-    len += s->print(s, EOL);
+    for(int i = 0; i < iovcnt; i++){
+        int n = s->write(s, iov[i].base, iov[i].len);
+        if(n > 0) len += n;
+        if(n != iov[i].len) break;
+    }
     return len;
 }
 
+// output of the formatter: reserved span of the tx ring, or small chunks
+// passed to write for devices without a ring
+struct serial_sink_s {
+    struct serial_dev_s* s;
+    struct rb_handle_s* rb;
+    char* span;
+    uint16_t span_len;
+    uint16_t used;
+    int limit;
+    int count;
+};
+
+static void serial_sink_flush(struct serial_sink_s* k){
+    if(k->rb){
+        rb_commit(k->rb, k->used);
+    }
+    else if(k->used){
+        k->s->write(k->s, k->span, k->used);
+    }
+    k->used = 0;
+}
+
+static void serial_putc(struct serial_sink_s* k, char c){
+    if(k->count >= k->limit) return;
+    if(k->used >= k->span_len){
+        serial_sink_flush(k);
+        if(k->rb){
+            k->span_len = rb_reserve_contiguous(k->rb, &k->span);
+            if(!k->span_len){
+                k->limit = k->count;
+                return;
+            }
+        }
+    }
+    k->span[k->used++] = c;
+    k->count++;
+}
+
+static void serial_pad(struct serial_sink_s* k, char c, int n){
+    while(n-- > 0) serial_putc(k, c);
+}
+
+// renders digits of v in reverse order into tmp, returns the number of digits
+static int serial_utoa(char* tmp, unsigned long long v, unsigned base, bool upper){
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    int n = 0;
+    do{
+        tmp[n++] = digits[v % base];
+        v /= base;
+    } while(v);
+    return n;
+}
+
+static void serial_put_number(struct serial_sink_s* k, const char* tmp, int ndig, char sign,
+                              int width, int prec, bool left, bool zero){
+    int nzero = (prec > ndig) ? prec - ndig : 0;
+    int len = ndig + nzero + (sign ? 1 : 0);
+    if(!left && !zero) serial_pad(k, ' ', width - len);
+    if(sign) serial_putc(k, sign);
+    if(!left && zero) serial_pad(k, '0', width - len);
+    serial_pad(k, '0', nzero);
+    while(ndig--) serial_putc(k, tmp[ndig]);
+    if(left) serial_pad(k, ' ', width - len);
+}
+
+static void serial_put_float(struct serial_sink_s* k, double v, int width, int prec,
+                             bool left, bool zero, char plus){
+    char tmp[40];
+    int n = 0;
+    char sign = plus;
+    if(prec < 0) prec = 6;
+    if(prec > 9) prec = 9;
+    if(v != v){
+        serial_put_number(k, "nan", 3, 0, width, 0, left, false);
+        return;
+    }
+    if(v < 0){
+        sign = '-';
+        v = -v;
+    }
+    if(v > 1.8e19){
+        serial_put_number(k, "fni", 3, sign, width, 0, left, false);
+        return;
+    }
+    unsigned long scale = 1;
+    for(int i = 0; i < prec; i++) scale *= 10;
+    v += 0.5 / scale;
+    unsigned long long ipart = (unsigned long long)v;
+    unsigned long frac = (unsigned long)((v - (double)ipart) * scale);
+    if(prec){
+        for(int i = 0; i < prec; i++){
+            tmp[n++] = '0' + frac % 10;
+            frac /= 10;
+        }
+        tmp[n++] = '.';
+    }
+    n += serial_utoa(&tmp[n], ipart, 10, false);
+    serial_put_number(k, tmp, n, sign, width, 0, left, zero);
+}
+
+static void serial_vformat(struct serial_sink_s* k, const char* fmt, va_list ap){
+    char tmp[24];
+    for(; *fmt; fmt++){
+        if(*fmt != '%'){
+            serial_putc(k, *fmt);
+            continue;
+        }
+        fmt++;
+        bool left = false, zero = false;
+        char plus = 0;
+        for(;; fmt++){
+            if(*fmt == '-') left = true;
+            else if(*fmt == '0') zero = true;
+            else if(*fmt == '+') plus = '+';
+            else if(*fmt == ' ' && !plus) plus = ' ';
+            else break;
+        }
+        int width = 0;
+        if(*fmt == '*'){
+            width = va_arg(ap, int);
+            fmt++;
+        }
+        while(*fmt >= '0' && *fmt <= '9') width = width * 10 + (*fmt++ - '0');
+        int prec = -1;
+        if(*fmt == '.'){
+            fmt++;
+            prec = 0;
+            if(*fmt == '*'){
+                prec = va_arg(ap, int);
+                fmt++;
+            }
+            while(*fmt >= '0' && *fmt <= '9') prec = prec * 10 + (*fmt++ - '0');
+        }
+        int lng = 0;
+        while(*fmt == 'l' || *fmt == 'h' || *fmt == 'z'){
+            if(*fmt == 'l') lng++;
+            if(*fmt == 'z') lng = (sizeof(size_t) > sizeof(int)) ? 1 : 0;
+            fmt++;
+        }
+        switch(*fmt){
+            case 'd':
+            case 'i':{
+                long long v = (lng >= 2) ? va_arg(ap, long long) : ((lng == 1) ? va_arg(ap, long) : va_arg(ap, int));
+                char sign = plus;
+                unsigned long long u = v;
+                if(v < 0){
+                    sign = '-';
+                    u = -(unsigned long long)v;
+                }
+                if(prec >= 0) zero = false; //for integers only, %08.3f is still zero padded
+                int n = (u == 0 && prec == 0) ? 0 : serial_utoa(tmp, u, 10, false);
+                serial_put_number(k, tmp, n, sign, width, prec, left, zero);
+            } break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':{
+                unsigned long long u = (lng >= 2) ? va_arg(ap, unsigned long long) :
+                                       ((lng == 1) ? va_arg(ap, unsigned long) : va_arg(ap, unsigned int));
+                unsigned base = (*fmt == 'u') ? 10 : ((*fmt == 'o') ? 8 : 16);
+                if(prec >= 0) zero = false;
+                int n = (u == 0 && prec == 0) ? 0 : serial_utoa(tmp, u, base, *fmt == 'X');
+                serial_put_number(k, tmp, n, 0, width, prec, left, zero);
+            } break;
+            case 'p':{
+                int n = serial_utoa(tmp, (unsigned long long)(size_t)va_arg(ap, void*), 16, false);
+                tmp[n++] = 'x';
+                tmp[n++] = '0';
+                serial_put_number(k, tmp, n, 0, width, 0, left, false);
+            } break;
+            case 'f':
+            case 'F':
+                serial_put_float(k, va_arg(ap, double), width, prec, left, zero, plus);
+                break;
+            case 'c':
+                if(!left) serial_pad(k, ' ', width - 1);
+                serial_putc(k, (char)va_arg(ap, int));
+                if(left) serial_pad(k, ' ', width - 1);
+                break;
+            case 's':{
+                const char* str = va_arg(ap, const char*);
+                if(!str) str = "(null)";
+                int len = 0;
+                while(str[len] && (prec < 0 || len < prec)) len++;
+                if(!left) serial_pad(k, ' ', width - len);
+                for(int i = 0; i < len; i++) serial_putc(k, str[i]);
+                if(left) serial_pad(k, ' ', width - len);
+            } break;
+            case '%':
+                serial_putc(k, '%');
+                break;
+            case '\0':
+                return;
+            default:
+                serial_putc(k, '%');
+                serial_putc(k, *fmt);
+                break;
+        }
+    }
+}
+
+// txbuffer, if set, has to be the struct rb_handle_s the driver transmits from
+int serial_format(struct serial_dev_s* s, const char* fmt, ...){
+    char chunk[16];
+    struct serial_sink_s k = {
+        .s = s,
+        .rb = (struct rb_handle_s*)s->txbuffer,
+        .span = chunk,
+        .span_len = 0,
+        .used = 0,
+        .limit = 0x7FFF,
+        .count = 0
+    };
+    if(k.rb){
+        // whatever the device would not take right now is dropped
+        k.limit = s->available_for_write(s);
+    }
+    else{
+        k.span_len = sizeof(chunk);
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    serial_vformat(&k, fmt, ap);
+    va_end(ap);
+    serial_sink_flush(&k);
+
+    if(k.rb){
+        s->writev(s, NULL, 0);
+    }
+    return k.count;
+}
+
 void serial_dev_default_init(struct serial_dev_s* s){
     s->print = serial_print;
     s->println = serial_println;
-}
\ No newline at end of file
+    s->writev = serial_writev;
+    s->format = serial_format;
+}
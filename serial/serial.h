@@ -10,6 +10,12 @@
 
 #define EOL "\r\n"
 
+// one fragment of a scatter-gather write
+struct serial_iovec_s {
+    const void* base;
+    int len;
+};
+
 struct serial_dev_s {
     uint16_t temporary_buffer;
     void* rxbuffer;
@@ -20,6 +26,9 @@ struct serial_dev_s {
     void (*deinit)(struct serial_dev_s* s);
     int (*read)(struct serial_dev_s* s, void* pBuffer, int size);
     int (*write)(struct serial_dev_s* s, const void* pBuffer, int size);
+    // queues all fragments, then starts a single transfer; iovcnt 0 only starts
+    // the transfer of data already queued in txbuffer
+    int (*writev)(struct serial_dev_s* s, const struct serial_iovec_s* iov, int iovcnt);
     int (*available)(struct serial_dev_s* s);
     int (*available_for_write)(struct serial_dev_s* s);
     void (*flush)(struct serial_dev_s* s);
@@ -28,6 +37,9 @@ struct serial_dev_s {
     //// implement higher level methods below
     int (*print)(struct serial_dev_s* s, const char* str);
     int (*println)(struct serial_dev_s* s, const char* str);
+    // printf style output rendered straight into txbuffer (if it is a struct rb_handle_s),
+    // supports %d %i %u %x %X %o %c %s %p %f %% with flags -0+ , width, precision and h/l/ll/z
+    int (*format)(struct serial_dev_s* s, const char* fmt, ...);
 };
 
 void serial_dev_default_init(struct serial_dev_s* s);
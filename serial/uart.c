@@ -5,87 +5,186 @@
 
 
 #include "uart.h"
+#include <errno.h>
 
-void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart){
-    struct serial_dev_s* inst = (struct serial_dev_s*)(huart->pRxBuffPtr);
-    if(rb_get((struct rb_handle_s*)inst->txbuffer, (char*)&inst->temporary_buffer)){
-        HAL_UART_Transmit_IT((UART_HandleTypeDef*)inst->handle, (uint8_t*)&inst->temporary_buffer, 1);
+// handle -> instance map, required for the shared ISR/Callback fcts.
+static struct serial_dev_s* uart_registry[UART_MAX_INSTANCES];
+
+static struct serial_dev_s* uart_lookup(UART_HandleTypeDef *huart){
+    for(int i = 0; i < UART_MAX_INSTANCES; i++){
+        if(uart_registry[i] && uart_registry[i]->handle == (void*)huart) return uart_registry[i];
+    }
+    return NULL;
+}
+
+static void uart_register(struct serial_dev_s* s){
+    int free_slot = -1;
+    for(int i = 0; i < UART_MAX_INSTANCES; i++){
+        if(uart_registry[i] && uart_registry[i]->handle == s->handle){
+            uart_registry[i] = s;
+            return;
+        }
+        if(!uart_registry[i] && free_slot < 0) free_slot = i;
+    }
+    if(free_slot >= 0) uart_registry[free_slot] = s;
+}
+
+static void uart_unregister(struct serial_dev_s* s){
+    for(int i = 0; i < UART_MAX_INSTANCES; i++){
+        if(uart_registry[i] == s) uart_registry[i] = NULL;
+    }
+}
+
+// RX runs as circular DMA straight into the rx ring if the UART has a circular
+// rx DMA channel linked (CubeMX), otherwise one byte per interrupt
+static inline int uart_rx_dma_mode(UART_HandleTypeDef *huart){
+    return huart->hdmarx && huart->hdmarx->Init.Mode == DMA_CIRCULAR;
+}
+
+// hands the contiguous span at the tail of the tx ring to the UART, the span is
+// consumed in HAL_UART_TxCpltCallback once it is on the wire
+static void uart_start_tx(struct serial_dev_s* s){
+    UART_HandleTypeDef* huart = (UART_HandleTypeDef*)s->handle;
+    char* span;
+    uint16_t n = rb_peek_contiguous((struct rb_handle_s*)s->txbuffer, &span);
+    if(!n) return;
+    if(huart->hdmatx){
+        HAL_UART_Transmit_DMA(huart, (uint8_t*)span, n);
+    }
+    else{
+        HAL_UART_Transmit_IT(huart, (uint8_t*)span, n);
+    }
+}
+
+static void uart_start_rx(struct serial_dev_s* s){
+    UART_HandleTypeDef* huart = (UART_HandleTypeDef*)s->handle;
+    if(uart_rx_dma_mode(huart)){
+        struct rb_handle_s* rb = (struct rb_handle_s*)s->rxbuffer;
+        rb->head = 0;
+        rb->tail = 0;
+        HAL_UARTEx_ReceiveToIdle_DMA(huart, (uint8_t*)rb->mem, rb->size);
     }
     else{
-        ((UART_HandleTypeDef*)inst->handle)->pTxBuffPtr = (uint8_t*)((UART_HandleTypeDef*)inst->handle)->pRxBuffPtr;
-        HAL_UART_Receive_IT((UART_HandleTypeDef*)inst->handle, (uint8_t*)&inst->temporary_buffer, 1);
+        HAL_UART_Receive_IT(huart, (uint8_t*)&s->temporary_buffer, 1);
     }
 }
 
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart){
+    struct serial_dev_s* inst = uart_lookup(huart);
+    if(!inst) return;
+    // the finished span is released only now, the UART read it from ring memory
+    rb_consume((struct rb_handle_s*)inst->txbuffer, huart->TxXferSize);
+    uart_start_tx(inst);
+}
+
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart){
-    struct serial_dev_s* inst = (struct serial_dev_s*)(huart->pTxBuffPtr);
+    struct serial_dev_s* inst = uart_lookup(huart);
+    if(!inst) return;
     rb_put((struct rb_handle_s*)inst->rxbuffer, (char)inst->temporary_buffer);
-    HAL_UART_Receive_IT((UART_HandleTypeDef*)inst->handle, (uint8_t*)&inst->temporary_buffer, 1);
+    HAL_UART_Receive_IT(huart, (uint8_t*)&inst->temporary_buffer, 1);
+}
+
+// called by the HAL on half transfer, transfer complete and idle line in circular
+// DMA mode; Size is the current DMA write position inside the rx ring memory
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size){
+    struct serial_dev_s* inst = uart_lookup(huart);
+    if(!inst) return;
+    struct rb_handle_s* rb = (struct rb_handle_s*)inst->rxbuffer;
+    rb_commit_overwrite(rb, (uint16_t)(Size - rb->head) & rb->mask);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart){
+    struct serial_dev_s* inst = uart_lookup(huart);
+    if(!inst) return;
+    // blocking errors stop the interrupt reception, re-arm it
+    if(!uart_rx_dma_mode(huart) && huart->RxState == HAL_UART_STATE_READY){
+        HAL_UART_Receive_IT(huart, (uint8_t*)&inst->temporary_buffer, 1);
+    }
+    // an aborted transmission was not consumed, send the span again
+    if(huart->gState == HAL_UART_STATE_READY){
+        uart_start_tx(inst);
+    }
 }
 
 
 int uart_read(struct serial_dev_s* s, void* pBuffer, int size)
 {
-    uint16_t count = rb_count((struct rb_handle_s*)s->rxbuffer);
-
-    uint16_t i;
-    for(i = 0; i < size && i < count; i++){
-        rb_get((struct rb_handle_s*)s->rxbuffer, &((char*)pBuffer)[i]);
-    }
-    
-    return i;
+    if(size <= 0) return 0;
+    return rb_read((struct rb_handle_s*)s->rxbuffer, (char*)pBuffer, (uint16_t)(size > 0xFFFF ? 0xFFFF : size));
 }
 
 
 
 int uart_available_for_write(struct serial_dev_s* s) {
-  return 1; // hw uart is always ready
+    return rb_free((struct rb_handle_s*)s->txbuffer);
 }
 
 int uart_available(struct serial_dev_s* s) {
     return rb_count((struct rb_handle_s*)s->rxbuffer); //number to read
 }
 
-void uart_init(struct serial_dev_s* s){    
-    HAL_UART_Init((UART_HandleTypeDef*)s->handle);
+void uart_init(struct serial_dev_s* s){
+    UART_HandleTypeDef* huart = (UART_HandleTypeDef*)s->handle;
+    if(uart_rx_dma_mode(huart)){
+        // an overrun would make the HAL abort the circular DMA, with DMA it can not happen anyway
+        huart->AdvancedInit.AdvFeatureInit |= UART_ADVFEATURE_RXOVERRUNDISABLE_INIT;
+        huart->AdvancedInit.OverrunDisable = UART_ADVFEATURE_OVERRUN_DISABLE;
+    }
+    HAL_UART_Init(huart);
 
-    ((UART_HandleTypeDef*)s->handle)->pTxBuffPtr = (uint8_t*)s;
-    HAL_UART_Receive_IT((UART_HandleTypeDef*)s->handle, (uint8_t*)&s->temporary_buffer, 1);
-    
+    uart_register(s);
+    uart_start_rx(s);
 }
 
 void uart_deinit(struct serial_dev_s* s){
     HAL_UART_Abort((UART_HandleTypeDef*)s->handle);
     HAL_UART_DeInit((UART_HandleTypeDef*)s->handle);
+    uart_unregister(s);
 }
 
-int uart_write(struct serial_dev_s* s, const void* pBuffer, int size)
+int uart_writev(struct serial_dev_s* s, const struct serial_iovec_s* iov, int iovcnt)
 {
-    uint16_t i;
-    for(i = 0; i < size; i++){
-        if(!rb_put((struct rb_handle_s*)s->txbuffer, ((char*)pBuffer)[i])) break;
+    int done = 0;
+    for(int i = 0; i < iovcnt; i++){
+        if(iov[i].len <= 0) continue;
+        uint16_t n = rb_write((struct rb_handle_s*)s->txbuffer, (const char*)iov[i].base, (uint16_t)(iov[i].len > 0xFFFF ? 0xFFFF : iov[i].len));
+        done += n;
+        if(n != iov[i].len) break;
     }
 
+    // TX and RX are independent, a running reception is not touched.
+    // While a span is in flight the completion callback picks up the new data.
     UART_HandleTypeDef* huart = (UART_HandleTypeDef*)s->handle;
-    if(huart->gState != HAL_UART_STATE_BUSY_TX){
-        HAL_UART_AbortReceive_IT(huart);
-        while(huart->gState != HAL_UART_STATE_READY){} // TIMEOUT !!!
-
-        rb_get((struct rb_handle_s*)s->txbuffer, (char*)&s->temporary_buffer);
-
-        ((UART_HandleTypeDef*)s->handle)->pRxBuffPtr = (uint8_t*)s;
-        HAL_UART_Transmit_IT((UART_HandleTypeDef*)s->handle, (uint8_t*)&s->temporary_buffer, 1);
+    if(huart->gState == HAL_UART_STATE_READY){
+        uart_start_tx(s);
     }
 
+    return done;
+}
 
-    return i;
+int uart_write(struct serial_dev_s* s, const void* pBuffer, int size)
+{
+    struct serial_iovec_s iov = {pBuffer, size};
+    return uart_writev(s, &iov, 1);
 }
 
 void uart_flush(struct serial_dev_s* s){
-    while(rb_count((struct rb_handle_s*)s->txbuffer)){}
+    UART_HandleTypeDef* huart = (UART_HandleTypeDef*)s->handle;
+    // the budget is the line time of what is buffered (10 bits per byte) plus a margin,
+    // a stalled transmitter (CTS held, DMA error) gives up instead of hanging the caller
+    uint32_t bytes = rb_count((struct rb_handle_s*)s->txbuffer) + huart->TxXferCount;
+    uint32_t baud = huart->Init.BaudRate ? huart->Init.BaudRate : 9600;
+    struct deadline_s d;
+    deadline_start(&d, (uint32_t)(((uint64_t)bytes * 10 * 1000 + baud - 1) / baud) + UART_FLUSH_MARGIN_MS);
+    while(rb_count((struct rb_handle_s*)s->txbuffer) || huart->gState != HAL_UART_STATE_READY){
+        if(deadline_expired(&d)){
+            errno = ETIMEDOUT;
+            return;
+        }
+    }
 }
 
-int uart_setup(struct serial_dev_s* s, int baud, int data, int parity, int stop){ 
+int uart_setup(struct serial_dev_s* s, int baud, int data, int parity, int stop){
     UART_HandleTypeDef* huart = (UART_HandleTypeDef*)s->handle;
 
     if(huart->gState != HAL_UART_STATE_READY) return false;
@@ -97,7 +196,7 @@ int uart_setup(struct serial_dev_s* s, int baud, int data, int parity, int stop)
     huart->Init.Mode = UART_MODE_TX_RX;
     huart->Init.OverSampling = UART_OVERSAMPLING_16;
 
-    return true; 
+    return true;
 }
 
 
@@ -110,6 +209,7 @@ void uart_serial_dev_init(struct serial_dev_s* s, UART_HandleTypeDef* h, struct
     s->deinit = uart_deinit;
     s->read = uart_read;
     s->write = uart_write;
+    s->writev = uart_writev;
     s->available = uart_available;
     s->available_for_write = uart_available_for_write;
     s->flush = uart_flush;
@@ -9,8 +9,27 @@
 #include <stm32h7xx_hal.h>
 #include "serial.h"
 #include "rb.h"
+#include "deadline.h"
 
+// number of UARTs that can be active at the same time
+#ifndef UART_MAX_INSTANCES
+#define UART_MAX_INSTANCES (4)
+#endif
 
+// uart_flush waits for the buffered bytes at the configured baud rate plus
+// this margin, then returns with errno = ETIMEDOUT
+#ifndef UART_FLUSH_MARGIN_MS
+#define UART_FLUSH_MARGIN_MS (10)
+#endif
+
+// tx and rx ring memory is read/written by DMA if the UART has DMA channels
+// linked, place it in a DMA accessible, non cached region then
+// With rx DMA the UART receives into the ring circularly without waiting for
+// the reader. A reader more than one ring behind loses the oldest bytes, they
+// are counted in rxbuffer->dropped and the ring never reports more than its
+// size. The DMA events come at half and full ring and at idle line, so their
+// interrupt must not be blocked for more than half a ring of bytes, a whole
+// ring passing unnoticed can not be detected.
 void uart_serial_dev_init(struct serial_dev_s* s, UART_HandleTypeDef* h, struct rb_handle_s* rxbuffer, struct rb_handle_s* txbuffer);
 
 
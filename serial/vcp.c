@@ -4,6 +4,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "vcp.h"
+#include "rb.h"
 #include <stdint.h>
 
 #include "usb_device.h"
@@ -11,30 +12,46 @@
 
 // DEFINED IN: usbd_cdc_if.c
 extern USBD_HandleTypeDef hUsbDeviceFS;
-extern struct sRxBufferHdr rxBufferHdr;
+extern struct sRxFifo rxFifo;
 extern uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 extern volatile uint8_t isCDCConnectionOpened;
+extern void (*transmitCpltCb)();
+
+// writes are queued here and sent from ring memory by the IN endpoint
+static char vcp_tx_mem[VCP_TX_BUFFER_SIZE];
+static struct rb_handle_s vcp_tx_rb;
+static volatile uint16_t vcp_tx_inflight = 0; //bytes handed to the IN endpoint, consumed on completion
+static uint32_t vcp_tx_first_tick = 0; //time the oldest waiting byte was queued
+static uint32_t vcp_tx_start_tick = 0; //time the packet in flight was started
+static volatile uint8_t vcp_recovering = 0;
+static uint32_t vcp_recover_tick = 0; //time the device was stopped for recovery
 
 
 int vcp_read(struct serial_dev_s* s, void* pBuffer, int size)
 {
-  if (!rxBufferHdr.ReadDone)
-    return 0;
-
-  int remaining = rxBufferHdr.Size - rxBufferHdr.Position;
-  int todo = MIN(remaining, size);
-  if (todo <= 0)
-    return 0;
-
-  memcpy(pBuffer, UserRxBufferFS + rxBufferHdr.Position, todo);
-  rxBufferHdr.Position += todo;
-  if (rxBufferHdr.Position >= rxBufferHdr.Size)
+  int done = 0;
+  while (done < size && rxFifo.Tail != rxFifo.Head)
   {
-    rxBufferHdr.ReadDone = 0;
-    USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+    uint8_t slot = rxFifo.Tail % APP_RX_PACKET_COUNT;
+    int todo = MIN(rxFifo.Len[slot] - rxFifo.Position, size - done);
+    memcpy((char*)pBuffer + done, &UserRxBufferFS[slot * APP_RX_PACKET_SIZE + rxFifo.Position], todo);
+    done += todo;
+    rxFifo.Position += todo;
+    if (rxFifo.Position >= rxFifo.Len[slot])
+    {
+      rxFifo.Position = 0;
+      rxFifo.Tail++;
+      if (rxFifo.Stalled)
+      {
+        // a slot is free again, continue the reception stopped in CDC_Receive_FS
+        rxFifo.Stalled = 0;
+        USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &UserRxBufferFS[(rxFifo.Head % APP_RX_PACKET_COUNT) * APP_RX_PACKET_SIZE]);
+        USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+      }
+    }
   }
 
-  return todo;
+  return done;
 }
 
 #ifdef USE_USB_HS
@@ -43,12 +60,26 @@ enum { kMaxOutPacketSize = CDC_DATA_HS_OUT_PACKET_SIZE };
 enum { kMaxOutPacketSize = CDC_DATA_FS_OUT_PACKET_SIZE };
 #endif
 
+enum vcp_link_state vcp_link_state(struct serial_dev_s* s) {
+  if (vcp_recovering)
+    return VCP_LINK_RECOVERING;
+  if (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED)
+    return VCP_LINK_DOWN;
+  return isCDCConnectionOpened ? VCP_LINK_OPEN : VCP_LINK_CONFIGURED;
+}
+
 int vcp_available_for_write(struct serial_dev_s* s) {
-  return isCDCConnectionOpened && (hUsbDeviceFS.dev_state == USBD_STATE_CONFIGURED);
+  enum vcp_link_state link = vcp_link_state(s);
+  if (link != VCP_LINK_OPEN && link != VCP_LINK_RECOVERING)
+    return 0;
+  return rb_free(&vcp_tx_rb);
 }
 
 int vcp_available(struct serial_dev_s* s) {
-    return rxBufferHdr.Size - rxBufferHdr.Position;
+    int count = -rxFifo.Position;
+    for (uint8_t i = rxFifo.Tail; i != rxFifo.Head; i++)
+      count += rxFifo.Len[i % APP_RX_PACKET_COUNT];
+    return count > 0 ? count : 0;
 }
 
 void vcp_init(struct serial_dev_s* s){
@@ -59,43 +90,128 @@ void vcp_deinit(struct serial_dev_s* s){
     USBD_Stop(&hUsbDeviceFS);
 }
 
+// Starts the next packet from the tx ring if the endpoint is idle.
+// Less than a full packet is held back to be merged with later writes until
+// VCP_TX_FLUSH_DEADLINE_MS passed, unless force is set.
+static void vcp_tx_kick(int force)
+{
+  USBD_CDC_HandleTypeDef* pCDC =
+    (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  // nobody reads the IN endpoint unless a terminal opened the port
+  if (vcp_link_state(NULL) != VCP_LINK_OPEN)
+    return;
+  if (!pCDC || pCDC->TxState || vcp_tx_inflight)
+    return;
+
+  char* span;
+  uint16_t todo = rb_peek_contiguous(&vcp_tx_rb, &span);
+  if (!todo)
+    return;
+  if (todo > kMaxOutPacketSize)
+    todo = kMaxOutPacketSize;
+  if (!force && rb_count(&vcp_tx_rb) < kMaxOutPacketSize &&
+      HAL_GetTick() - vcp_tx_first_tick < VCP_TX_FLUSH_DEADLINE_MS)
+    return;
+
+  vcp_tx_inflight = todo;
+  vcp_tx_start_tick = HAL_GetTick();
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, (uint8_t*)span, todo);
+  if (USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK)
+    vcp_tx_inflight = 0;
+}
+
+// IN transfer complete, called from CDC_TransmitCplt_FS (USB interrupt)
+static void vcp_tx_complete(void)
+{
+  rb_consume(&vcp_tx_rb, vcp_tx_inflight);
+  vcp_tx_inflight = 0;
+  vcp_tx_first_tick = HAL_GetTick();
+  // whatever was written during the last packet goes out right away
+  vcp_tx_kick(1);
+}
+
+// all fragments are queued before the endpoint is started, so they are merged
+// into as few packets as possible
+int vcp_writev(struct serial_dev_s* s, const struct serial_iovec_s* iov, int iovcnt)
+{
+  // without a terminal the data would only pile up, fail fast;
+  // during a recovery it is queued and sent after re-enumeration
+  enum vcp_link_state link = vcp_link_state(s);
+  if (link != VCP_LINK_OPEN && link != VCP_LINK_RECOVERING)
+    return 0;
+  if (!rb_count(&vcp_tx_rb))
+    vcp_tx_first_tick = HAL_GetTick();
+
+  int done = 0;
+  for (int i = 0; i < iovcnt; i++)
+  {
+    if (iov[i].len <= 0)
+      continue;
+    uint16_t n = rb_write(&vcp_tx_rb, (const char*)iov[i].base, (uint16_t)MIN(iov[i].len, 0xFFFF));
+    done += n;
+    if (n != iov[i].len)
+      break;
+  }
+  vcp_tx_kick(0);
+  return done;
+}
+
 int vcp_write(struct serial_dev_s* s, const void* pBuffer, int size)
 {
-  if (size > kMaxOutPacketSize)
+  struct serial_iovec_s iov = {pBuffer, size};
+  return vcp_writev(s, &iov, 1);
+}
+
+/**
+  * @brief Link supervision, never blocks.
+  *        A packet that is not acknowledged within VCP_TX_STALL_MS stops the
+  *        device, after VCP_RECOVERY_DELAY_MS it is started again and the host
+  *        re-enumerates it. Unacknowledged data is sent again afterwards.
+  */
+void vcp_service(struct serial_dev_s* s)
+{
+  uint32_t now = HAL_GetTick();
+
+  if (vcp_recovering)
   {
-    int offset;
-    int done = 0;
-    for (offset = 0; offset < size; offset += done)
+    if (now - vcp_recover_tick >= VCP_RECOVERY_DELAY_MS)
     {
-      int todo = MIN(kMaxOutPacketSize, size - offset);
-      done = vcp_write(s, ((char*)pBuffer) + offset, todo);
-      if (done != todo)
-        return offset + done;
+      vcp_tx_inflight = 0;
+      USBD_Start(&hUsbDeviceFS);
+      vcp_recovering = 0;
     }
-
-    return size;
+    return;
   }
 
-  USBD_CDC_HandleTypeDef* pCDC =
-    (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
-  while (pCDC->TxState) {} //Wait for previous transfer
-
-  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, (uint8_t*)pBuffer, size);
-  if (USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK)
-    return 0;
-
-  uint32_t time = HAL_GetTick();
-  while (pCDC->TxState) {
-    if (HAL_GetTick() - time > 500) {
+  if (vcp_tx_inflight)
+  {
+    if (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED)
+    {
+      // unplugged or reset by the host, the packet is lost with the endpoint
+      vcp_tx_inflight = 0;
+    }
+    else if (now - vcp_tx_start_tick > VCP_TX_STALL_MS)
+    {
       USBD_Stop(&hUsbDeviceFS);
-      vcp_init(NULL);
-      HAL_Delay(500);
+      isCDCConnectionOpened = 0; //the terminal has to open the port again after re-enumeration
+      vcp_recover_tick = now;
+      vcp_recovering = 1;
+      return;
     }
-  } //Wait until transfer is done
-  return size;
+  }
+
+  vcp_tx_kick(0);
+}
+
+// sends everything queued, returns early if the link is or goes down
+void vcp_flush(struct serial_dev_s* s)
+{
+  while (rb_count(&vcp_tx_rb) && vcp_link_state(s) == VCP_LINK_OPEN) {
+    vcp_tx_kick(1);
+    vcp_service(s);
+  }
 }
 
-void vcp_flush(struct serial_dev_s* s){}
 int vcp_setup(struct serial_dev_s* s, int baud, int data, int parity, int stop){ return 0; }
 
 void vcp_serial_dev_init(struct serial_dev_s* s){
@@ -104,8 +220,15 @@ void vcp_serial_dev_init(struct serial_dev_s* s){
     s->deinit = vcp_deinit;
     s->read = vcp_read;
     s->write = vcp_write;
+    s->writev = vcp_writev;
     s->available = vcp_available;
     s->available_for_write = vcp_available_for_write;
     s->flush = vcp_flush;
     s->setup = vcp_setup;
+    s->txbuffer = (void*)&vcp_tx_rb;
+
+    vcp_tx_rb = rb_init(vcp_tx_mem, VCP_TX_BUFFER_SIZE);
+    vcp_tx_inflight = 0;
+    vcp_recovering = 0;
+    transmitCpltCb = vcp_tx_complete;
 }
@@ -7,7 +7,37 @@
 #define __VCP_DRV_H__
 
 #include "serial.h"
+
+// size of the transmit queue, rounded down to a power of two
+#ifndef VCP_TX_BUFFER_SIZE
+#define VCP_TX_BUFFER_SIZE (1024)
+#endif
+// time a write shorter than a packet waits to be merged with following writes
+#ifndef VCP_TX_FLUSH_DEADLINE_MS
+#define VCP_TX_FLUSH_DEADLINE_MS (2)
+#endif
+
+// an IN transfer not acknowledged within this time counts as a stalled link
+#ifndef VCP_TX_STALL_MS
+#define VCP_TX_STALL_MS (500)
+#endif
+// time the device stays disconnected before it re-enumerates after a stall
+#ifndef VCP_RECOVERY_DELAY_MS
+#define VCP_RECOVERY_DELAY_MS (500)
+#endif
+
+enum vcp_link_state
+{
+    VCP_LINK_DOWN,       //not configured by a host
+    VCP_LINK_CONFIGURED, //enumerated, port not opened by a terminal
+    VCP_LINK_OPEN,       //terminal connected, data is sent
+    VCP_LINK_RECOVERING  //stalled, device stopped until it re-enumerates
+};
+
 void vcp_serial_dev_init(struct serial_dev_s* s);
+// link supervision and delayed sending of small writes, call periodically from the main loop
+void vcp_service(struct serial_dev_s* s);
+enum vcp_link_state vcp_link_state(struct serial_dev_s* s);
 
 
 #endif
\ No newline at end of file
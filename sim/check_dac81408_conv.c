@@ -0,0 +1,160 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Host check of the DAC81408 volts to code conversion */
+
+// Compares dac81408_q16_to_codes and dac81408_volts_to_codes (the portable C
+// path, the host has no SMMLAR) with a double precision reference for every
+// range, uncalibrated and with gain and offset, across the saturation edges.
+// The driver runs against the chip model to set the ranges and to reject
+// calibrations out of range. Built and run by make check in this directory.
+// Exit status 0 if all codes are rounded to the nearest of the exact value.
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "sim.h"
+#include "sim_spi.h"
+#include "sim_dac81408.h"
+#include "spi_hal.h"
+#include "dac81408.h"
+
+// error of the rounded multiplier, far below a code for inputs up to 64 V
+#define CHECK_MUL_ERROR (1e-3)
+
+static const struct
+{
+    enum dac81408_range range;
+    const char *name;
+    double min, span;
+} check_ranges[] =
+{
+    {unip_5, "unip_5", 0, 5},
+    {bipo_10, "bipo_10", -10, 20},
+    {unip_10, "unip_10", 0, 10},
+    {unip_20, "unip_20", 0, 20},
+    {unip_40, "unip_40", 0, 40},
+    {bipo_2_5, "bipo_2_5", -2.5, 5},
+    {bipo_5, "bipo_5", -5, 10},
+    {bipo_20, "bipo_20", -20, 40},
+};
+
+static const struct dac81408_cal_s check_cals[] =
+{
+    {0, 0},             //identity
+    {65536 + 655, -10}, //+1 %, -10 codes
+    {65536 - 1311, 25}, //-2 %, +25 codes
+    {DAC81408_CAL_GAIN_MAX, -3000}, //largest multiplier
+};
+
+static SPI_HandleTypeDef hspi1;
+
+static double check_gain(const struct dac81408_cal_s *cal)
+{
+    return cal->gain ? cal->gain / 65536.0 : 1.0;
+}
+
+// exact code, saturated, not rounded
+static double check_reference(double volts, double min, double span, const struct dac81408_cal_s *cal)
+{
+    double code = (volts - min) * 65536.0 / span * check_gain(cal) + cal->offset;
+    return code < 0 ? 0 : (code > 0xFFFF ? 0xFFFF : code);
+}
+
+static double check_error(uint16_t code, double ref)
+{
+    return fabs(code - ref);
+}
+
+int main(void)
+{
+    struct sim_spi_bus_s bus;
+    struct sim_dac81408_s model;
+    struct spi_dev_s spi;
+    struct dac81408_dev_s dac = {0};
+    int failed = 0;
+
+    sim_init(480000000);
+    hspi1.Init.DataSize = SPI_DATASIZE_24BIT;
+    sim_spi_bus_init(&bus, &hspi1, 25000000);
+    sim_dac81408_init(&model);
+    sim_spi_attach(&bus, &model.model);
+    spi_init(&spi, &hspi1);
+    dac.spi_dev = &spi;
+    if (dac81408_init(&dac))
+    {
+        printf("dac81408_init failed\n");
+        return 1;
+    }
+
+    // gains that could overflow the multiplier, offsets beyond the code range
+    const struct dac81408_cal_s bad_cals[] =
+    {
+        {DAC81408_CAL_GAIN_MIN - 1, 0}, {DAC81408_CAL_GAIN_MAX + 1, 0}, {-65536, 0}, {0, 0x10000}, {0, -0x10000}
+    };
+    for (unsigned c = 0; c < sizeof(bad_cals) / sizeof(bad_cals[0]); c++)
+    {
+        if (dac81408_set_cal(&dac, 0, &bad_cals[c]) != -1)
+        {
+            printf("gain %ld offset %ld: accepted FAILED\n", (long)bad_cals[c].gain, (long)bad_cals[c].offset);
+            failed++;
+        }
+    }
+
+    for (unsigned r = 0; r < sizeof(check_ranges) / sizeof(check_ranges[0]); r++)
+    {
+        double min = check_ranges[r].min, span = check_ranges[r].span;
+        dac81408_set_channel_range(&dac, 0xFF, check_ranges[r].range);
+        for (unsigned c = 0; c < sizeof(check_cals) / sizeof(check_cals[0]); c++)
+        {
+            const struct dac81408_cal_s *cal = &check_cals[c];
+            double max_q16 = 0, max_float = 0;
+            int edges = 0;
+            dac81408_set_cal(&dac, 0, cal);
+            double tolerance = 0.5 + CHECK_MUL_ERROR;
+
+            // every Q16 value from one volt below to one volt above the range
+            int32_t lo = (int32_t)((min - 1.0) * 65536.0), hi = (int32_t)((min + span + 1.0) * 65536.0);
+            for (int32_t q = lo; q <= hi; q++)
+            {
+                uint16_t code;
+                dac81408_q16_to_codes(&dac, 0x01, &q, &code, 1);
+                double err = check_error(code, check_reference(q / 65536.0, min, span, cal));
+                if (err > max_q16)
+                    max_q16 = err;
+            }
+
+            // the same as float, including values far outside every range
+            for (int i = -70000; i <= 70000; i++)
+            {
+                float_t v = (float_t)(min + span * i / 65536.0);
+                uint16_t code;
+                dac81408_volts_to_codes(&dac, 0x01, &v, &code, 1);
+                double err = check_error(code, check_reference((int32_t)(v * 65536.0f) / 65536.0, min, span, cal));
+                if (err > max_float)
+                    max_float = err;
+            }
+
+            // saturation has to be exact, a tenth of the span outside covers the gains above
+            const double v_edges[] = {-1e30, -1000.0, min - span / 10, min + span * 1.1, 1000.0, 1e30};
+            for (int i = 0; i < 6; i++)
+            {
+                int32_t q = v_edges[i] < INT32_MIN / 65536.0 ? INT32_MIN :
+                            (v_edges[i] > INT32_MAX / 65536.0 ? INT32_MAX : (int32_t)(v_edges[i] * 65536.0));
+                float_t v = (float_t)v_edges[i];
+                uint16_t code_q, code_f, expect = i < 3 ? 0 : 0xFFFF;
+                dac81408_q16_to_codes(&dac, 0x01, &q, &code_q, 1);
+                dac81408_volts_to_codes(&dac, 0x01, &v, &code_f, 1);
+                edges += (code_q != expect) + (code_f != expect);
+            }
+
+            int ok = max_q16 <= tolerance && max_float <= tolerance && !edges;
+            printf("%-8s gain %6ld offset %4ld: max error q16 %.3f float %.3f of %.3f, saturation errors %d %s\n",
+                   check_ranges[r].name, (long)cal->gain, (long)cal->offset, max_q16, max_float, tolerance,
+                   edges, ok ? "ok" : "FAILED");
+            failed += !ok;
+        }
+    }
+    return failed ? 1 : 0;
+}
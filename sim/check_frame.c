@@ -0,0 +1,210 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Host check of the COBS framing of serial/frame.c */
+
+// Encodes frames with frame_encode and feeds them byte by byte to the host
+// decoder, the same code the firmware uses. The encoding is compared with a
+// plain reference COBS encoder over a bitwise CRC, payloads cover every length
+// and the zero/0xFF patterns around the 254 byte COBS block boundary. Damaged
+// streams have to be counted and dropped without losing the following frame:
+// CRC errors, truncated and overlong frames, gaps in seq. Built and run by
+// make check in this directory. Exit status 0 if all checks passed.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "frame.h"
+
+static int check_failed;
+
+#define CHECK(cond) check_result((cond), #cond, __LINE__)
+
+static void check_result(int ok, const char *what, int line)
+{
+    if (!ok)
+    {
+        printf("line %d: %s FAILED\n", line, what);
+        check_failed++;
+    }
+}
+
+// CRC-16/CCITT-FALSE bit by bit
+static uint16_t check_crc16(const uint8_t *data, uint16_t len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len--)
+    {
+        crc ^= (uint16_t)(*data++ << 8);
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+// textbook COBS of raw plus the delimiter, returns the encoded length
+static uint16_t check_cobs(const uint8_t *raw, uint16_t len, uint8_t *enc)
+{
+    uint16_t code_idx = 0, pos = 1;
+    uint8_t code = 1;
+    for (uint16_t i = 0; i < len; i++)
+    {
+        if (raw[i])
+        {
+            enc[pos++] = raw[i];
+            code++;
+        }
+        if (!raw[i] || code == 0xFF)
+        {
+            enc[code_idx] = code;
+            code_idx = pos++;
+            code = 1;
+        }
+    }
+    enc[code_idx] = code;
+    enc[pos++] = 0;
+    return pos;
+}
+
+// feeds enc to dec, returns the result of the last byte, frame filled on success
+static int8_t check_feed(struct frame_decoder_s *dec, const uint8_t *enc, uint16_t len, struct frame_s *frame)
+{
+    int8_t result = 0;
+    for (uint16_t i = 0; i < len; i++)
+    {
+        int8_t r = frame_decode(dec, enc[i], frame);
+        if (r)
+            result = r;
+    }
+    return result;
+}
+
+static void check_fill(uint8_t *payload, uint16_t len, int pattern)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        switch (pattern)
+        {
+        case 0: payload[i] = 0x00; break;
+        case 1: payload[i] = 0xFF; break;
+        case 2: payload[i] = (uint8_t)(i % 255 + 1); break; //no zero at all
+        case 3: payload[i] = (i % 254 == 253) ? 0 : 0x5A; break; //zero at the block end
+        default: payload[i] = (uint8_t)rand(); break;
+        }
+    }
+}
+
+static void check_round_trip(void)
+{
+    static uint8_t payload[FRAME_MAX_PAYLOAD], raw[FRAME_MAX_RAW];
+    static uint8_t enc[FRAME_MAX_ENCODED], ref[FRAME_MAX_ENCODED];
+    struct frame_decoder_s dec;
+    struct frame_s frame;
+    uint16_t seq = 0xFFF0; //wraps during the run
+    uint32_t frames = 0;
+    frame_decoder_init(&dec);
+
+    for (int pattern = 0; pattern < 5; pattern++)
+    {
+        for (uint16_t len = 0; len <= FRAME_MAX_PAYLOAD; len++)
+        {
+            check_fill(payload, len, pattern);
+            uint8_t type = (uint8_t)(len & 1 ? 0x00 : FRAME_TYPE_USER + pattern);
+            // payload split in header and data as frame_send does it
+            uint16_t hdr_len = len / 3;
+            uint16_t n = frame_encode(enc, seq, type, payload, hdr_len, payload + hdr_len, len - hdr_len);
+
+            raw[0] = type;
+            raw[1] = seq & 0xFF;
+            raw[2] = seq >> 8;
+            memcpy(raw + FRAME_HEADER_LEN, payload, len);
+            uint16_t crc = check_crc16(raw, FRAME_HEADER_LEN + len);
+            raw[FRAME_HEADER_LEN + len] = crc & 0xFF;
+            raw[FRAME_HEADER_LEN + len + 1] = crc >> 8;
+            uint16_t n_ref = check_cobs(raw, FRAME_HEADER_LEN + len + FRAME_CRC_LEN, ref);
+
+            CHECK(n == n_ref && n <= FRAME_MAX_ENCODED);
+            CHECK(!memcmp(enc, ref, n_ref));
+            CHECK(memchr(enc, 0, n) == enc + n - 1);
+
+            int8_t r = check_feed(&dec, enc, n, &frame);
+            CHECK(r == 1);
+            if (r == 1)
+            {
+                CHECK(frame.type == type && frame.seq == seq && frame.len == len);
+                CHECK(!memcmp(frame.payload, payload, len));
+            }
+            seq++;
+            frames++;
+        }
+    }
+    CHECK(dec.frames == frames && !dec.crc_errors && !dec.bad_frames && !dec.lost);
+
+    // too long for one frame
+    CHECK(frame_encode(enc, 0, FRAME_TYPE_TEXT, payload, 1, payload, FRAME_MAX_PAYLOAD) == 0);
+}
+
+static void check_damage(void)
+{
+    static uint8_t enc[FRAME_MAX_ENCODED], bad[FRAME_MAX_ENCODED + 64];
+    const char text[] = "framing check";
+    struct frame_decoder_s dec;
+    struct frame_s frame;
+    frame_decoder_init(&dec);
+
+    // known CRC-16/CCITT-FALSE check value
+    CHECK(frame_crc16(0xFFFF, (const uint8_t *)"123456789", 9) == 0x29B1);
+
+    uint16_t n = frame_encode(enc, 1, FRAME_TYPE_TEXT, NULL, 0, text, sizeof(text));
+    CHECK(check_feed(&dec, enc, n, &frame) == 1);
+
+    // a changed payload byte fails the CRC, the next frame decodes
+    memcpy(bad, enc, n);
+    bad[5] ^= 0x01;
+    CHECK(check_feed(&dec, bad, n, &frame) == -1);
+    CHECK(dec.crc_errors == 1);
+    n = frame_encode(enc, 2, FRAME_TYPE_TEXT, NULL, 0, text, sizeof(text));
+    CHECK(check_feed(&dec, enc, n, &frame) == 1);
+
+    // cut in the middle of a block
+    memcpy(bad, enc, 6);
+    bad[6] = 0;
+    CHECK(check_feed(&dec, bad, 7, &frame) == -1);
+    CHECK(dec.bad_frames == 1);
+
+    // shorter than header and CRC
+    const uint8_t tiny[] = {0x03, 0x11, 0x22, 0x00};
+    CHECK(check_feed(&dec, tiny, sizeof(tiny), &frame) == -1);
+    CHECK(dec.bad_frames == 2);
+
+    // no delimiter for longer than the largest frame
+    memset(bad, 0x7F, sizeof(bad) - 1);
+    bad[sizeof(bad) - 1] = 0;
+    CHECK(check_feed(&dec, bad, sizeof(bad), &frame) == -1);
+    CHECK(dec.bad_frames == 3);
+
+    // delimiters alone resynchronize without counting anything
+    const uint8_t idle[] = {0, 0, 0};
+    CHECK(check_feed(&dec, idle, sizeof(idle), &frame) == 0);
+    CHECK(dec.bad_frames == 3 && dec.crc_errors == 1);
+
+    // the damaged frames were not counted as lost, seq 4..6 are
+    n = frame_encode(enc, 3, FRAME_TYPE_TEXT, NULL, 0, text, sizeof(text));
+    CHECK(check_feed(&dec, enc, n, &frame) == 1);
+    CHECK(dec.lost == 0);
+    n = frame_encode(enc, 7, FRAME_TYPE_TEXT, NULL, 0, text, sizeof(text));
+    CHECK(check_feed(&dec, enc, n, &frame) == 1);
+    CHECK(dec.lost == 3);
+    CHECK(frame.len == sizeof(text) && !memcmp(frame.payload, text, sizeof(text)));
+}
+
+int main(void)
+{
+    srand(1);
+    check_round_trip();
+    check_damage();
+    printf("frame: %s\n", check_failed ? "FAILED" : "ok");
+    return check_failed ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Host check of the I2C chip drivers against the bus simulation */
+
+// Runs the TCA9534 and ISL28023 drivers unchanged through bus/i2c_hal.c and
+// their struct i2c_dev_s against the chip models of one simulated bus: pin
+// updates and the register shadow, reads of the input port, the ID block,
+// PMBus words and a chip that does not answer. Built and run by make check in
+// this directory. Exit status 0 if all checks passed.
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "sim.h"
+#include "sim_i2c.h"
+#include "sim_tca9534.h"
+#include "sim_isl28023.h"
+#include "i2c_hal.h"
+#include "tca9534.h"
+#include "isl28023.h"
+
+#define CHECK_TCA9534_ADR (0x20)
+#define CHECK_ISL28023_ADR (0x40)
+
+static int check_failed;
+
+#define CHECK(cond) check_result((cond), #cond, __LINE__)
+
+static void check_result(int ok, const char *what, int line)
+{
+    if (!ok)
+    {
+        printf("line %d: %s FAILED\n", line, what);
+        check_failed++;
+    }
+}
+
+static I2C_HandleTypeDef hi2c1;
+
+static void check_tca9534(struct i2c_dev_s *i2c, struct sim_tca9534_s *model)
+{
+    struct tca9534_dev_s gpio = {0};
+    uint8_t val;
+    gpio.i2c_dev = i2c;
+    gpio.hw_adr = CHECK_TCA9534_ADR << 1;
+
+    CHECK(tca9534_init(&gpio) == 0);
+    CHECK(model->reg[TCA9534_POLINV_REG_ADR] == 0);
+
+    // low nibble output, high nibble input
+    CHECK(tca9534_set_output(&gpio, 0x0F) == 0);
+    CHECK(model->reg[TCA9534_CONF_REG_ADR] == 0xF0);
+    CHECK(tca9534_set_port(&gpio, 0x05) == 0);
+    CHECK((sim_tca9534_levels(model) & 0x0F) == 0x05);
+
+    // the shadow skips writes of unchanged values
+    uint32_t writes = model->writes;
+    CHECK(tca9534_set_port(&gpio, 0x05) == 0);
+    CHECK(model->writes == writes);
+
+    // only the pins in mask change
+    CHECK(tca9534_update_port(&gpio, 0x03, 0x02) == 0);
+    CHECK(model->reg[TCA9534_OUTPORT_REG_ADR] == 0x06);
+    CHECK((sim_tca9534_levels(model) & 0x0F) == 0x06);
+
+    // the input port is read from the chip every time
+    model->pins = 0xA0;
+    CHECK(tca9534_get_port(&gpio, &val) == 0);
+    CHECK(val == 0xA6);
+    model->pins = 0x50;
+    CHECK(tca9534_get_port(&gpio, &val) == 0);
+    CHECK(val == 0x56);
+}
+
+static void check_isl28023(struct i2c_dev_s *i2c, struct sim_isl28023_s *model)
+{
+    struct isl28023_dev_s pm;
+    uint8_t id[9];
+    isl28023_init(&pm, i2c, CHECK_ISL28023_ADR << 1, 0.01f);
+
+    // block read: count byte, then the string
+    CHECK(pm.read_ID(&pm, id) == 0);
+    CHECK(id[0] == strlen(SIM_ISL28023_ID) && !memcmp(id + 1, SIM_ISL28023_ID, id[0]));
+
+    // PMBus words are low byte first, 1 mV per LSB for the bus voltage
+    uint8_t word[2];
+    sim_isl28023_set_input(model, 0.01, 12.0, 0.01);
+    CHECK(i2c->mem_read(i2c, pm.hw_adr, ISL28023_REG_READ_VOUT, I2C_MEMADD_SIZE_8BIT, word, 2, I2C_TIMEOUT_MS) == 0);
+    CHECK((word[0] | (word[1] << 8)) == 12000);
+    word[0] = 0x34;
+    word[1] = 0x12;
+    CHECK(i2c->mem_write(i2c, pm.hw_adr, ISL28023_REG_IOUT_CAL_GAIN, I2C_MEMADD_SIZE_8BIT, word, 2, I2C_TIMEOUT_MS) == 0);
+    CHECK(model->value[ISL28023_REG_IOUT_CAL_GAIN] == 0x1234);
+
+    // the measurement functions run through the same struct
+    float_t v;
+    CHECK(pm.read_vout(&pm, &v) == 0);
+    CHECK(pm.read_vshunt(&pm, &v) == 0);
+    CHECK(pm.read_iout(&pm, &v) == 0);
+
+    // unsupported command: NACK of the command byte
+    CHECK(i2c->mem_read(i2c, pm.hw_adr, 0x00, I2C_MEMADD_SIZE_8BIT, word, 2, I2C_TIMEOUT_MS) == -1);
+    CHECK(errno == ENXIO);
+
+    // nobody at the address
+    struct isl28023_dev_s absent;
+    isl28023_init(&absent, i2c, (CHECK_ISL28023_ADR + 1) << 1, 0.01f);
+    CHECK(absent.read_ID(&absent, id) == -1);
+    CHECK(errno == ENXIO);
+}
+
+int main(void)
+{
+    struct sim_i2c_bus_s bus;
+    struct sim_tca9534_s gpio_model;
+    struct sim_isl28023_s pm_model;
+    struct i2c_dev_s i2c;
+
+    sim_init(480000000);
+    sim_i2c_bus_init(&bus, &hi2c1, 400000);
+    sim_tca9534_init(&gpio_model, CHECK_TCA9534_ADR);
+    sim_isl28023_init(&pm_model, CHECK_ISL28023_ADR);
+    sim_i2c_attach(&bus, &gpio_model.model);
+    sim_i2c_attach(&bus, &pm_model.model);
+    i2c_init(&i2c, &hi2c1);
+
+    check_tca9534(&i2c, &gpio_model);
+    check_isl28023(&i2c, &pm_model);
+
+    printf("%u transfers, %u bytes, %u NACKs in %llu us: %s\n", bus.transfers, bus.bytes, bus.nacks,
+           (unsigned long long)(sim_now_ns() / 1000), check_failed ? "FAILED" : "ok");
+    return check_failed ? 1 : 0;
+}
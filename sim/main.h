@@ -0,0 +1,14 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Host replacement of the CubeMX main.h for the bus simulation */
+#ifndef SIM_MAIN_H
+#define SIM_MAIN_H
+
+#include "stm32h7xx_hal.h"
+
+void Error_Handler(void);
+
+#endif
@@ -0,0 +1,152 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Virtual time of the host bus simulation */
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "stm32h7xx_hal.h"
+
+static DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+uint32_t SystemCoreClock = 480000000;
+
+static uint64_t sim_time_ns;
+static struct sim_event_s *sim_events; //sorted by time
+
+// the cycle counter follows the time, it wraps like on the target
+static void sim_set_time(uint64_t t_ns)
+{
+    sim_time_ns = t_ns;
+    sim_dwt.CYCCNT = (uint32_t)(t_ns * (SystemCoreClock / 1000000) / 1000);
+}
+
+void sim_init(uint32_t core_clock_hz)
+{
+    SystemCoreClock = core_clock_hz;
+    sim_events = NULL;
+    sim_set_time(0);
+}
+
+uint64_t sim_now_ns(void)
+{
+    return sim_time_ns;
+}
+
+void sim_schedule(struct sim_event_s *ev, uint64_t t_ns)
+{
+    if (ev->pending)
+        sim_cancel(ev);
+    ev->t_ns = t_ns;
+    ev->pending = 1;
+    struct sim_event_s **p = &sim_events;
+    while (*p && (*p)->t_ns <= t_ns)
+        p = &(*p)->next;
+    ev->next = *p;
+    *p = ev;
+}
+
+void sim_cancel(struct sim_event_s *ev)
+{
+    for (struct sim_event_s **p = &sim_events; *p; p = &(*p)->next)
+    {
+        if (*p == ev)
+        {
+            *p = ev->next;
+            break;
+        }
+    }
+    ev->pending = 0;
+    ev->next = NULL;
+}
+
+// the time of an event is reached, it runs like an interrupt would
+static void sim_fire_due(void)
+{
+    while (sim_events && sim_events->t_ns <= sim_time_ns)
+    {
+        struct sim_event_s *ev = sim_events;
+        sim_events = ev->next;
+        ev->pending = 0;
+        ev->next = NULL;
+        ev->fire(ev);
+    }
+}
+
+void sim_advance_ns(uint64_t ns)
+{
+    uint64_t end = sim_time_ns + ns;
+    // events fire at their time, they may schedule further ones
+    while (sim_events && sim_events->t_ns <= end)
+    {
+        if (sim_events->t_ns > sim_time_ns)
+            sim_set_time(sim_events->t_ns);
+        sim_fire_due();
+    }
+    sim_set_time(end);
+}
+
+void sim_poll(void)
+{
+    uint64_t step = SIM_POLL_NS;
+    if (sim_events && sim_events->t_ns > sim_time_ns && sim_events->t_ns - sim_time_ns < step)
+        step = sim_events->t_ns - sim_time_ns;
+    sim_advance_ns(step);
+}
+
+void sim_run(uint64_t limit_ns)
+{
+    uint64_t end = sim_time_ns + limit_ns;
+    while (sim_events && sim_events->t_ns <= end)
+        sim_advance_ns(sim_events->t_ns > sim_time_ns ? sim_events->t_ns - sim_time_ns : 0);
+}
+
+// no events fire here, they do at the next poll or transfer
+DWT_Type *sim_dwt_access(void)
+{
+    sim_set_time(sim_time_ns + SIM_DWT_ACCESS_NS);
+    return &sim_dwt;
+}
+
+uint32_t HAL_GetTick(void)
+{
+    sim_poll();
+    return (uint32_t)(sim_time_ns / 1000000ULL);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+    sim_advance_ns((uint64_t)Delay * 1000000ULL);
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+    (void)GPIOx;
+    (void)GPIO_Init;
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin)
+{
+    GPIOx->ODR |= GPIO_Pin; //released, the pull-up wins
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    return (GPIOx->ODR & ~GPIOx->held_low & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+    if (PinState == GPIO_PIN_SET)
+        GPIOx->ODR |= GPIO_Pin;
+    else
+        GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+}
+
+void Error_Handler(void)
+{
+    fprintf(stderr, "Error_Handler called at %llu ns\n", (unsigned long long)sim_time_ns);
+    abort();
+}
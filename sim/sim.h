@@ -0,0 +1,67 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Virtual time of the host bus simulation */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// The simulation replaces the HAL below bus/i2c_hal.c and bus/spi_hal.c, so the
+// drivers run unchanged on a workstation against chip models (sim_i2c.h,
+// sim_spi.h). Time is virtual: it advances by the bus time of every transfer
+// and whenever the code polls (HAL_GetTick, HAL_I2C_GetState), never by wall
+// clock, so latency and throughput figures are reproducible.
+//
+// Typical setup, the driver structs are the same as on the target:
+//     sim_init(480000000);
+//     sim_i2c_bus_init(&bus, &hi2c1, 400000);
+//     sim_tca9534_init(&gpio_model, 0x20);
+//     sim_i2c_attach(&bus, &gpio_model.model);
+//     i2c_init(&i2c, &hi2c1);
+//     gpio.i2c_dev = &i2c; gpio.hw_adr = 0x20 << 1;
+//     tca9534_init(&gpio);
+// and sim_now_ns() or the bus statistics before and after the code of interest.
+
+// time the CPU spends per poll of the tick while it waits
+#ifndef SIM_POLL_NS
+#define SIM_POLL_NS (1000)
+#endif
+
+// time of one read of the DWT cycle counter, busy waits on it make progress
+#ifndef SIM_DWT_ACCESS_NS
+#define SIM_DWT_ACCESS_NS (2)
+#endif
+
+// completion of a transfer, like an interrupt of the peripheral
+struct sim_event_s
+{
+    uint64_t t_ns;
+    void (*fire) (struct sim_event_s *ev);
+    void *ctx;
+    uint8_t pending;
+    struct sim_event_s *next;
+};
+
+// resets the time, core_clock_hz drives the DWT cycle counter
+void sim_init(uint32_t core_clock_hz);
+uint64_t sim_now_ns(void);
+// lets time pass, e.g. for processing on the CPU, and fires due events
+void sim_advance_ns(uint64_t ns);
+// one poll of a waiting CPU: advances SIM_POLL_NS or to the next event
+void sim_poll(void);
+// runs the events until none is left or limit_ns passed
+void sim_run(uint64_t limit_ns);
+
+void sim_schedule(struct sim_event_s *ev, uint64_t t_ns);
+void sim_cancel(struct sim_event_s *ev);
+
+// duration of bits at clock_hz, rounded up
+static inline uint64_t sim_bits_ns(uint64_t bits, uint32_t clock_hz)
+{
+    return (bits * 1000000000ULL + clock_hz - 1) / clock_hz;
+}
+
+#endif
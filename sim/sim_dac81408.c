@@ -0,0 +1,250 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Model of the DAC DAC81408 for the bus simulation */
+#include "sim_dac81408.h"
+#include <string.h>
+#include "dac81408.h"
+
+// channel n is bit n+4 in SYNCCONFIG, BRDCONFIG and DACPWDWN
+#define SIM_DAC81408_CH_BIT(n) (1u << ((n) + 4))
+#define SIM_DAC81408_SDO_EN (1u << 2)
+#define SIM_DAC81408_STR_EN (1u << 3)
+#define SIM_DAC81408_LDAC (1u << 4)
+#define SIM_DAC81408_AB_TOG_EN (1u << 7)
+#define SIM_DAC81408_SOFT_RESET (0xA)
+
+static void sim_dac81408_reset(struct sim_dac81408_s *self)
+{
+    memset(self->reg, 0, sizeof(self->reg));
+    memset(self->out, 0, sizeof(self->out));
+    memset(self->reg_b, 0, sizeof(self->reg_b));
+    self->reg[DAC81408_DEVICEID] = 0x298 << 2;
+    self->reg[DAC81408_SPICONFIG] = 0x0AA4;
+    self->reg[DAC81408_GENCONFIG] = 0x7F00;
+    self->reg[DAC81408_BRDCONFIG] = 0xFFFF;
+    self->reg[DAC81408_DACPWDWN] = 0xFFFF;
+    self->sdo = 0;
+}
+
+// TOGGLE pin of channel n, -1 if it is not in toggle mode
+static int8_t sim_dac81408_toggle_pin(struct sim_dac81408_s *self, uint8_t n)
+{
+    uint8_t i = n + 4;
+    uint16_t cfg = self->reg[i >= 8 ? DAC81408_TOGGCONFIG0 : DAC81408_TOGGCONFIG1];
+    return (int8_t)((cfg >> (2 * (i % 8))) & 0x3) - 1;
+}
+
+// the register the output takes: A, or B in toggle mode with the pin high
+static uint16_t sim_dac81408_level(struct sim_dac81408_s *self, uint8_t n)
+{
+    int8_t pin = sim_dac81408_toggle_pin(self, n);
+    return (pin >= 0 && self->toggle[pin]) ? self->reg_b[n] : self->reg[DAC81408_DAC0 + n];
+}
+
+// DAC data register written, the output follows unless the channel waits for LDAC
+static void sim_dac81408_set(struct sim_dac81408_s *self, uint8_t n, uint16_t val)
+{
+    if (self->reg[DAC81408_TRIGGER] & SIM_DAC81408_AB_TOG_EN)
+        self->reg_b[n] = val;
+    else
+        self->reg[DAC81408_DAC0 + n] = val;
+    if (!(self->reg[DAC81408_SYNCCONFIG] & SIM_DAC81408_CH_BIT(n)))
+    {
+        self->out[n] = sim_dac81408_level(self, n);
+        self->updates++;
+    }
+}
+
+static void sim_dac81408_write(struct sim_dac81408_s *self, uint8_t adr, uint16_t val)
+{
+    self->writes++;
+    if (adr >= DAC81408_DAC0 && adr < DAC81408_DAC0 + SIM_DAC81408_CHANNELS)
+    {
+        sim_dac81408_set(self, adr - DAC81408_DAC0, val);
+        return;
+    }
+    switch (adr)
+    {
+    case DAC81408_NOP:
+    case DAC81408_DEVICEID:
+    case DAC81408_STATUS:
+        return;
+    case DAC81408_BRDCAST:
+        self->reg[adr] = val;
+        for (uint8_t n = 0; n < SIM_DAC81408_CHANNELS; n++)
+        {
+            if (self->reg[DAC81408_BRDCONFIG] & SIM_DAC81408_CH_BIT(n))
+                sim_dac81408_set(self, n, val);
+        }
+        return;
+    case DAC81408_TRIGGER:
+        // soft reset and LDAC are self clearing
+        self->reg[adr] = val & SIM_DAC81408_AB_TOG_EN;
+        if ((val & 0xF) == SIM_DAC81408_SOFT_RESET)
+        {
+            sim_dac81408_reset(self);
+            return;
+        }
+        if (val & SIM_DAC81408_LDAC)
+        {
+            self->ldac++;
+            for (uint8_t n = 0; n < SIM_DAC81408_CHANNELS; n++)
+            {
+                if (self->reg[DAC81408_SYNCCONFIG] & SIM_DAC81408_CH_BIT(n))
+                {
+                    self->out[n] = sim_dac81408_level(self, n);
+                    self->updates++;
+                }
+            }
+        }
+        return;
+    case DAC81408_TOGGCONFIG0:
+    case DAC81408_TOGGCONFIG1:
+        self->reg[adr] = val;
+        for (uint8_t n = 0; n < SIM_DAC81408_CHANNELS; n++)
+        {
+            if (!(self->reg[DAC81408_SYNCCONFIG] & SIM_DAC81408_CH_BIT(n)))
+                self->out[n] = sim_dac81408_level(self, n);
+        }
+        return;
+    default:
+        self->reg[adr] = val;
+        return;
+    }
+}
+
+uint32_t sim_dac81408_command(struct sim_dac81408_s *self, uint32_t mosi)
+{
+    self->frames++;
+    uint32_t miso = (self->reg[DAC81408_SPICONFIG] & SIM_DAC81408_SDO_EN) ? self->sdo : 0;
+    uint8_t adr = (mosi >> 16) & 0x3F;
+    if (mosi & (1UL << 23))
+    {
+        self->sdo = (mosi & 0xFF0000) | self->reg[adr];
+    }
+    else
+    {
+        self->sdo = mosi;
+        sim_dac81408_write(self, adr, mosi & 0xFFFF);
+        if (self->reg[DAC81408_SPICONFIG] & SIM_DAC81408_STR_EN)
+            self->stream_adr = adr + 1;
+    }
+    return miso;
+}
+
+static uint32_t sim_dac81408_frame(struct sim_spi_model_s *m, uint32_t mosi, uint8_t bits)
+{
+    struct sim_dac81408_s *self = (struct sim_dac81408_s *)m;
+    if (bits == 24)
+        return sim_dac81408_command(self, mosi);
+    if (bits != 8)
+    {
+        self->bad_frames++;
+        return 0;
+    }
+    // SDO is not modeled for byte transfers
+    self->acc = (self->acc << 8) | (mosi & 0xFF);
+    self->acc_bits += 8;
+    if (!self->stream_adr && self->acc_bits == 24)
+    {
+        sim_dac81408_command(self, self->acc & 0xFFFFFF);
+        self->acc = 0;
+        self->acc_bits = 0;
+    }
+    else if (self->stream_adr && self->acc_bits == 16)
+    {
+        self->stream_words++;
+        sim_dac81408_write(self, self->stream_adr++ & 0x3F, self->acc & 0xFFFF);
+        self->acc = 0;
+        self->acc_bits = 0;
+    }
+    return 0;
+}
+
+// CS rising edge: a partial frame is dropped, streaming ends
+static void sim_dac81408_select(struct sim_spi_model_s *m, uint8_t selected)
+{
+    (void)selected;
+    struct sim_dac81408_s *self = (struct sim_dac81408_s *)m;
+    if (self->acc_bits)
+        self->bad_frames++;
+    self->acc = 0;
+    self->acc_bits = 0;
+    self->stream_adr = 0;
+}
+
+void sim_dac81408_toggle(struct sim_dac81408_s *self, uint8_t pin, uint8_t level)
+{
+    if (self->toggle[pin] == !!level)
+        return;
+    self->toggle[pin] = !!level;
+    for (uint8_t n = 0; n < SIM_DAC81408_CHANNELS; n++)
+    {
+        if (sim_dac81408_toggle_pin(self, n) == pin)
+        {
+            self->out[n] = sim_dac81408_level(self, n);
+            self->toggles++;
+        }
+    }
+}
+
+void sim_dac81408_init(struct sim_dac81408_s *self)
+{
+    memset(self, 0, sizeof(*self));
+    self->model.frame = sim_dac81408_frame;
+    self->model.select = sim_dac81408_select;
+    sim_dac81408_reset(self);
+}
+
+
+//// daisy chain
+
+static uint32_t sim_dac81408_chain_frame(struct sim_spi_model_s *m, uint32_t mosi, uint8_t bits)
+{
+    struct sim_dac81408_chain_s *self = (struct sim_dac81408_chain_s *)m;
+    if (bits != 24)
+    {
+        self->chip[0].bad_frames++;
+        return 0;
+    }
+    uint32_t miso = self->shift[self->n - 1];
+    for (uint8_t k = self->n - 1; k > 0; k--)
+        self->shift[k] = self->shift[k - 1];
+    self->shift[0] = mosi;
+    self->words++;
+    return miso;
+}
+
+static void sim_dac81408_chain_select(struct sim_spi_model_s *m, uint8_t selected)
+{
+    struct sim_dac81408_chain_s *self = (struct sim_dac81408_chain_s *)m;
+    if (selected)
+    {
+        // the responses of the last frames, zeros from chips without SDO
+        for (uint8_t k = 0; k < self->n; k++)
+        {
+            struct sim_dac81408_s *chip = &self->chip[k];
+            self->shift[k] = (chip->reg[DAC81408_SPICONFIG] & SIM_DAC81408_SDO_EN) ? chip->sdo : 0;
+        }
+        self->words = 0;
+        return;
+    }
+    self->transfers++;
+    if (self->words < self->n)
+        self->chip[0].bad_frames++; //the chips behind execute stale contents
+    for (uint8_t k = 0; k < self->n; k++)
+        sim_dac81408_command(&self->chip[k], self->shift[k]);
+}
+
+void sim_dac81408_chain_init(struct sim_dac81408_chain_s *self, uint8_t n)
+{
+    memset(self, 0, sizeof(*self));
+    self->n = n;
+    for (uint8_t k = 0; k < n; k++)
+        sim_dac81408_init(&self->chip[k]);
+    self->model.frame = sim_dac81408_chain_frame;
+    self->model.select = sim_dac81408_chain_select;
+}
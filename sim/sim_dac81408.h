@@ -0,0 +1,67 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Model of the DAC DAC81408 for the bus simulation */
+#ifndef SIM_DAC81408_H
+#define SIM_DAC81408_H
+
+#include <stdint.h>
+#include "sim_spi.h"
+
+#define SIM_DAC81408_CHANNELS (8)
+
+// 24 bit frames: R/W bit 23, register address 21:16, data 15:0. SDO shifts out
+// during a frame what the previous one left in the shift register: the echo of
+// a read command with the register content, or the previous frame itself.
+// Bytes are assembled to frames within one chip select window. With STR-EN set
+// in SPICONFIG every further 16 bit word of a write goes to the next register.
+// A channel in toggle mode (TOGGCONFIG) outputs register A (the DAC data
+// register) while its TOGGLE pin is low and register B while it is high, B is
+// written with AB-TOG-EN set in TRIGGER.
+struct sim_dac81408_s
+{
+    struct sim_spi_model_s model;
+    uint16_t reg[64];
+    uint16_t reg_b[SIM_DAC81408_CHANNELS];
+    uint8_t toggle[3];     /**< levels of the TOGGLE pins */
+    uint16_t out[SIM_DAC81408_CHANNELS]; /**< code on the outputs */
+    uint32_t sdo;          /**< shift register content for the next frame */
+    uint32_t acc;          /**< bits of a frame assembled from bytes */
+    uint8_t acc_bits;
+    uint8_t stream_adr;    /**< next register of a streaming write, 0 for none */
+    uint32_t frames;
+    uint32_t bad_frames;   /**< not 24 bit long, ignored */
+    uint32_t stream_words; /**< data words written by streaming */
+    uint32_t writes;
+    uint32_t updates;      /**< output updates, counted per channel */
+    uint32_t ldac;         /**< synchronous updates by the LDAC trigger */
+    uint32_t toggles;      /**< output updates by the TOGGLE pins */
+};
+
+void sim_dac81408_init(struct sim_dac81408_s *self);
+// executes a 24 bit frame, returns what SDO shifted out during it
+uint32_t sim_dac81408_command(struct sim_dac81408_s *self, uint32_t frame);
+// TOGGLE pin 0..2 driven to level
+void sim_dac81408_toggle(struct sim_dac81408_s *self, uint8_t pin, uint8_t level);
+
+// Daisy chain of chips behind one chip select: the frames shift through the
+// chips, chip 0 takes MOSI and chip n-1 drives MISO. When CS rises every chip
+// executes the frame it holds, its response is shifted out with the next
+// transfer. The chips are initialized, not attached to a bus.
+#define SIM_DAC81408_CHAIN_MAX (8)
+
+struct sim_dac81408_chain_s
+{
+    struct sim_spi_model_s model;
+    struct sim_dac81408_s chip[SIM_DAC81408_CHAIN_MAX];
+    uint8_t n;
+    uint32_t shift[SIM_DAC81408_CHAIN_MAX];
+    uint8_t words; /**< frames in the current CS window */
+    uint32_t transfers;
+};
+
+void sim_dac81408_chain_init(struct sim_dac81408_chain_s *self, uint8_t n);
+
+#endif
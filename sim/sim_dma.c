@@ -0,0 +1,89 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated DMA requests, behind the HAL DMA functions */
+#include "sim_dma.h"
+#include <stddef.h>
+
+static struct sim_dma_sink_s *sim_dma_sinks[SIM_DMA_SINKS];
+
+void sim_dma_add_sink(struct sim_dma_sink_s *sink)
+{
+    int free_slot = -1;
+    for (int i = 0; i < SIM_DMA_SINKS; i++)
+    {
+        if (sim_dma_sinks[i] == sink)
+            return;
+        if (!sim_dma_sinks[i] && free_slot < 0)
+            free_slot = i;
+    }
+    if (free_slot >= 0)
+        sim_dma_sinks[free_slot] = sink;
+}
+
+static void sim_dma_write(uintptr_t dst, uint32_t data)
+{
+    for (int i = 0; i < SIM_DMA_SINKS; i++)
+    {
+        struct sim_dma_sink_s *s = sim_dma_sinks[i];
+        if (s && (uintptr_t)s->addr == dst)
+        {
+            s->write(s, data);
+            return;
+        }
+    }
+    *(volatile uint32_t *)dst = data;
+}
+
+void sim_dma_request(DMA_HandleTypeDef *hdma)
+{
+    if (!hdma || hdma->State != HAL_DMA_STATE_BUSY)
+        return;
+    uint32_t data = ((const uint32_t *)hdma->src)[hdma->index];
+    int wrapped = 0;
+    hdma->index++;
+    if (hdma->index == hdma->length)
+    {
+        hdma->index = 0;
+        wrapped = 1;
+        if (hdma->Init.Mode != DMA_CIRCULAR)
+            hdma->State = HAL_DMA_STATE_READY;
+    }
+    sim_dma_write(hdma->dst, data);
+    // a callback may abort or restart the transfer
+    if (wrapped)
+    {
+        if (hdma->XferCpltCallback)
+            hdma->XferCpltCallback(hdma);
+    }
+    else if (hdma->index == hdma->length / 2 && hdma->XferHalfCpltCallback)
+    {
+        hdma->XferHalfCpltCallback(hdma);
+    }
+}
+
+
+//// HAL
+
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uintptr_t SrcAddress, uintptr_t DstAddress, uint32_t DataLength)
+{
+    if (hdma->State == HAL_DMA_STATE_BUSY)
+        return HAL_BUSY;
+    if (!DataLength)
+        return HAL_ERROR;
+    hdma->src = SrcAddress;
+    hdma->dst = DstAddress;
+    hdma->length = DataLength;
+    hdma->index = 0;
+    hdma->ErrorCode = HAL_DMA_ERROR_NONE;
+    hdma->State = HAL_DMA_STATE_BUSY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+    hdma->State = HAL_DMA_STATE_READY;
+    return HAL_OK;
+}
@@ -0,0 +1,31 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated DMA requests, behind the HAL DMA functions */
+#ifndef SIM_DMA_H
+#define SIM_DMA_H
+
+#include <stdint.h>
+#include "stm32h7xx_hal.h"
+
+#ifndef SIM_DMA_SINKS
+#define SIM_DMA_SINKS (8)
+#endif
+
+// A peripheral register that reacts to writes, e.g. SPI TXDR. The DMA writes
+// to a sink instead of the memory if the destination address matches.
+struct sim_dma_sink_s
+{
+    volatile uint32_t *addr;
+    void (*write) (struct sim_dma_sink_s *self, uint32_t data);
+    void *ctx;
+};
+
+void sim_dma_add_sink(struct sim_dma_sink_s *sink);
+// One request of the peripheral that triggers hdma (e.g. a timer update),
+// moves one word of a started transfer. Ignored if hdma is not running.
+void sim_dma_request(DMA_HandleTypeDef *hdma);
+
+#endif
@@ -0,0 +1,283 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated I2C bus with chip models, behind the HAL I2C functions */
+#include "sim_i2c.h"
+#include <string.h>
+
+static struct sim_i2c_model_s *sim_i2c_find(struct sim_i2c_bus_s *self, uint16_t DevAddress)
+{
+    for (struct sim_i2c_model_s *m = self->models; m; m = m->next)
+    {
+        if (m->address == (DevAddress >> 1))
+            return m;
+    }
+    return NULL;
+}
+
+// START and address byte, 0 if a chip acknowledged
+static int8_t sim_i2c_start(struct sim_i2c_model_s *m, uint8_t read, uint64_t *bits)
+{
+    *bits += 1 + 9;
+    return (m && !m->start(m, read)) ? 0 : -1;
+}
+
+// Runs one transfer through the models at once: head (the register address)
+// and for writes data are sent, for reads data is received after a repeated
+// start, or right after the address if there is no head. Returns the HAL
+// error code, the duration is added to *ns.
+static uint32_t sim_i2c_run(struct sim_i2c_bus_s *self, uint16_t DevAddress, const uint8_t *head,
+                            uint16_t nhead, uint8_t *data, uint16_t size, uint8_t read, uint64_t *ns)
+{
+    struct sim_i2c_model_s *m = sim_i2c_find(self, DevAddress);
+    uint64_t bits = 1; //stop
+    uint32_t error = HAL_I2C_ERROR_NONE;
+
+    if (!read || nhead)
+    {
+        if (sim_i2c_start(m, 0, &bits))
+        {
+            error = HAL_I2C_ERROR_AF;
+            goto stop;
+        }
+        for (uint16_t i = 0; i < nhead + (read ? 0 : size); i++)
+        {
+            bits += 9;
+            if (m->write(m, i < nhead ? head[i] : data[i - nhead]))
+            {
+                error = HAL_I2C_ERROR_AF;
+                goto stop;
+            }
+        }
+    }
+    if (read)
+    {
+        if (sim_i2c_start(m, 1, &bits))
+        {
+            error = HAL_I2C_ERROR_AF;
+            goto stop;
+        }
+        for (uint16_t i = 0; i < size; i++)
+            data[i] = m->read(m);
+        bits += 9 * size;
+    }
+stop:
+    if (m)
+        m->stop(m);
+    uint64_t t = self->setup_ns + sim_bits_ns(bits, self->clock_hz);
+    self->transfers++;
+    self->busy_ns += t;
+    if (error)
+        self->nacks++;
+    else
+        self->bytes += size;
+    *ns += t;
+    return error;
+}
+
+static uint16_t sim_i2c_mem_head(uint16_t MemAddress, uint16_t MemAddSize, uint8_t *head)
+{
+    if (MemAddSize == I2C_MEMADD_SIZE_16BIT)
+    {
+        head[0] = MemAddress >> 8;
+        head[1] = MemAddress & 0xFF;
+        return 2;
+    }
+    head[0] = MemAddress & 0xFF;
+    return 1;
+}
+
+static HAL_StatusTypeDef sim_i2c_blocking(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, const uint8_t *head,
+                                          uint16_t nhead, uint8_t *data, uint16_t size, uint8_t read)
+{
+    struct sim_i2c_bus_s *self = (struct sim_i2c_bus_s *)hi2c->Instance;
+    if (hi2c->State != HAL_I2C_STATE_READY)
+        return HAL_BUSY;
+    uint64_t ns = 0;
+    hi2c->ErrorCode = sim_i2c_run(self, DevAddress, head, nhead, data, size, read, &ns);
+    sim_advance_ns(ns);
+    return hi2c->ErrorCode == HAL_I2C_ERROR_NONE ? HAL_OK : HAL_ERROR;
+}
+
+static void sim_i2c_done(struct sim_event_s *ev)
+{
+    struct sim_i2c_bus_s *self = (struct sim_i2c_bus_s *)ev->ctx;
+    I2C_HandleTypeDef *hi2c = self->hi2c;
+    hi2c->State = HAL_I2C_STATE_READY;
+    hi2c->Mode = HAL_I2C_MODE_NONE;
+    if (hi2c->ErrorCode != HAL_I2C_ERROR_NONE)
+        HAL_I2C_ErrorCallback(hi2c);
+    else
+        self->cplt(hi2c);
+}
+
+// The chip sees the transfer when it starts, the completion interrupt follows after the bus time.
+static HAL_StatusTypeDef sim_i2c_async(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, const uint8_t *head,
+                                       uint16_t nhead, uint8_t *data, uint16_t size, uint8_t read,
+                                       void (*cplt) (I2C_HandleTypeDef *hi2c))
+{
+    struct sim_i2c_bus_s *self = (struct sim_i2c_bus_s *)hi2c->Instance;
+    if (hi2c->State != HAL_I2C_STATE_READY)
+        return HAL_BUSY;
+    uint64_t ns = 0;
+    hi2c->ErrorCode = sim_i2c_run(self, DevAddress, head, nhead, data, size, read, &ns);
+    hi2c->State = read ? HAL_I2C_STATE_BUSY_RX : HAL_I2C_STATE_BUSY_TX;
+    hi2c->Mode = nhead ? HAL_I2C_MODE_MEM : HAL_I2C_MODE_MASTER;
+    self->cplt = cplt;
+    sim_schedule(&self->done, sim_now_ns() + ns);
+    return HAL_OK;
+}
+
+void sim_i2c_bus_init(struct sim_i2c_bus_s *self, I2C_HandleTypeDef *hi2c, uint32_t clock_hz)
+{
+    memset(self, 0, sizeof(*self));
+    self->hi2c = hi2c;
+    self->clock_hz = clock_hz;
+    self->done.fire = sim_i2c_done;
+    self->done.ctx = self;
+    hi2c->Instance = self;
+    hi2c->State = HAL_I2C_STATE_READY;
+    hi2c->Mode = HAL_I2C_MODE_NONE;
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+}
+
+void sim_i2c_attach(struct sim_i2c_bus_s *self, struct sim_i2c_model_s *model)
+{
+    model->next = self->models;
+    self->models = model;
+}
+
+void sim_i2c_reset_stats(struct sim_i2c_bus_s *self)
+{
+    self->transfers = 0;
+    self->bytes = 0;
+    self->nacks = 0;
+    self->busy_ns = 0;
+}
+
+
+//// HAL
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+    hi2c->State = HAL_I2C_STATE_READY;
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+    sim_cancel(&((struct sim_i2c_bus_s *)hi2c->Instance)->done);
+    hi2c->State = HAL_I2C_STATE_RESET;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    return sim_i2c_blocking(hi2c, DevAddress, NULL, 0, pData, Size, 0);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    return sim_i2c_blocking(hi2c, DevAddress, NULL, 0, pData, Size, 1);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    uint8_t head[2];
+    return sim_i2c_blocking(hi2c, DevAddress, head, sim_i2c_mem_head(MemAddress, MemAddSize, head), pData, Size, 0);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    uint8_t head[2];
+    return sim_i2c_blocking(hi2c, DevAddress, head, sim_i2c_mem_head(MemAddress, MemAddSize, head), pData, Size, 1);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+{
+    return sim_i2c_async(hi2c, DevAddress, NULL, 0, pData, Size, 0, HAL_I2C_MasterTxCpltCallback);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+{
+    return sim_i2c_async(hi2c, DevAddress, NULL, 0, pData, Size, 1, HAL_I2C_MasterRxCpltCallback);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+    uint8_t head[2];
+    return sim_i2c_async(hi2c, DevAddress, head, sim_i2c_mem_head(MemAddress, MemAddSize, head), pData, Size, 0,
+                         HAL_I2C_MemTxCpltCallback);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+    uint8_t head[2];
+    return sim_i2c_async(hi2c, DevAddress, head, sim_i2c_mem_head(MemAddress, MemAddSize, head), pData, Size, 1,
+                         HAL_I2C_MemRxCpltCallback);
+}
+
+// DMA and interrupt transfers only differ in the CPU load, which is not simulated
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+{
+    return HAL_I2C_Master_Transmit_IT(hi2c, DevAddress, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size)
+{
+    return HAL_I2C_Master_Receive_IT(hi2c, DevAddress, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+    return HAL_I2C_Mem_Write_IT(hi2c, DevAddress, MemAddress, MemAddSize, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size)
+{
+    return HAL_I2C_Mem_Read_IT(hi2c, DevAddress, MemAddress, MemAddSize, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress)
+{
+    (void)DevAddress;
+    struct sim_i2c_bus_s *self = (struct sim_i2c_bus_s *)hi2c->Instance;
+    if (!self->done.pending)
+        return HAL_ERROR;
+    hi2c->State = HAL_I2C_STATE_ABORT;
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    self->cplt = HAL_I2C_AbortCpltCallback;
+    sim_schedule(&self->done, sim_now_ns() + self->setup_ns);
+    return HAL_OK;
+}
+
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c)
+{
+    sim_poll();
+    return hi2c->State;
+}
+
+HAL_I2C_ModeTypeDef HAL_I2C_GetMode(I2C_HandleTypeDef *hi2c)
+{
+    return hi2c->Mode;
+}
+
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c)
+{
+    return hi2c->ErrorCode;
+}
+
+// overridden by bus/i2c_hal.c if it is linked
+__attribute__((weak)) void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
+__attribute__((weak)) void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c) { (void)hi2c; }
@@ -0,0 +1,51 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated I2C bus with chip models, behind the HAL I2C functions */
+#ifndef SIM_I2C_H
+#define SIM_I2C_H
+
+#include <stdint.h>
+#include "stm32h7xx_hal.h"
+#include "sim.h"
+
+// A chip on the bus sees the transfer byte by byte like a real slave. It is
+// embedded as first member of the model, e.g. struct sim_tca9534_s.
+struct sim_i2c_model_s
+{
+    uint8_t address; /**< 7 bit */
+    // (repeated) start addressed to the chip, returns 0 for ACK
+    int8_t (*start) (struct sim_i2c_model_s *self, uint8_t read);
+    // byte from the master, returns 0 for ACK
+    int8_t (*write) (struct sim_i2c_model_s *self, uint8_t data);
+    uint8_t (*read) (struct sim_i2c_model_s *self);
+    void (*stop) (struct sim_i2c_model_s *self);
+    struct sim_i2c_model_s *next;
+};
+
+// Timing: every byte takes 9 clocks, start, repeated start and stop one each,
+// plus setup_ns per transfer for the interrupt and DMA handling.
+struct sim_i2c_bus_s
+{
+    I2C_HandleTypeDef *hi2c;
+    uint32_t clock_hz; /**< SCL */
+    uint32_t setup_ns;
+    struct sim_i2c_model_s *models;
+    // transfer started with _IT or _DMA, completes with the event
+    struct sim_event_s done;
+    void (*cplt) (I2C_HandleTypeDef *hi2c);
+    // statistics
+    uint32_t transfers;
+    uint32_t bytes;  /**< data bytes, without address and register address */
+    uint32_t nacks;
+    uint64_t busy_ns;
+};
+
+// links hi2c (the CubeMX handle of the target code) to the bus
+void sim_i2c_bus_init(struct sim_i2c_bus_s *self, I2C_HandleTypeDef *hi2c, uint32_t clock_hz);
+void sim_i2c_attach(struct sim_i2c_bus_s *self, struct sim_i2c_model_s *model);
+void sim_i2c_reset_stats(struct sim_i2c_bus_s *self);
+
+#endif
@@ -0,0 +1,164 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Model of the digital power monitor ISL28023 for the bus simulation */
+#include "sim_isl28023.h"
+#include <math.h>
+#include <string.h>
+#include "isl28023.h"
+
+enum sim_pmbus_kind
+{
+    SIM_PMBUS_NONE = 0, //unsupported, NACKed
+    SIM_PMBUS_SEND,     //command byte only
+    SIM_PMBUS_BYTE,
+    SIM_PMBUS_WORD,
+    SIM_PMBUS_BLOCK     //read only string
+};
+
+#define SIM_PMBUS_RO (0x80)
+
+static const uint8_t sim_isl28023_kind[256] = {
+    [ISL28023_REG_OPERATION] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_CLEAR_FAULTS] = SIM_PMBUS_SEND,
+    [ISL28023_REG_RESTORE_DEFAULT] = SIM_PMBUS_SEND,
+    [ISL28023_REG_CAPABILITY] = SIM_PMBUS_BYTE | SIM_PMBUS_RO,
+    [ISL28023_REG_SMBALERT_MASK] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_VOUT_MODE] = SIM_PMBUS_BYTE | SIM_PMBUS_RO,
+    [ISL28023_REG_IOUT_CAL_GAIN] = SIM_PMBUS_WORD,
+    [ISL28023_REG_STATUS_BYTE] = SIM_PMBUS_BYTE | SIM_PMBUS_RO,
+    [ISL28023_REG_STATUS_WORD] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_STATUS_VOUT] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_STATUS_IOUT] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_STATUS_TEMPERATURE] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_STATUS_CML] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_READ_VOUT] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_READ_IOUT] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_READ_TEMPERATURE_1] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_READ_POUT] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_PMBUS_REV] = SIM_PMBUS_BYTE | SIM_PMBUS_RO,
+    [ISL28023_REG_IC_DEVICE_ID] = SIM_PMBUS_BLOCK | SIM_PMBUS_RO,
+    [ISL28023_REG_IC_DEVICE_REV] = SIM_PMBUS_BLOCK | SIM_PMBUS_RO,
+    [ISL28023_REG_SET_DPM_MODE] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_DPM_CONV_STATUS] = SIM_PMBUS_BYTE | SIM_PMBUS_RO,
+    [ISL28023_REG_CONFIG_ICHANNEL] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_CONFIG_VCHANNEL] = SIM_PMBUS_WORD,
+    [ISL28023_REG_READ_VSHUNT_OUT] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_CONFIG_PEAK_DET] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_READ_PEAK_MIN_IOUT] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_READ_PEAK_MAX_IOUT] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_VOUT_OV_THRES_SET] = SIM_PMBUS_WORD,
+    [ISL28023_REG_VOUT_UV_THRES_SET] = SIM_PMBUS_WORD,
+    [ISL28023_REG_IOUT_OC_THRES_SET] = SIM_PMBUS_WORD,
+    [ISL28023_REG_CONFIG_INTR] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_FORCE_FEEDTHR_ALERT] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_SMBALERT2_MASK] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_READ_VSHUNT_OUT_AUX] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_READ_VOUT_AUX] = SIM_PMBUS_WORD | SIM_PMBUS_RO,
+    [ISL28023_REG_CONFIG_EXCITATION] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_SET_VOL_MARGIN] = SIM_PMBUS_WORD,
+    [ISL28023_REG_CONFIG_VOL_MARGIN] = SIM_PMBUS_BYTE,
+    [ISL28023_REG_CONFIG_EXT_CLK] = SIM_PMBUS_BYTE,
+};
+
+static void sim_isl28023_defaults(struct sim_isl28023_s *self)
+{
+    memset(self->value, 0, sizeof(self->value));
+    self->value[ISL28023_REG_OPERATION] = 0x80;
+    self->value[ISL28023_REG_PMBUS_REV] = 0x22;
+    self->value[ISL28023_REG_SET_DPM_MODE] = 0x07; //continuous, both channels
+}
+
+static const char *sim_isl28023_block(uint8_t command)
+{
+    return command == ISL28023_REG_IC_DEVICE_ID ? SIM_ISL28023_ID : "A";
+}
+
+static int8_t sim_isl28023_start(struct sim_i2c_model_s *m, uint8_t read)
+{
+    struct sim_isl28023_s *self = (struct sim_isl28023_s *)m;
+    self->addressed = !read;
+    self->index = 0;
+    return 0;
+}
+
+static int8_t sim_isl28023_write(struct sim_i2c_model_s *m, uint8_t data)
+{
+    struct sim_isl28023_s *self = (struct sim_isl28023_s *)m;
+    uint8_t kind = sim_isl28023_kind[self->command];
+    if (self->addressed)
+    {
+        self->addressed = 0;
+        if (!sim_isl28023_kind[data])
+            return -1;
+        self->command = data;
+        self->index = 0;
+        self->commands++;
+        if (data == ISL28023_REG_RESTORE_DEFAULT)
+            sim_isl28023_defaults(self);
+        else if (data == ISL28023_REG_CLEAR_FAULTS)
+        {
+            self->value[ISL28023_REG_STATUS_BYTE] = 0;
+            self->value[ISL28023_REG_STATUS_WORD] = 0;
+            self->value[ISL28023_REG_STATUS_VOUT] = 0;
+            self->value[ISL28023_REG_STATUS_IOUT] = 0;
+            self->value[ISL28023_REG_STATUS_TEMPERATURE] = 0;
+            self->value[ISL28023_REG_STATUS_CML] = 0;
+        }
+        return 0;
+    }
+    uint8_t size = ((kind & ~SIM_PMBUS_RO) == SIM_PMBUS_WORD) ? 2 : 1;
+    if ((kind & SIM_PMBUS_RO) || (kind & ~SIM_PMBUS_RO) == SIM_PMBUS_SEND || self->index >= size)
+        return -1;
+    uint16_t *v = &self->value[self->command];
+    if (self->index == 0)
+        *v = (*v & 0xFF00) | data;
+    else
+        *v = (*v & 0x00FF) | (data << 8);
+    self->index++;
+    return 0;
+}
+
+static uint8_t sim_isl28023_read(struct sim_i2c_model_s *m)
+{
+    struct sim_isl28023_s *self = (struct sim_isl28023_s *)m;
+    uint8_t kind = sim_isl28023_kind[self->command] & ~SIM_PMBUS_RO;
+    uint8_t i = self->index++;
+    if (kind == SIM_PMBUS_BLOCK)
+    {
+        const char *s = sim_isl28023_block(self->command);
+        uint8_t len = strlen(s);
+        return i == 0 ? len : (i <= len ? (uint8_t)s[i - 1] : 0xFF);
+    }
+    uint8_t size = (kind == SIM_PMBUS_WORD) ? 2 : (kind == SIM_PMBUS_BYTE ? 1 : 0);
+    if (i >= size)
+        return 0xFF; //nothing driven, pull-up
+    return (self->value[self->command] >> (8 * i)) & 0xFF;
+}
+
+static void sim_isl28023_stop(struct sim_i2c_model_s *m)
+{
+    ((struct sim_isl28023_s *)m)->addressed = 0;
+}
+
+void sim_isl28023_set_input(struct sim_isl28023_s *self, double vshunt, double vbus, double r_shunt)
+{
+    // LSBs as in isl28023_init: 2.5 uV shunt, 1 mV bus (60 V version), 80 mV/2^15 current
+    self->value[ISL28023_REG_READ_VSHUNT_OUT] = (uint16_t)(int16_t)lround(vshunt / 2.5e-6);
+    self->value[ISL28023_REG_READ_VOUT] = (uint16_t)lround(vbus / 1e-3);
+    self->value[ISL28023_REG_READ_IOUT] = (uint16_t)(int16_t)lround(vshunt / (80e-3 / 32768.0));
+    self->value[ISL28023_REG_READ_POUT] = (uint16_t)lround(vbus * vshunt / r_shunt / 1e-3); //mW
+}
+
+void sim_isl28023_init(struct sim_isl28023_s *self, uint8_t address)
+{
+    memset(self, 0, sizeof(*self));
+    self->model.address = address;
+    self->model.start = sim_isl28023_start;
+    self->model.write = sim_isl28023_write;
+    self->model.read = sim_isl28023_read;
+    self->model.stop = sim_isl28023_stop;
+    sim_isl28023_defaults(self);
+}
@@ -0,0 +1,33 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Model of the digital power monitor ISL28023 for the bus simulation */
+#ifndef SIM_ISL28023_H
+#define SIM_ISL28023_H
+
+#include <stdint.h>
+#include "sim_i2c.h"
+
+#define SIM_ISL28023_ID "ISL28023"
+
+// PMBus command set: a command byte, then the data of the command low byte
+// first. Words are two bytes, the ID registers are block reads with a count byte.
+struct sim_isl28023_s
+{
+    struct sim_i2c_model_s model;
+    uint16_t value[256];  /**< byte and word commands */
+    uint8_t command;
+    uint8_t index;        /**< byte of the command data on the bus */
+    uint8_t addressed;    /**< next written byte is the command byte */
+    uint32_t commands;    /**< commands received */
+};
+
+// defaults, address is the 7 bit address
+void sim_isl28023_init(struct sim_isl28023_s *self, uint8_t address);
+// sets the measurement registers for a shunt and bus voltage, the current as
+// seen with the full scale of the shunt channel (80 mV) over r_shunt
+void sim_isl28023_set_input(struct sim_isl28023_s *self, double vshunt, double vbus, double r_shunt);
+
+#endif
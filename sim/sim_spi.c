@@ -0,0 +1,237 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated SPI bus with chip models, behind the HAL SPI functions */
+#include "sim_spi.h"
+#include <string.h>
+
+// bytes of one data word in memory, like the HAL packs them
+static inline uint8_t sim_spi_word_size(uint8_t bits)
+{
+    return bits <= 8 ? 1 : (bits <= 16 ? 2 : 4);
+}
+
+// the chip whose CS is low, else the one on the hardware NSS
+static struct sim_spi_model_s *sim_spi_selected(struct sim_spi_bus_s *self)
+{
+    struct sim_spi_model_s *nss = NULL;
+    for (struct sim_spi_model_s *m = self->models; m; m = m->next)
+    {
+        if (!m->cs_port)
+            nss = m;
+        else if (HAL_GPIO_ReadPin(m->cs_port, m->cs_pin) == GPIO_PIN_RESET)
+            return m;
+    }
+    return nss;
+}
+
+static uint32_t sim_spi_sck(struct sim_spi_bus_s *self)
+{
+    if (!self->kernel_hz)
+        return self->clock_hz;
+    return self->kernel_hz >> ((self->hspi->Init.BaudRatePrescaler >> 28) + 1);
+}
+
+// Runs the frames through the selected chip at once and returns the bus time.
+static uint64_t sim_spi_run(struct sim_spi_bus_s *self, const uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+    SPI_HandleTypeDef *hspi = self->hspi;
+    struct sim_spi_model_s *model = sim_spi_selected(self);
+    uint8_t bits = hspi->Init.DataSize + 1;
+    uint8_t n = sim_spi_word_size(bits);
+    uint32_t mask = bits < 32 ? (1UL << bits) - 1 : 0xFFFFFFFFUL;
+
+    if (model && model->select)
+        model->select(model, 1);
+    for (uint16_t i = 0; i < Size; i++)
+    {
+        uint32_t mosi = 0;
+        if (pTxData)
+            memcpy(&mosi, pTxData + i * n, n); //little endian, like the target
+        uint32_t miso = model ? model->frame(model, mosi & mask, bits) : mask;
+        if (pRxData)
+        {
+            miso &= mask;
+            memcpy(pRxData + i * n, &miso, n);
+        }
+    }
+    if (model && model->select)
+        model->select(model, 0);
+    uint64_t t = self->setup_ns + sim_bits_ns((uint64_t)Size * bits, sim_spi_sck(self)) + (uint64_t)Size * self->cs_gap_ns;
+    self->transfers++;
+    self->frames += Size;
+    self->busy_ns += t;
+    hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+    return t;
+}
+
+static HAL_StatusTypeDef sim_spi_blocking(SPI_HandleTypeDef *hspi, const uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+    struct sim_spi_bus_s *self = (struct sim_spi_bus_s *)hspi->Instance;
+    if (hspi->State != HAL_SPI_STATE_READY)
+        return HAL_BUSY;
+    sim_advance_ns(sim_spi_run(self, pTxData, pRxData, Size));
+    return HAL_OK;
+}
+
+static void sim_spi_done(struct sim_event_s *ev)
+{
+    struct sim_spi_bus_s *self = (struct sim_spi_bus_s *)ev->ctx;
+    self->hspi->State = HAL_SPI_STATE_READY;
+    self->cplt(self->hspi);
+}
+
+// The chip sees the frames when the transfer starts, the completion interrupt follows after the bus time.
+static HAL_StatusTypeDef sim_spi_async(SPI_HandleTypeDef *hspi, const uint8_t *pTxData, uint8_t *pRxData, uint16_t Size,
+                                       HAL_SPI_StateTypeDef state, void (*cplt) (SPI_HandleTypeDef *hspi))
+{
+    struct sim_spi_bus_s *self = (struct sim_spi_bus_s *)hspi->Instance;
+    if (hspi->State != HAL_SPI_STATE_READY)
+        return HAL_BUSY;
+    uint64_t t = sim_spi_run(self, pTxData, pRxData, Size);
+    hspi->State = state;
+    self->cplt = cplt;
+    sim_schedule(&self->done, sim_now_ns() + t);
+    return HAL_OK;
+}
+
+static void sim_spi_txdr_write(struct sim_dma_sink_s *sink, uint32_t data)
+{
+    struct sim_spi_bus_s *self = (struct sim_spi_bus_s *)sink->ctx;
+    self->regs.TXDR = data;
+    if ((self->regs.CR1 & (SPI_CR1_SPE | SPI_CR1_CSTART)) != (SPI_CR1_SPE | SPI_CR1_CSTART))
+        return;
+    uint64_t now = sim_now_ns();
+    uint64_t t = sim_spi_run(self, (const uint8_t *)&data, NULL, 1) - self->setup_ns;
+    if (self->stream_busy_ns > now)
+    {
+        self->stalls++;
+        now = self->stream_busy_ns;
+    }
+    self->stream_busy_ns = now + t;
+}
+
+void sim_spi_bus_init(struct sim_spi_bus_s *self, SPI_HandleTypeDef *hspi, uint32_t clock_hz)
+{
+    memset(self, 0, sizeof(*self));
+    self->hspi = hspi;
+    self->clock_hz = clock_hz;
+    self->done.fire = sim_spi_done;
+    self->done.ctx = self;
+    self->regs.SR = SPI_SR_TXC | SPI_SR_SUSP;
+    self->txdr.addr = &self->regs.TXDR;
+    self->txdr.write = sim_spi_txdr_write;
+    self->txdr.ctx = self;
+    sim_dma_add_sink(&self->txdr);
+    hspi->Instance = &self->regs;
+    hspi->State = HAL_SPI_STATE_READY;
+    hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+}
+
+void sim_spi_attach(struct sim_spi_bus_s *self, struct sim_spi_model_s *model)
+{
+    model->next = self->models;
+    self->models = model;
+}
+
+void sim_spi_reset_stats(struct sim_spi_bus_s *self)
+{
+    self->transfers = 0;
+    self->frames = 0;
+    self->busy_ns = 0;
+    self->stalls = 0;
+}
+
+
+//// HAL
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi)
+{
+    hspi->State = HAL_SPI_STATE_READY;
+    hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi)
+{
+    sim_cancel(&((struct sim_spi_bus_s *)hspi->Instance)->done);
+    hspi->State = HAL_SPI_STATE_RESET;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    return sim_spi_blocking(hspi, pData, NULL, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    return sim_spi_blocking(hspi, NULL, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout)
+{
+    (void)Timeout;
+    return sim_spi_blocking(hspi, pTxData, pRxData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+    return sim_spi_async(hspi, pData, NULL, Size, HAL_SPI_STATE_BUSY_TX, HAL_SPI_TxCpltCallback);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+    return sim_spi_async(hspi, NULL, pData, Size, HAL_SPI_STATE_BUSY_RX, HAL_SPI_RxCpltCallback);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_IT(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+    return sim_spi_async(hspi, pTxData, pRxData, Size, HAL_SPI_STATE_BUSY_TX_RX, HAL_SPI_TxRxCpltCallback);
+}
+
+// DMA and interrupt transfers only differ in the CPU load, which is not simulated
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+    return HAL_SPI_Transmit_IT(hspi, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size)
+{
+    return HAL_SPI_Receive_IT(hspi, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size)
+{
+    return HAL_SPI_TransmitReceive_IT(hspi, pTxData, pRxData, Size);
+}
+
+// blocking like the HAL one, no callback
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi)
+{
+    sim_cancel(&((struct sim_spi_bus_s *)hspi->Instance)->done);
+    hspi->State = HAL_SPI_STATE_READY;
+    hspi->ErrorCode = HAL_SPI_ERROR_ABORT;
+    return HAL_OK;
+}
+
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi)
+{
+    sim_poll();
+    return hspi->State;
+}
+
+uint32_t HAL_SPI_GetError(SPI_HandleTypeDef *hspi)
+{
+    return hspi->ErrorCode;
+}
+
+// overridden by bus/spi_hal.c if it is linked
+__attribute__((weak)) void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
+__attribute__((weak)) void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) { (void)hspi; }
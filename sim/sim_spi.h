@@ -0,0 +1,62 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated SPI bus with chip models, behind the HAL SPI functions */
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include <stdint.h>
+#include "stm32h7xx_hal.h"
+#include "sim.h"
+#include "sim_dma.h"
+
+// Every data word of hspi->Init.DataSize bits is one frame with chip select
+// asserted (hardware NSS pulse mode), the chip returns the word it shifts out
+// at the same time. Embedded as first member of the model. A model with
+// cs_port set only sees the transfers while its software CS pin is low, one
+// without takes those where no such pin is low. select, if set, is called with
+// 1 before and 0 after the words of a transfer, the chip select window in which
+// a model made of shorter words assembles its frames.
+struct sim_spi_model_s
+{
+    uint32_t (*frame) (struct sim_spi_model_s *self, uint32_t mosi, uint8_t bits);
+    void (*select) (struct sim_spi_model_s *self, uint8_t selected);
+    GPIO_TypeDef *cs_port;
+    uint16_t cs_pin;
+    struct sim_spi_model_s *next;
+};
+
+// Timing: data bits at the SCK, cs_gap_ns between the frames, plus setup_ns per
+// transfer. SCK is clock_hz, or kernel_hz divided by the prescaler of the
+// handle if kernel_hz is set. Transfers started with _IT or _DMA complete with
+// the done event after that time. In the streaming mode (SPE and CSTART set by
+// the target code) every word a DMA writes to TXDR is a frame.
+struct sim_spi_bus_s
+{
+    SPI_TypeDef regs;
+    SPI_HandleTypeDef *hspi;
+    uint32_t clock_hz; /**< SCK */
+    uint32_t kernel_hz;
+    uint32_t cs_gap_ns;
+    uint32_t setup_ns;
+    struct sim_spi_model_s *models;
+    struct sim_event_s done;
+    void (*cplt) (SPI_HandleTypeDef *hspi);
+    struct sim_dma_sink_s txdr;
+    uint64_t stream_busy_ns; /**< end of the last streamed frame */
+    // statistics
+    uint32_t transfers;
+    uint32_t frames;
+    uint64_t busy_ns;
+    uint32_t stalls; /**< streamed frames written before the previous one was out */
+};
+
+// links hspi (the CubeMX handle of the target code) to the bus
+void sim_spi_bus_init(struct sim_spi_bus_s *self, SPI_HandleTypeDef *hspi, uint32_t clock_hz);
+// set cs_port and cs_pin of the model before, if it has a software CS
+void sim_spi_attach(struct sim_spi_bus_s *self, struct sim_spi_model_s *model);
+void sim_spi_reset_stats(struct sim_spi_bus_s *self);
+
+#endif
@@ -0,0 +1,67 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Model of the I/O expander TCA9534 for the bus simulation */
+#include "sim_tca9534.h"
+#include <string.h>
+
+// The command byte selects the register, it does not increment: further bytes
+// of a write go to the same register and a read returns it repeatedly.
+
+uint8_t sim_tca9534_levels(const struct sim_tca9534_s *self)
+{
+    uint8_t in = self->reg[3];
+    return (self->pins & in) | (self->reg[1] & ~in);
+}
+
+static int8_t sim_tca9534_start(struct sim_i2c_model_s *m, uint8_t read)
+{
+    struct sim_tca9534_s *self = (struct sim_tca9534_s *)m;
+    self->addressed = !read;
+    return 0;
+}
+
+static int8_t sim_tca9534_write(struct sim_i2c_model_s *m, uint8_t data)
+{
+    struct sim_tca9534_s *self = (struct sim_tca9534_s *)m;
+    if (self->addressed)
+    {
+        self->addressed = 0;
+        if (data > 3)
+            return -1;
+        self->pointer = data;
+        return 0;
+    }
+    if (self->pointer != 0) //the input port is read only
+        self->reg[self->pointer] = data;
+    self->writes++;
+    return 0;
+}
+
+static uint8_t sim_tca9534_read(struct sim_i2c_model_s *m)
+{
+    struct sim_tca9534_s *self = (struct sim_tca9534_s *)m;
+    if (self->pointer == 0)
+        return sim_tca9534_levels(self) ^ self->reg[2];
+    return self->reg[self->pointer];
+}
+
+static void sim_tca9534_stop(struct sim_i2c_model_s *m)
+{
+    ((struct sim_tca9534_s *)m)->addressed = 0;
+}
+
+void sim_tca9534_init(struct sim_tca9534_s *self, uint8_t address)
+{
+    memset(self, 0, sizeof(*self));
+    self->model.address = address;
+    self->model.start = sim_tca9534_start;
+    self->model.write = sim_tca9534_write;
+    self->model.read = sim_tca9534_read;
+    self->model.stop = sim_tca9534_stop;
+    self->reg[1] = 0xFF;
+    self->reg[3] = 0xFF;
+    self->pins = 0xFF; //pull-ups
+}
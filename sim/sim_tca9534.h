@@ -0,0 +1,28 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Model of the I/O expander TCA9534 for the bus simulation */
+#ifndef SIM_TCA9534_H
+#define SIM_TCA9534_H
+
+#include <stdint.h>
+#include "sim_i2c.h"
+
+struct sim_tca9534_s
+{
+    struct sim_i2c_model_s model;
+    uint8_t reg[4];   /**< input, output, polarity inversion, configuration (1: input) */
+    uint8_t pins;     /**< level driven from outside on the input pins */
+    uint8_t pointer;  /**< command byte, the register addressed by reads and writes */
+    uint8_t addressed; /**< next written byte is the command byte */
+    uint32_t writes;  /**< register writes, to check for redundant bus traffic */
+};
+
+// power-on state, address is the 7 bit address
+void sim_tca9534_init(struct sim_tca9534_s *self, uint8_t address);
+// level of all pins: the outputs where configured as output, pins elsewhere
+uint8_t sim_tca9534_levels(const struct sim_tca9534_s *self);
+
+#endif
@@ -0,0 +1,160 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated timer update events, behind the HAL TIM functions */
+#include "sim_tim.h"
+#include "sim_dma.h"
+#include <string.h>
+
+// from the start in clocks, so the period does not drift by rounding
+static void sim_tim_schedule(struct sim_tim_s *self)
+{
+    self->ticks += (uint64_t)(self->regs.PSC + 1) * (self->regs.ARR + 1);
+    sim_schedule(&self->update, self->t0_ns + self->ticks * 1000000000ULL / self->clock_hz);
+}
+
+static void sim_tim_output(struct sim_tim_output_s *out, uint8_t level)
+{
+    if (out->level == level)
+        return;
+    out->level = level;
+    if (out->edge)
+        out->edge(out->ctx, level);
+}
+
+static void sim_tim_compare(struct sim_event_s *ev)
+{
+    sim_tim_output((struct sim_tim_output_s *)ev->ctx, 0);
+}
+
+// counter at 0: the enabled outputs go high until their compare match
+static void sim_tim_period(struct sim_tim_s *self)
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        if (!(self->regs.CCER & TIM_CCER_CCxE(i << 2)))
+            continue;
+        uint32_t ccr = (&self->regs.CCR1)[i];
+        sim_tim_output(&self->out[i], ccr > 0);
+        if (ccr > 0 && ccr <= self->regs.ARR)
+            sim_schedule(&self->out[i].compare,
+                         sim_now_ns() + (uint64_t)ccr * (self->regs.PSC + 1) * 1000000000ULL / self->clock_hz);
+    }
+}
+
+static void sim_tim_update(struct sim_event_s *ev)
+{
+    struct sim_tim_s *self = (struct sim_tim_s *)ev->ctx;
+    if (!(self->regs.CR1 & TIM_CR1_CEN))
+        return;
+    self->updates++;
+    sim_tim_schedule(self);
+    sim_tim_period(self);
+    if (self->regs.DIER & TIM_DMA_UPDATE)
+        sim_dma_request(self->htim->hdma[TIM_DMA_ID_UPDATE]);
+    if (self->regs.DIER & TIM_IT_UPDATE)
+        HAL_TIM_PeriodElapsedCallback(self->htim);
+}
+
+static HAL_StatusTypeDef sim_tim_start(TIM_HandleTypeDef *htim, uint32_t it)
+{
+    struct sim_tim_s *self = (struct sim_tim_s *)htim->Instance;
+    if (htim->State != HAL_TIM_STATE_READY)
+        return HAL_BUSY;
+    htim->State = HAL_TIM_STATE_BUSY;
+    self->regs.DIER |= it;
+    self->regs.CR1 |= TIM_CR1_CEN;
+    self->t0_ns = sim_now_ns();
+    self->ticks = 0;
+    sim_tim_schedule(self);
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef sim_tim_stop(TIM_HandleTypeDef *htim, uint32_t it)
+{
+    struct sim_tim_s *self = (struct sim_tim_s *)htim->Instance;
+    self->regs.DIER &= ~it;
+    self->regs.CR1 &= ~TIM_CR1_CEN;
+    sim_cancel(&self->update);
+    htim->State = HAL_TIM_STATE_READY;
+    return HAL_OK;
+}
+
+void sim_tim_init(struct sim_tim_s *self, TIM_HandleTypeDef *htim, uint32_t clock_hz)
+{
+    memset(self, 0, sizeof(*self));
+    self->htim = htim;
+    self->clock_hz = clock_hz;
+    self->update.fire = sim_tim_update;
+    self->update.ctx = self;
+    self->regs.PSC = htim->Init.Prescaler;
+    self->regs.ARR = htim->Init.Period;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        self->out[i].compare.fire = sim_tim_compare;
+        self->out[i].compare.ctx = &self->out[i];
+    }
+    htim->Instance = &self->regs;
+    htim->State = HAL_TIM_STATE_READY;
+}
+
+
+//// HAL
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim)
+{
+    return sim_tim_start(htim, 0);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop(TIM_HandleTypeDef *htim)
+{
+    return sim_tim_stop(htim, 0);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim)
+{
+    return sim_tim_start(htim, TIM_IT_UPDATE);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim)
+{
+    return sim_tim_stop(htim, TIM_IT_UPDATE);
+}
+
+// like the HAL: the channel output is enabled and the counter runs, it stops
+// with the last channel unless the base timer was started
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+    struct sim_tim_s *self = (struct sim_tim_s *)htim->Instance;
+    if (self->regs.CCER & TIM_CCER_CCxE(Channel))
+        return HAL_ERROR;
+    self->regs.CCER |= TIM_CCER_CCxE(Channel);
+    if (!(self->regs.CR1 & TIM_CR1_CEN))
+    {
+        self->regs.CR1 |= TIM_CR1_CEN;
+        self->t0_ns = sim_now_ns();
+        self->ticks = 0;
+        sim_tim_schedule(self);
+        sim_tim_period(self);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+    struct sim_tim_s *self = (struct sim_tim_s *)htim->Instance;
+    struct sim_tim_output_s *out = &self->out[Channel >> 2];
+    self->regs.CCER &= ~TIM_CCER_CCxE(Channel);
+    sim_cancel(&out->compare);
+    sim_tim_output(out, 0);
+    if (!self->regs.CCER && htim->State == HAL_TIM_STATE_READY)
+    {
+        self->regs.CR1 &= ~TIM_CR1_CEN;
+        sim_cancel(&self->update);
+    }
+    return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) { (void)htim; }
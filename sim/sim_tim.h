@@ -0,0 +1,42 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Simulated timer update events, behind the HAL TIM functions */
+#ifndef SIM_TIM_H
+#define SIM_TIM_H
+
+#include <stdint.h>
+#include "stm32h7xx_hal.h"
+#include "sim.h"
+
+// Update events every (PSC + 1) * (ARR + 1) clocks of clock_hz while CEN is
+// set. They request the DMA of TIM_DMA_ID_UPDATE if UDE is set in DIER and
+// call HAL_TIM_PeriodElapsedCallback if the interrupt is enabled.
+// A channel started with HAL_TIM_PWM_Start (PWM mode 1) is high from the update
+// event to the compare match with CCRx, edge reports its level changes.
+struct sim_tim_output_s
+{
+    void (*edge) (void *ctx, uint8_t level);
+    void *ctx;
+    uint8_t level;
+    struct sim_event_s compare;
+};
+
+struct sim_tim_s
+{
+    TIM_TypeDef regs;
+    TIM_HandleTypeDef *htim;
+    uint32_t clock_hz;
+    struct sim_event_s update;
+    uint64_t t0_ns;   /**< time of the start */
+    uint64_t ticks;   /**< clocks from the start to the next update */
+    uint64_t updates;
+    struct sim_tim_output_s out[4]; /**< TIM_CHANNEL_x >> 2 */
+};
+
+// links htim (the CubeMX handle of the target code) to the timer
+void sim_tim_init(struct sim_tim_s *self, TIM_HandleTypeDef *htim, uint32_t clock_hz);
+
+#endif
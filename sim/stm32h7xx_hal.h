@@ -0,0 +1,378 @@
+// Copyright 2019-2021, Reinhard Feger,
+// Institute for Communications Engineering and RF-Systems,
+// Johannes Kepler University Linz, Austria and all contributors
+// SPDX-License-Identifier: MIT
+
+/* Host replacement of the STM32H7 HAL for the bus simulation */
+#ifndef SIM_STM32H7XX_HAL_H
+#define SIM_STM32H7XX_HAL_H
+
+// Only what the bus drivers and the chip drivers on top of them use. The I2C
+// and SPI functions are implemented by sim_i2c.c and sim_spi.c, the tick and
+// the cycle counter by sim.c, DMA and timers by sim_dma.c and sim_tim.c. Put
+// this directory first on the include path.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+typedef enum
+{
+    HAL_OK = 0x00,
+    HAL_ERROR = 0x01,
+    HAL_BUSY = 0x02,
+    HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY (0xFFFFFFFFU)
+#define UNUSED(X) (void)X
+
+#define SET_BIT(REG, BIT) ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT) ((REG) & (BIT))
+#define WRITE_REG(REG, VAL) ((REG) = (VAL))
+#define MODIFY_REG(REG, CLEARMASK, SETMASK) WRITE_REG((REG), (((REG) & (~(CLEARMASK))) | (SETMASK)))
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+// core, the simulation runs in one thread and calls the "interrupts" itself
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t priMask) { (void)priMask; }
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+    volatile uint32_t LAR;
+} DWT_Type;
+
+typedef struct
+{
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+// every access to the cycle counter costs a few ns, so busy waits on it end
+DWT_Type *sim_dwt_access(void);
+extern CoreDebug_Type sim_core_debug;
+#define DWT (sim_dwt_access())
+#define CoreDebug (&sim_core_debug)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL)
+extern uint32_t SystemCoreClock;
+
+// GPIO, outputs are open drain, a pin reads low if driven low or if the
+// simulation holds it low from outside (a slave stuck on SDA)
+typedef struct
+{
+    volatile uint32_t ODR;
+    uint32_t held_low; //pins pulled low externally
+} GPIO_TypeDef;
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_MODE_INPUT (0x00000000U)
+#define GPIO_MODE_OUTPUT_PP (0x00000001U)
+#define GPIO_MODE_OUTPUT_OD (0x00000011U)
+#define GPIO_MODE_AF_OD (0x00000012U)
+#define GPIO_NOPULL (0x00000000U)
+#define GPIO_PULLUP (0x00000001U)
+#define GPIO_SPEED_FREQ_LOW (0x00000000U)
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+// DMA, addresses are uintptr_t here, the target code casts pointers to them.
+// One data item is a word, the requests come from sim_dma_request (sim_dma.h).
+typedef enum
+{
+    HAL_DMA_STATE_RESET = 0x00,
+    HAL_DMA_STATE_READY = 0x01,
+    HAL_DMA_STATE_BUSY = 0x02
+} HAL_DMA_StateTypeDef;
+
+#define DMA_NORMAL (0x00000000U)
+#define DMA_CIRCULAR (0x00000100U)
+#define HAL_DMA_ERROR_NONE (0x00000000U)
+
+typedef struct
+{
+    uint32_t Mode;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef
+{
+    void *Instance;
+    DMA_InitTypeDef Init;
+    volatile HAL_DMA_StateTypeDef State;
+    void *Parent;
+    void (*XferCpltCallback) (struct __DMA_HandleTypeDef *hdma);
+    void (*XferHalfCpltCallback) (struct __DMA_HandleTypeDef *hdma);
+    void (*XferErrorCallback) (struct __DMA_HandleTypeDef *hdma);
+    volatile uint32_t ErrorCode;
+    // simulation
+    uintptr_t src, dst;
+    uint32_t length, index;
+} DMA_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uintptr_t SrcAddress, uintptr_t DstAddress, uint32_t DataLength);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma);
+
+// TIM, the counter is not simulated, only the update events and PWM edges
+typedef struct
+{
+    volatile uint32_t CR1;
+    volatile uint32_t DIER;
+    volatile uint32_t SR;
+    volatile uint32_t CCER;
+    volatile uint32_t CNT;
+    volatile uint32_t PSC;
+    volatile uint32_t ARR;
+    volatile uint32_t CCR1;
+    volatile uint32_t CCR2;
+    volatile uint32_t CCR3;
+    volatile uint32_t CCR4;
+} TIM_TypeDef;
+
+#define TIM_CR1_CEN (1UL << 0)
+#define TIM_IT_UPDATE (1UL << 0)
+#define TIM_DMA_UPDATE (1UL << 8)
+#define TIM_DMA_ID_UPDATE (0)
+#define TIM_CHANNEL_1 (0x00000000U)
+#define TIM_CHANNEL_2 (0x00000004U)
+#define TIM_CHANNEL_3 (0x00000008U)
+#define TIM_CHANNEL_4 (0x0000000CU)
+#define TIM_CCER_CCxE(ch) (1UL << (ch))
+
+typedef enum
+{
+    HAL_TIM_STATE_RESET = 0x00,
+    HAL_TIM_STATE_READY = 0x01,
+    HAL_TIM_STATE_BUSY = 0x02
+} HAL_TIM_StateTypeDef;
+
+typedef struct
+{
+    uint32_t Prescaler;
+    uint32_t Period;
+} TIM_Base_InitTypeDef;
+
+typedef struct __TIM_HandleTypeDef
+{
+    TIM_TypeDef *Instance; //first member of struct sim_tim_s
+    TIM_Base_InitTypeDef Init;
+    DMA_HandleTypeDef *hdma[7];
+    volatile HAL_TIM_StateTypeDef State;
+} TIM_HandleTypeDef;
+
+#define __HAL_TIM_ENABLE_DMA(h, d) ((h)->Instance->DIER |= (d))
+#define __HAL_TIM_DISABLE_DMA(h, d) ((h)->Instance->DIER &= ~(d))
+#define __HAL_TIM_GET_AUTORELOAD(h) ((h)->Instance->ARR)
+#define __HAL_TIM_SET_COMPARE(h, ch, v) ((&(h)->Instance->CCR1)[(ch) >> 2] = (v))
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
+
+// I2C
+typedef enum
+{
+    HAL_I2C_STATE_RESET = 0x00,
+    HAL_I2C_STATE_READY = 0x20,
+    HAL_I2C_STATE_BUSY = 0x24,
+    HAL_I2C_STATE_BUSY_TX = 0x21,
+    HAL_I2C_STATE_BUSY_RX = 0x22,
+    HAL_I2C_STATE_ABORT = 0x60
+} HAL_I2C_StateTypeDef;
+
+typedef enum
+{
+    HAL_I2C_MODE_NONE = 0x00,
+    HAL_I2C_MODE_MASTER = 0x10,
+    HAL_I2C_MODE_MEM = 0x40
+} HAL_I2C_ModeTypeDef;
+
+#define HAL_I2C_ERROR_NONE (0x00000000U)
+#define HAL_I2C_ERROR_BERR (0x00000001U)
+#define HAL_I2C_ERROR_ARLO (0x00000002U)
+#define HAL_I2C_ERROR_AF (0x00000004U)
+#define HAL_I2C_ERROR_OVR (0x00000008U)
+#define HAL_I2C_ERROR_DMA (0x00000010U)
+#define HAL_I2C_ERROR_TIMEOUT (0x00000020U)
+
+#define I2C_MEMADD_SIZE_8BIT (0x00000001U)
+#define I2C_MEMADD_SIZE_16BIT (0x00000002U)
+
+typedef struct
+{
+    uint32_t Timing;
+    uint32_t OwnAddress1;
+    uint32_t AddressingMode;
+} I2C_InitTypeDef;
+
+typedef struct __I2C_HandleTypeDef
+{
+    void *Instance; //struct sim_i2c_bus_s
+    I2C_InitTypeDef Init;
+    DMA_HandleTypeDef *hdmatx;
+    DMA_HandleTypeDef *hdmarx;
+    volatile HAL_I2C_StateTypeDef State;
+    volatile HAL_I2C_ModeTypeDef Mode;
+    volatile uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c, uint16_t DevAddress);
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c);
+HAL_I2C_ModeTypeDef HAL_I2C_GetMode(I2C_HandleTypeDef *hi2c);
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c);
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c);
+
+// SPI
+typedef enum
+{
+    HAL_SPI_STATE_RESET = 0x00,
+    HAL_SPI_STATE_READY = 0x01,
+    HAL_SPI_STATE_BUSY = 0x02,
+    HAL_SPI_STATE_BUSY_TX = 0x03,
+    HAL_SPI_STATE_BUSY_RX = 0x04,
+    HAL_SPI_STATE_BUSY_TX_RX = 0x05,
+    HAL_SPI_STATE_ABORT = 0x07
+} HAL_SPI_StateTypeDef;
+
+#define HAL_SPI_ERROR_NONE (0x00000000U)
+#define HAL_SPI_ERROR_MODF (0x00000001U)
+#define HAL_SPI_ERROR_OVR (0x00000004U)
+#define HAL_SPI_ERROR_DMA (0x00000010U)
+#define HAL_SPI_ERROR_ABORT (0x00000040U)
+#define HAL_SPI_ERROR_TIMEOUT (0x00000100U)
+
+// number of bits - 1, like the DSIZE field
+#define SPI_DATASIZE_8BIT (0x00000007U)
+#define SPI_DATASIZE_16BIT (0x0000000FU)
+#define SPI_DATASIZE_24BIT (0x00000017U)
+#define SPI_DATASIZE_32BIT (0x0000001FU)
+
+#define SPI_POLARITY_LOW (0x00000000U)
+#define SPI_POLARITY_HIGH (0x02000000U)
+#define SPI_PHASE_1EDGE (0x00000000U)
+#define SPI_PHASE_2EDGE (0x01000000U)
+
+// MBR field, SCK is the kernel clock / 2^(MBR + 1)
+#define SPI_BAUDRATEPRESCALER_2 (0x00000000U)
+#define SPI_BAUDRATEPRESCALER_4 (0x10000000U)
+#define SPI_BAUDRATEPRESCALER_8 (0x20000000U)
+#define SPI_BAUDRATEPRESCALER_16 (0x30000000U)
+#define SPI_BAUDRATEPRESCALER_32 (0x40000000U)
+#define SPI_BAUDRATEPRESCALER_64 (0x50000000U)
+#define SPI_BAUDRATEPRESCALER_128 (0x60000000U)
+#define SPI_BAUDRATEPRESCALER_256 (0x70000000U)
+
+typedef struct
+{
+    uint32_t Mode;
+    uint32_t DataSize;
+    uint32_t CLKPolarity;
+    uint32_t CLKPhase;
+    uint32_t BaudRatePrescaler;
+} SPI_InitTypeDef;
+
+// registers used by the streaming mode, SR keeps TXC and SUSP set since the
+// frames are on the wire at once
+typedef struct
+{
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t CFG1;
+    volatile uint32_t CFG2;
+    volatile uint32_t IER;
+    volatile uint32_t SR;
+    volatile uint32_t IFCR;
+    volatile uint32_t TXDR;
+    volatile uint32_t RXDR;
+} SPI_TypeDef;
+
+#define SPI_CR1_SPE (1UL << 0)
+#define SPI_CR1_CSTART (1UL << 9)
+#define SPI_CR1_CSUSP (1UL << 10)
+#define SPI_CR2_TSIZE (0xFFFFUL)
+#define SPI_CFG2_COMM (3UL << 17)
+#define SPI_CFG2_COMM_0 (1UL << 17)
+#define SPI_SR_SUSP (1UL << 11)
+#define SPI_SR_TXC (1UL << 12)
+#define SPI_IFCR_SUSPC (1UL << 11)
+
+#define __HAL_SPI_ENABLE(h) SET_BIT((h)->Instance->CR1, SPI_CR1_SPE)
+#define __HAL_SPI_DISABLE(h) CLEAR_BIT((h)->Instance->CR1, SPI_CR1_SPE)
+
+typedef struct __SPI_HandleTypeDef
+{
+    SPI_TypeDef *Instance; //first member of struct sim_spi_bus_s
+    SPI_InitTypeDef Init;
+    DMA_HandleTypeDef *hdmatx;
+    DMA_HandleTypeDef *hdmarx;
+    volatile HAL_SPI_StateTypeDef State;
+    volatile uint32_t ErrorCode;
+} SPI_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Receive_IT(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_IT(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi);
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi);
+uint32_t HAL_SPI_GetError(SPI_HandleTypeDef *hspi);
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
+
+#endif
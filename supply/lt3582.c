@@ -8,18 +8,37 @@
 #include <errno.h>
 #include <math.h>
 
+// CMDR holds self clearing command bits, it is written every time
+static const uint8_t lt3582_policy[LT3582_NUM_REGS] = {
+    REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_WRITE_ONLY, REGMAP_VOLATILE
+};
+
+static int8_t lt3582_regmap_write(struct regmap_s *map, uint16_t reg, uint16_t val16)
+{
+    struct lt3582_dev_s *self = (struct lt3582_dev_s *)map->ctx;
+    uint8_t val = (uint8_t)val16;
+    // supply changes are control writes, they go ahead of measurements on the bus
+    struct i2c_xfer_s xfer = {
+        .op = I2C_XFER_MEM_WRITE, .dev_address = self->hw_adr, .mem_address = reg,
+        .mem_add_size = I2C_MEMADD_SIZE_8BIT, .data = &val, .size = 1, .prio = I2C_PRIO_URGENT
+    };
+    return self->i2c_dev->transfer(self->i2c_dev, &xfer, I2C_TIMEOUT_MS);
+}
+
 void lt3582_init(struct lt3582_dev_s *self, struct i2c_dev_s *i2c_dev, uint8_t hw_adr)
 {
     self->i2c_dev = i2c_dev;
     self->setVoltages = &lt3582_setVoltages;
     self->hw_adr = hw_adr;
+    regmap_init(&self->map, self->reg, self->reg_dirty, self->reg_valid, LT3582_NUM_REGS, lt3582_policy);
+    self->map.ctx = self;
+    self->map.write_reg = &lt3582_regmap_write;
+    self->map.read_reg = NULL;
 }
 
 int8_t lt3582_writeReg(struct lt3582_dev_s *self, uint8_t adr, uint8_t val)
 {
-    int8_t result;
-    result = self->i2c_dev->mem_write(self->i2c_dev, self->hw_adr, adr, 1, &val, 1, 0xFFFFFFFF);    
-    return result;
+    return regmap_write(&self->map, adr, val);
 }
 
 int8_t lt3582_setVoltages(struct lt3582_dev_s *self, float_t volt_p, float_t volt_n)
@@ -33,17 +52,14 @@ int8_t lt3582_setVoltages(struct lt3582_dev_s *self, float_t volt_p, float_t vol
     else
         vplusbit=1;
     
-    self->reg0=reg0val;//136;
-    error += lt3582_writeReg(self, LT3582_REG0_ADR, self->reg0);
-        
-    self->reg1=(uint8_t)(-(volt_n+1.2)/50e-3);//176;
-    error += lt3582_writeReg(self, LT3582_REG1_ADR, self->reg1);
-
-    self->reg2 = (vplusbit<<LT3582_VPLUS_BIT_NUM) | (1<<LT3582_PDDIS_BIT_NUM) | LT3582_PUSEQ_MASK;
-    error += lt3582_writeReg(self, LT3582_REG2_ADR, self->reg2);
-
-    self->cmdr = (1<<LT3582_RSEL2_BIT_NUM) | (1<<LT3582_RSEL1_BIT_NUM) | (1<<LT3582_RSEL0_BIT_NUM);
-    error += lt3582_writeReg(self, LT3582_CMDR_ADR, self->cmdr);
+    // staged first, only registers that changed since the last call are sent
+    error += regmap_set(&self->map, LT3582_REG0_ADR, reg0val);//136;
+    error += regmap_set(&self->map, LT3582_REG1_ADR, (uint8_t)(-(volt_n+1.2)/50e-3));//176;
+    error += regmap_set(&self->map, LT3582_REG2_ADR,
+                        (vplusbit<<LT3582_VPLUS_BIT_NUM) | (1<<LT3582_PDDIS_BIT_NUM) | LT3582_PUSEQ_MASK);
+    error += regmap_set(&self->map, LT3582_CMDR_ADR,
+                        (1<<LT3582_RSEL2_BIT_NUM) | (1<<LT3582_RSEL1_BIT_NUM) | (1<<LT3582_RSEL0_BIT_NUM));
+    error += regmap_sync(&self->map);
     
     if(error)
     {
@@ -9,12 +9,14 @@
 
 #include <stdint.h>
 #include "i2c_hal.h"
+#include "regmap.h"
 
 /* Register addresses */
 #define LT3582_REG0_ADR (0x0)
 #define LT3582_REG1_ADR (0x1)
 #define LT3582_REG2_ADR (0x2)
 #define LT3582_CMDR_ADR (0x4)
+#define LT3582_NUM_REGS (5)
 
 /* REG2 entries: BIT_NUM: position of LSB of corresponding value, MASK covers all bits of corresponding value */
 #define LT3582_LOCK_BIT_NUM (6u)
@@ -40,10 +42,14 @@ struct lt3582_dev_s
     struct i2c_dev_s *i2c_dev; /**< I2C device */
     int8_t (*setVoltages) (struct lt3582_dev_s *self, float_t volt_p, float_t volt_n);
     uint8_t hw_adr; /**< hardware address of chip */
-    uint8_t reg0; /**< VOUTP Output Voltage (00h=3.2V, BFh = 12.75V) */
-    uint8_t reg1; /**< VOUTN Output Voltage (00h=1.2V, FFh = 13.95V) */
-    uint8_t reg2; /**< Lockout bit, 25mV increase Voutp, RAMP pull-up current, power down discharge EN, power up sequencing */
-    uint8_t cmdr; /**< write OTP, clr/progr fault, RST, switches off, REG select (OTP or REG) */
+    struct regmap_s map; /**< shadow of the registers, unchanged ones are not written again */
+    // REG0: VOUTP Output Voltage (00h=3.2V, BFh = 12.75V)
+    // REG1: VOUTN Output Voltage (00h=1.2V, FFh = 13.95V)
+    // REG2: Lockout bit, 25mV increase Voutp, RAMP pull-up current, power down discharge EN, power up sequencing
+    // CMDR: write OTP, clr/progr fault, RST, switches off, REG select (OTP or REG)
+    uint16_t reg[LT3582_NUM_REGS];
+    uint32_t reg_dirty[REGMAP_BITMAP_WORDS(LT3582_NUM_REGS)];
+    uint32_t reg_valid[REGMAP_BITMAP_WORDS(LT3582_NUM_REGS)];
 };
 
 int8_t lt3582_writeReg(struct lt3582_dev_s *self, uint8_t adr, uint8_t val);
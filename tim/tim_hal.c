@@ -15,6 +15,10 @@ int8_t tim_set_period(struct tim_dev_s *self, uint16_t Period);
 int8_t tim_set_freq(struct tim_dev_s *self, uint32_t Freq);
 int8_t tim_start(struct tim_dev_s *self);
 int8_t tim_stop(struct tim_dev_s *self);
+int8_t tim_start_dma_request(struct tim_dev_s *self);
+int8_t tim_stop_dma_request(struct tim_dev_s *self);
+int8_t tim_start_pwm(struct tim_dev_s *self, uint32_t Channel, uint16_t duty);
+int8_t tim_stop_pwm(struct tim_dev_s *self, uint32_t Channel);
 
 void tim_dev_init(struct tim_dev_s *self, TIM_HandleTypeDef *htim)
 {
@@ -24,6 +28,10 @@ void tim_dev_init(struct tim_dev_s *self, TIM_HandleTypeDef *htim)
     self->set_freq = &tim_set_freq;
     self->start = &tim_start;
     self->stop = &tim_stop;
+    self->start_dma_request = &tim_start_dma_request;
+    self->stop_dma_request = &tim_stop_dma_request;
+    self->start_pwm = &tim_start_pwm;
+    self->stop_pwm = &tim_stop_pwm;
 }
 
 int8_t tim_set_prescaler(struct tim_dev_s *self, uint16_t Prescaler)
@@ -44,7 +52,11 @@ int8_t tim_set_period(struct tim_dev_s *self, uint16_t Period)
 
 int8_t tim_set_freq(struct tim_dev_s *self, uint32_t Freq)
 {
-    //TODO: check for errors/limits
+    if(Freq < TIM_FREQ_MIN || Freq > TIM_FREQ_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
     //TODO: read clock configuration    
     //Update Frequency = TIM_CLOCK / ((Prescaler+1)*(Period+1)) 
     //assuming 240 MHz time clock
@@ -84,4 +96,66 @@ int8_t tim_stop(struct tim_dev_s *self)
         errno = 0;
         return 0;
     }
-}
\ No newline at end of file
+}
+
+int8_t tim_start_dma_request(struct tim_dev_s *self)
+{
+    __HAL_TIM_ENABLE_DMA(self->htim, TIM_DMA_UPDATE);
+    if(HAL_TIM_Base_Start(self->htim) != HAL_OK)
+    {
+        __HAL_TIM_DISABLE_DMA(self->htim, TIM_DMA_UPDATE);
+        errno = EBUSY;
+        return -1;
+    }
+    else
+    {
+        errno = 0;
+        return 0;
+    }
+}
+
+int8_t tim_stop_dma_request(struct tim_dev_s *self)
+{
+    HAL_StatusTypeDef result = HAL_TIM_Base_Stop(self->htim);
+    __HAL_TIM_DISABLE_DMA(self->htim, TIM_DMA_UPDATE);
+    if(result != HAL_OK)
+    {
+        errno = EIO;
+        return -1;
+    }
+    else
+    {
+        errno = 0;
+        return 0;
+    }
+}
+
+int8_t tim_start_pwm(struct tim_dev_s *self, uint32_t Channel, uint16_t duty)
+{
+    uint32_t period = __HAL_TIM_GET_AUTORELOAD(self->htim) + 1;
+    __HAL_TIM_SET_COMPARE(self->htim, Channel, (uint32_t)(((uint64_t)period * duty) >> 16)); //TIM2/5 are 32 bit
+    if(HAL_TIM_PWM_Start(self->htim, Channel) != HAL_OK)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+    else
+    {
+        errno = 0;
+        return 0;
+    }
+}
+
+int8_t tim_stop_pwm(struct tim_dev_s *self, uint32_t Channel)
+{
+    if(HAL_TIM_PWM_Stop(self->htim, Channel) != HAL_OK)
+    {
+        errno = EIO;
+        return -1;
+    }
+    else
+    {
+        errno = 0;
+        return 0;
+    }
+}
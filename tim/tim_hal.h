@@ -9,14 +9,28 @@
 
 #include "stm32h7xx_hal.h"
 
+// Update frequencies set_freq can produce: the timer runs at 40 MHz (240 MHz
+// divided by 6) with a 16 bit period of at least two counts
+#define TIM_FREQ_MIN (611)
+#define TIM_FREQ_MAX (20000000)
+
 struct tim_dev_s
 {    
     TIM_HandleTypeDef *htim;
     int8_t (*set_prescaler) (struct tim_dev_s *self, uint16_t Prescaler);
     int8_t (*set_period) (struct tim_dev_s *self, uint16_t Period);
-    int8_t (*set_freq) (struct tim_dev_s *self, uint32_t Freq);
+    int8_t (*set_freq) (struct tim_dev_s *self, uint32_t Freq); //EINVAL outside TIM_FREQ_MIN..MAX
     int8_t (*start) (struct tim_dev_s *self);
     int8_t (*stop) (struct tim_dev_s *self);
+    // runs the timer without interrupt, every update event requests the DMA
+    // linked to TIM_DMA_ID_UPDATE instead, which has to be started before
+    int8_t (*start_dma_request) (struct tim_dev_s *self);
+    int8_t (*stop_dma_request) (struct tim_dev_s *self);
+    // PWM on the output of Channel (TIM_CHANNEL_x, PWM mode 1 and the pin set
+    // up by CubeMX): high for duty/65536 of the period set before, 0x8000 for a
+    // square wave at the update frequency
+    int8_t (*start_pwm) (struct tim_dev_s *self, uint32_t Channel, uint16_t duty);
+    int8_t (*stop_pwm) (struct tim_dev_s *self, uint32_t Channel);
     //TODO: consider using a vtable
 };
 